@@ -0,0 +1,281 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace bench {
+namespace {
+constexpr std::int64_t kMaxIterations = 1'000'000'000;
+
+std::int64_t realNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::int64_t cpuNow() {
+  timespec spec{};
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &spec);
+  return static_cast<std::int64_t>(spec.tv_sec) * 1'000'000'000 + spec.tv_nsec;
+}
+
+std::vector<std::unique_ptr<Benchmark>>& registry() {
+  static std::vector<std::unique_ptr<Benchmark>> benchmarks;
+  return benchmarks;
+}
+
+struct Options {
+  std::string filter = ".";
+  double minTime = 0.5;
+  std::string format = "console";
+  std::string outPath;
+};
+
+struct Result {
+  std::string name;
+  std::string runName;
+  std::int64_t iterations;
+  double realTime;
+  double cpuTime;
+  double itemsPerSecond;
+  double bytesPerSecond;
+  std::map<std::string, double> counters;
+};
+
+bool readFlag(const std::string& argument, const char* flag, std::string& value) {
+  const auto prefix = std::string("--") + flag + "=";
+  if (argument.rfind(prefix, 0) != 0) {
+    return false;
+  }
+  value = argument.substr(prefix.size());
+  return true;
+}
+
+std::string escape(const std::string& value) {
+  std::string escaped;
+  for (const auto character : value) {
+    if (character == '"' || character == '\\') {
+      escaped += '\\';
+    }
+    escaped += character;
+  }
+  return escaped;
+}
+
+std::string toJson(const std::vector<Result>& results) {
+  std::ostringstream out;
+  const auto now = std::time(nullptr);
+  char date[64];
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+  out << "{\n  \"context\": {\n"
+      << "    \"date\": \"" << date << "\",\n"
+      << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+      << "    \"library_build_type\": \"release\"\n"
+#else
+      << "    \"library_build_type\": \"debug\"\n"
+#endif
+      << "  },\n  \"benchmarks\": [";
+  for (std::size_t index = 0; index < results.size(); ++index) {
+    const auto& result = results[index];
+    out << (index == 0 ? "\n" : ",\n") << "    {\n"
+        << "      \"name\": \"" << escape(result.name) << "\",\n"
+        << "      \"run_name\": \"" << escape(result.runName) << "\",\n"
+        << "      \"run_type\": \"iteration\",\n"
+        << "      \"iterations\": " << result.iterations << ",\n"
+        << "      \"real_time\": " << result.realTime << ",\n"
+        << "      \"cpu_time\": " << result.cpuTime << ",\n"
+        << "      \"time_unit\": \"ns\"";
+    if (result.itemsPerSecond > 0) {
+      out << ",\n      \"items_per_second\": " << result.itemsPerSecond;
+    }
+    if (result.bytesPerSecond > 0) {
+      out << ",\n      \"bytes_per_second\": " << result.bytesPerSecond;
+    }
+    for (const auto& [name, value] : result.counters) {
+      out << ",\n      \"" << escape(name) << "\": " << value;
+    }
+    out << "\n    }";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+void printConsole(const Result& result) {
+  std::printf("%-48s %14.1f ns %14.1f ns %12lld", result.name.c_str(), result.realTime, result.cpuTime,
+              static_cast<long long>(result.iterations));
+  if (result.itemsPerSecond > 0) {
+    std::printf("  items/s=%.3g", result.itemsPerSecond);
+  }
+  if (result.bytesPerSecond > 0) {
+    std::printf("  bytes/s=%.3g", result.bytesPerSecond);
+  }
+  for (const auto& [name, value] : result.counters) {
+    std::printf("  %s=%.3g", name.c_str(), value);
+  }
+  std::printf("\n");
+}
+}  // namespace
+
+State::State(std::int64_t max_iterations, std::vector<std::int64_t> args)
+    : maxIterations_(max_iterations), args_(std::move(args)) {}
+
+bool State::Iterator::operator!=(const Iterator& other) const {
+  if (remaining != other.remaining) {
+    return true;
+  }
+  state->stop();
+  return false;
+}
+
+State::Iterator& State::Iterator::operator++() {
+  --remaining;
+  return *this;
+}
+
+State::Iterator State::begin() {
+  start();
+  return Iterator{this, maxIterations_};
+}
+
+void State::start() {
+  running_ = true;
+  realStart_ = realNow();
+  cpuStart_ = cpuNow();
+}
+
+void State::stop() {
+  if (!running_) {
+    return;
+  }
+  realNanos_ += static_cast<double>(realNow() - realStart_);
+  cpuNanos_ += static_cast<double>(cpuNow() - cpuStart_);
+  running_ = false;
+}
+
+void State::PauseTiming() {
+  stop();
+}
+
+void State::ResumeTiming() {
+  start();
+}
+
+Benchmark::Benchmark(std::string name, Function function) : name_(std::move(name)), function_(std::move(function)) {}
+
+Benchmark* Benchmark::Arg(std::int64_t value) {
+  argSets_.push_back({value});
+  return this;
+}
+
+Benchmark* Benchmark::Args(std::vector<std::int64_t> values) {
+  argSets_.push_back(std::move(values));
+  return this;
+}
+
+Benchmark* registerBenchmark(std::string name, Function function) {
+  registry().push_back(std::make_unique<Benchmark>(std::move(name), std::move(function)));
+  return registry().back().get();
+}
+
+// Grows the iteration count like Google Benchmark until one run lasts at least --benchmark_min_time.
+struct Runner {
+  static Result run(const Benchmark& benchmark, const std::vector<std::int64_t>& args, const std::string& name,
+                    double min_time) {
+    std::int64_t iterations = 1;
+    while (true) {
+      State state(iterations, args);
+      benchmark.function_(state);
+      const auto seconds = state.realNanos_ / 1e9;
+      if (seconds >= min_time || iterations >= kMaxIterations) {
+        Result result{name,
+                      benchmark.name_,
+                      iterations,
+                      state.realNanos_ / static_cast<double>(iterations),
+                      state.cpuNanos_ / static_cast<double>(iterations),
+                      0,
+                      0,
+                      state.counters};
+        if (state.itemsProcessed_ > 0 && seconds > 0) {
+          result.itemsPerSecond = static_cast<double>(state.itemsProcessed_) / seconds;
+        }
+        if (state.bytesProcessed_ > 0 && seconds > 0) {
+          result.bytesPerSecond = static_cast<double>(state.bytesProcessed_) / seconds;
+        }
+        return result;
+      }
+      const auto factor = seconds <= 0 ? 10.0 : std::clamp(min_time * 1.4 / seconds, 2.0, 10.0);
+      iterations = std::min(kMaxIterations, static_cast<std::int64_t>(static_cast<double>(iterations) * factor));
+    }
+  }
+};
+
+int runRegistered(int argc, char** argv) {
+  Options options;
+  for (int index = 1; index < argc; ++index) {
+    const std::string argument = argv[index];
+    std::string value;
+    if (readFlag(argument, "benchmark_filter", value)) {
+      options.filter = value;
+    } else if (readFlag(argument, "benchmark_min_time", value)) {
+      options.minTime = std::stod(value);
+    } else if (readFlag(argument, "benchmark_format", value)) {
+      options.format = value;
+    } else if (readFlag(argument, "benchmark_out", value)) {
+      options.outPath = value;
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>] "
+                   "[--benchmark_format=console|json] [--benchmark_out=<file.json>]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+
+  const std::regex filter(options.filter);
+  const bool console = options.format != "json";
+  std::vector<Result> results;
+  if (console) {
+    std::printf("%-48s %17s %17s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+  }
+  for (const auto& benchmark : registry()) {
+    auto arg_sets = benchmark->argSets();
+    if (arg_sets.empty()) {
+      arg_sets.emplace_back();
+    }
+    for (const auto& args : arg_sets) {
+      auto name = benchmark->name();
+      for (const auto arg : args) {
+        name += '/';
+        name += std::to_string(arg);
+      }
+      if (!std::regex_search(name, filter)) {
+        continue;
+      }
+      results.push_back(Runner::run(*benchmark, args, name, options.minTime));
+      if (console) {
+        printConsole(results.back());
+        std::fflush(stdout);
+      }
+    }
+  }
+
+  const auto json = toJson(results);
+  if (!console) {
+    std::fputs(json.c_str(), stdout);
+  }
+  if (!options.outPath.empty()) {
+    std::ofstream(options.outPath) << json;
+  }
+  return 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Minimal in-tree stand-in for Google Benchmark: same registration/State loop shape and the same JSON schema
+// (so tools/compare.py style diffs work), without a third-party dependency in the native build.
+namespace bench {
+
+class State {
+ public:
+  State(std::int64_t maxIterations, std::vector<std::int64_t> args);
+
+  // Marked unused so `for (auto _ : state)` compiles cleanly under -Wall.
+  struct [[gnu::unused]] Value {};
+
+  struct Iterator {
+    State* state;
+    std::int64_t remaining;
+    bool operator!=(const Iterator& other) const;
+    Iterator& operator++();
+    Value operator*() const { return {}; }
+  };
+
+  Iterator begin();
+  Iterator end() { return Iterator{this, 0}; }
+
+  std::int64_t range(std::size_t index = 0) const { return args_.at(index); }
+  std::int64_t iterations() const { return maxIterations_; }
+  void PauseTiming();
+  void ResumeTiming();
+  void SetItemsProcessed(std::int64_t items) { itemsProcessed_ = items; }
+  void SetBytesProcessed(std::int64_t bytes) { bytesProcessed_ = bytes; }
+
+  std::map<std::string, double> counters;
+
+ private:
+  friend struct Runner;
+  void start();
+  void stop();
+
+  std::int64_t maxIterations_;
+  std::vector<std::int64_t> args_;
+  std::int64_t itemsProcessed_ = 0;
+  std::int64_t bytesProcessed_ = 0;
+  double realNanos_ = 0;
+  double cpuNanos_ = 0;
+  std::int64_t realStart_ = 0;
+  std::int64_t cpuStart_ = 0;
+  bool running_ = false;
+};
+
+using Function = std::function<void(State&)>;
+
+class Benchmark {
+ public:
+  Benchmark(std::string name, Function function);
+  Benchmark* Arg(std::int64_t value);
+  Benchmark* Args(std::vector<std::int64_t> values);
+  const std::string& name() const { return name_; }
+  const std::vector<std::vector<std::int64_t>>& argSets() const { return argSets_; }
+
+ private:
+  friend struct Runner;
+  std::string name_;
+  Function function_;
+  std::vector<std::vector<std::int64_t>> argSets_;
+};
+
+Benchmark* registerBenchmark(std::string name, Function function);
+int runRegistered(int argc, char** argv);
+
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory() {
+  asm volatile("" : : : "memory");
+}
+
+}  // namespace bench
+
+#define BENCH_CONCAT_IMPL(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_IMPL(a, b)
+#define BENCHMARK(function) \
+  static ::bench::Benchmark* BENCH_CONCAT(benchmark_registration_, __LINE__) = ::bench::registerBenchmark(#function, function)
@@ -0,0 +1,683 @@
+#include "benchmark.hpp"
+#include "engine.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Engine hot-path microbenchmarks. Results go to stdout, or as JSON with --benchmark_format=json or
+// --benchmark_out=<file> so runs can be diffed before and after a data-model change.
+namespace {
+constexpr int kCommandsPerIteration = 1024;
+const std::string kColor = "#2563eb";
+
+std::string strokeId(std::int64_t index) {
+  return "stroke-" + std::to_string(index);
+}
+
+// Fresh engine per iteration so mutating benchmarks measure a steady-size document, not unbounded growth.
+template <typename Setup, typename Body>
+void runOnFreshEngine(bench::State& state, Setup&& setup, Body&& body) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto engine = std::make_unique<Engine>();
+    setup(*engine);
+    state.ResumeTiming();
+    body(*engine);
+    state.PauseTiming();
+    engine.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * kCommandsPerIteration);
+}
+
+void appendFloat(std::vector<std::uint32_t>& words, float value) {
+  std::uint32_t word;
+  std::memcpy(&word, &value, sizeof(word));
+  words.push_back(word);
+}
+
+void runBatch(Engine& engine, const std::vector<std::uint32_t>& words) {
+  const auto byte_length = static_cast<std::uint32_t>(words.size() * 4);
+  std::memcpy(engine.commandBuffer(byte_length).data(), words.data(), byte_length);
+  engine.executeBatch(byte_length);
+}
+
+void BM_CreateRectangle(bench::State& state) {
+  runOnFreshEngine(state, [](Engine&) {}, [](Engine& engine) {
+    for (int index = 0; index < kCommandsPerIteration; ++index) {
+      engine.createRectangle(static_cast<float>(index), 0, 10, 10, kColor);
+    }
+  });
+}
+BENCHMARK(BM_CreateRectangle);
+
+void BM_StartFinishStroke(bench::State& state) {
+  std::vector<std::string> ids;
+  for (int index = 0; index < kCommandsPerIteration; ++index) {
+    ids.push_back(strokeId(index));
+  }
+  runOnFreshEngine(state, [](Engine&) {}, [&](Engine& engine) {
+    for (const auto& id : ids) {
+      engine.startStroke(id, 0, 0, 4, kColor);
+      engine.finishStroke(id);
+    }
+  });
+}
+BENCHMARK(BM_StartFinishStroke);
+
+void BM_UpdateStroke(bench::State& state) {
+  const auto id = strokeId(0);
+  runOnFreshEngine(state, [&](Engine& engine) { engine.startStroke(id, 0, 0, 4, kColor); }, [&](Engine& engine) {
+    for (int index = 0; index < kCommandsPerIteration; ++index) {
+      engine.updateStroke(id, static_cast<float>(index), static_cast<float>(index));
+    }
+  });
+}
+BENCHMARK(BM_UpdateStroke);
+
+// updateStroke spread over many open strokes, dominated by the findStroke() lookup.
+void BM_FindStroke(bench::State& state) {
+  const auto open_strokes = state.range(0);
+  std::vector<std::string> ids;
+  for (std::int64_t index = 0; index < open_strokes; ++index) {
+    ids.push_back(strokeId(index));
+  }
+  std::mt19937 random(42);
+  std::vector<std::size_t> order(kCommandsPerIteration);
+  for (auto& slot : order) {
+    slot = random() % ids.size();
+  }
+  runOnFreshEngine(
+      state,
+      [&](Engine& engine) {
+        for (const auto& id : ids) {
+          engine.startStroke(id, 0, 0, 4, kColor);
+        }
+      },
+      [&](Engine& engine) {
+        for (const auto slot : order) {
+          engine.updateStroke(ids[slot], 1, 1);
+        }
+      });
+}
+BENCHMARK(BM_FindStroke)->Arg(1)->Arg(64)->Arg(4096);
+
+void BM_ExecuteBatchUpdateStroke(bench::State& state) {
+  runOnFreshEngine(state, [](Engine&) {}, [](Engine& engine) {
+    const auto id = engine.internString("stroke-0");
+    engine.startStroke("stroke-0", 0, 0, 4, kColor);
+    std::vector<std::uint32_t> words;
+    for (int index = 0; index < kCommandsPerIteration; ++index) {
+      words.push_back(static_cast<std::uint32_t>(CommandOp::UpdateStroke) | (4u << 16));
+      words.push_back(id);
+      appendFloat(words, static_cast<float>(index));
+      appendFloat(words, static_cast<float>(index));
+    }
+    runBatch(engine, words);
+  });
+}
+BENCHMARK(BM_ExecuteBatchUpdateStroke);
+
+// Same stream addressed by the handle returned by startStroke instead of the id's string index.
+void BM_ExecuteBatchUpdateStrokeHandle(bench::State& state) {
+  runOnFreshEngine(state, [](Engine&) {}, [](Engine& engine) {
+    const auto handle = engine.startStroke("stroke-0", 0, 0, 4, kColor);
+    std::vector<std::uint32_t> words;
+    for (int index = 0; index < kCommandsPerIteration; ++index) {
+      words.push_back(static_cast<std::uint32_t>(CommandOp::UpdateStrokeHandle) | (5u << 16));
+      words.push_back(handle.slot);
+      words.push_back(handle.generation);
+      appendFloat(words, static_cast<float>(index));
+      appendFloat(words, static_cast<float>(index));
+    }
+    runBatch(engine, words);
+  });
+}
+BENCHMARK(BM_ExecuteBatchUpdateStrokeHandle);
+
+void BM_ExecuteBatchCreateRectangle(bench::State& state) {
+  runOnFreshEngine(state, [](Engine&) {}, [](Engine& engine) {
+    const auto color = engine.internString(kColor);
+    std::vector<std::uint32_t> words;
+    for (int index = 0; index < kCommandsPerIteration; ++index) {
+      words.push_back(static_cast<std::uint32_t>(CommandOp::CreateRectangle) | (6u << 16));
+      appendFloat(words, static_cast<float>(index));
+      appendFloat(words, 0);
+      appendFloat(words, 10);
+      appendFloat(words, 10);
+      words.push_back(color);
+    }
+    runBatch(engine, words);
+  });
+}
+BENCHMARK(BM_ExecuteBatchCreateRectangle);
+
+// Presence updates from `range(0)` concurrent pointers.
+void BM_PointerMove(bench::State& state) {
+  const auto pointers = static_cast<int>(state.range(0));
+  Engine engine;
+  int step = 0;
+  for (auto _ : state) {
+    for (int index = 0; index < kCommandsPerIteration; ++index) {
+      engine.pointerMove(index % pointers, static_cast<float>(step), static_cast<float>(index));
+    }
+    ++step;
+  }
+  state.SetItemsProcessed(state.iterations() * kCommandsPerIteration);
+}
+BENCHMARK(BM_PointerMove)->Arg(1)->Arg(16)->Arg(256);
+
+void BM_TickBinaryRectangles(bench::State& state) {
+  Engine engine;
+  for (std::int64_t index = 0; index < state.range(0); ++index) {
+    engine.createRectangle(static_cast<float>(index % 1000), static_cast<float>(index / 1000), 10, 10, kColor);
+  }
+  std::size_t bytes = 0;
+  for (auto _ : state) {
+    const auto snapshot = engine.tickBinary();
+    bytes = snapshot.size();
+    bench::DoNotOptimize(snapshot.data());
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(bytes));
+  state.counters["shapes"] = static_cast<double>(state.range(0));
+}
+BENCHMARK(BM_TickBinaryRectangles)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// `range(0)` strokes sharing `range(1)` points in total (1M points for the largest case).
+void BM_TickBinaryStrokes(bench::State& state) {
+  Engine engine;
+  const auto strokes = state.range(0);
+  const auto points_per_stroke = state.range(1) / strokes;
+  for (std::int64_t stroke = 0; stroke < strokes; ++stroke) {
+    const auto id = strokeId(stroke);
+    engine.startStroke(id, 0, 0, 4, kColor);
+    for (std::int64_t point = 1; point < points_per_stroke; ++point) {
+      engine.updateStroke(id, static_cast<float>(point), static_cast<float>(stroke));
+    }
+    engine.finishStroke(id);
+  }
+  std::size_t bytes = 0;
+  for (auto _ : state) {
+    const auto snapshot = engine.tickBinary();
+    bytes = snapshot.size();
+    bench::DoNotOptimize(snapshot.data());
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(bytes));
+  state.counters["points"] = static_cast<double>(strokes * points_per_stroke);
+}
+BENCHMARK(BM_TickBinaryStrokes)->Args({1000, 1000000})->Args({10000, 1000000});
+
+// Viewport-sized rectangle and point queries over `range(0)` rectangles scattered on a 20000x20000 board.
+void BM_QueryRect(bench::State& state) {
+  Engine engine;
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> position(0, 20000);
+  std::uniform_real_distribution<float> extent(4, 200);
+  for (std::int64_t index = 0; index < state.range(0); ++index) {
+    engine.createRectangle(position(random), position(random), extent(random), extent(random), kColor);
+  }
+  std::size_t hits = 0;
+  float origin = 0;
+  for (auto _ : state) {
+    const auto rows = engine.queryRect(origin, origin, origin + 1280, origin + 800);
+    hits += rows.size();
+    bench::DoNotOptimize(rows.data());
+    origin = origin > 18000 ? 0 : origin + 97;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hits/query"] = static_cast<double>(hits) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_QueryRect)->Arg(10000)->Arg(100000);
+
+void BM_QueryPoint(bench::State& state) {
+  Engine engine;
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> position(0, 20000);
+  std::uniform_real_distribution<float> extent(4, 200);
+  for (std::int64_t index = 0; index < state.range(0); ++index) {
+    engine.createRectangle(position(random), position(random), extent(random), extent(random), kColor);
+  }
+  for (auto _ : state) {
+    const auto rows = engine.queryPoint(position(random), position(random));
+    bench::DoNotOptimize(rows.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueryPoint)->Arg(10000)->Arg(100000);
+
+// `count` finished 100-point strokes scattered on a 20000x20000 board.
+void scatterStrokes(Engine& engine, std::int64_t count) {
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> position(0, 20000);
+  for (std::int64_t stroke = 0; stroke < count; ++stroke) {
+    const auto id = strokeId(stroke);
+    const auto x = position(random);
+    const auto y = position(random);
+    engine.startStroke(id, x, y, 4, kColor);
+    for (int point = 1; point < 100; ++point) {
+      engine.updateStroke(id, x + static_cast<float>(point), y + static_cast<float>(point % 7));
+    }
+    engine.finishStroke(id);
+  }
+}
+
+// One 1280x800 viewport over `range(0)` strokes; compare with BM_TickBinaryStrokes.
+void BM_TickVisible(bench::State& state) {
+  Engine engine;
+  scatterStrokes(engine, state.range(0));
+  engine.setViewport(9000, 9000, 1280, 800);
+  std::size_t shapes = 0;
+  for (auto _ : state) {
+    const auto snapshot = engine.tickVisible();
+    std::uint32_t count;
+    std::memcpy(&count, snapshot.data() + 12, sizeof(count));
+    shapes += count;
+    bench::DoNotOptimize(snapshot.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["shapes/frame"] = static_cast<double>(shapes) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_TickVisible)->Arg(10000)->Arg(100000);
+
+// Pixel kernels over a 1280x800 frame; `range(0)` is 0 for the scalar kernels, 1 for pixelKernels() (SIMD when the
+// build has it). Items are pixels, so items/s reads as pixels per second.
+const PixelKernels& benchKernels(const bench::State& state) {
+  return state.range(0) == 0 ? scalarPixelKernels() : pixelKernels();
+}
+
+constexpr std::size_t kFramePixels = 1280 * 800;
+
+void BM_KernelFill(bench::State& state) {
+  const auto& kernels = benchKernels(state);
+  std::vector<std::uint32_t> pixels(kFramePixels);
+  for (auto _ : state) {
+    kernels.fill(pixels.data(), pixels.size(), 0xFFFFFFFF);
+    bench::DoNotOptimize(pixels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(kFramePixels));
+}
+BENCHMARK(BM_KernelFill)->Arg(0)->Arg(1);
+
+// A translucent span, as fillRect draws the inside of a rectangle.
+void BM_KernelBlend(bench::State& state) {
+  const auto& kernels = benchKernels(state);
+  std::vector<std::uint32_t> pixels(kFramePixels, 0xFFFFFFFF);
+  for (auto _ : state) {
+    kernels.blend(pixels.data(), pixels.size(), 0x80204080, 200);
+    bench::DoNotOptimize(pixels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(kFramePixels));
+}
+BENCHMARK(BM_KernelBlend)->Arg(0)->Arg(1);
+
+// Stroke compositing through a coverage mask of anti-aliased ramps.
+void BM_KernelBlendMask(bench::State& state) {
+  const auto& kernels = benchKernels(state);
+  std::vector<std::uint32_t> pixels(kFramePixels, 0xFFFFFFFF);
+  std::vector<std::uint8_t> mask(kFramePixels);
+  for (std::size_t index = 0; index < mask.size(); ++index) {
+    mask[index] = static_cast<std::uint8_t>(index * 7);
+  }
+  for (auto _ : state) {
+    kernels.blendMask(pixels.data(), mask.data(), pixels.size(), 0xC0102030);
+    bench::DoNotOptimize(pixels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(kFramePixels));
+}
+BENCHMARK(BM_KernelBlendMask)->Arg(0)->Arg(1);
+
+// Capsule coverage for every row of the frame against one diagonal segment.
+void BM_KernelAccumulateCapsule(bench::State& state) {
+  const auto& kernels = benchKernels(state);
+  constexpr int kWidth = 1280;
+  constexpr int kHeight = 800;
+  std::vector<std::uint8_t> mask(kFramePixels);
+  constexpr float kDx = 1000;
+  constexpr float kDy = 600;
+  for (auto _ : state) {
+    for (int row = 0; row < kHeight; ++row) {
+      const CapsuleRow capsule{0, 100, static_cast<float>(row) + 0.5f - 100, kDx, kDy, 1 / (kDx * kDx + kDy * kDy), 8};
+      kernels.accumulateCapsule(mask.data() + static_cast<std::size_t>(row) * kWidth, kWidth, capsule);
+    }
+    bench::DoNotOptimize(mask.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(kFramePixels));
+}
+BENCHMARK(BM_KernelAccumulateCapsule)->Arg(0)->Arg(1);
+
+// Cold frames: the viewport jumps by its own width every iteration, so every tile is rasterized from scratch.
+// `range(1)` device pixels per unit, `range(2)` render threads (0 for the hardware concurrency).
+void BM_RenderScroll(bench::State& state) {
+  Engine engine;
+  engine.setRenderThreads(static_cast<std::size_t>(state.range(2)));
+  scatterStrokes(engine, state.range(0));
+  const auto scale = static_cast<float>(state.range(1));
+  float origin = 0;
+  std::int64_t tiles = 0;
+  for (auto _ : state) {
+    engine.setViewport(origin, 9000, 1280, 800);
+    const auto frame = engine.render(scale);
+    tiles += frame.tilesRendered;
+    bench::DoNotOptimize(frame.pixels.data());
+    origin = origin > 17000 ? 0 : origin + 1280;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["tiles/frame"] = static_cast<double>(tiles) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_RenderScroll)
+    ->Args({10000, 1, 1})
+    ->Args({100000, 1, 1})
+    ->Args({100000, 2, 1})
+    ->Args({100000, 2, 0});
+
+// Steady drawing over a full viewport: each frame appends one point to a stroke, then renders.
+void BM_RenderDrawing(bench::State& state) {
+  Engine engine;
+  scatterStrokes(engine, state.range(0));
+  engine.setViewport(9000, 9000, 1280, 800);
+  engine.startStroke("drawing", 9500, 9300, 4, kColor);
+  engine.render(1);
+  float x = 9500;
+  std::int64_t tiles = 0;
+  for (auto _ : state) {
+    x = x > 10000 ? 9500 : x + 3;
+    engine.updateStroke("drawing", x, 9300 + (x - 9500) / 10);
+    const auto frame = engine.render(1);
+    tiles += frame.tilesRendered;
+    bench::DoNotOptimize(frame.pixels.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["tiles/frame"] = static_cast<double>(tiles) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_RenderDrawing)->Arg(10000)->Arg(100000);
+
+// A finished `range(0)`-point stroke zigzagging over the whole viewport, and a small rectangle added each frame, so
+// one tile crossed by the stroke is redrawn per frame. With the stroke's coverage cached per tile, the frame cost
+// should not grow with the point count.
+void BM_RenderOverLongStroke(bench::State& state) {
+  Engine engine;
+  engine.resize(1280, 800);
+  const auto points = state.range(0);
+  engine.startStroke("long", 0, 0, 3, kColor);
+  for (std::int64_t index = 1; index < points; ++index) {
+    const auto x = static_cast<float>(index % 64) * 20;
+    const auto y = static_cast<float>(index) * 800 / static_cast<float>(points);
+    engine.updateStroke("long", index % 2 == 0 ? x : 1280 - x, y);
+  }
+  engine.finishStroke("long");
+  engine.render(1);
+  std::int64_t frame = 0;
+  for (auto _ : state) {
+    const auto x = static_cast<float>(frame % 5) * 256 + 100;
+    const auto y = static_cast<float>(frame / 5 % 3) * 256 + 100;
+    engine.createRectangle(x, y, 4, 4, kColor);
+    bench::DoNotOptimize(engine.render(1).pixels.data());
+    ++frame;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RenderOverLongStroke)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// A 1000-sample stroke as a high-rate mouse reports it (0.3 units apart, with sub-pixel jitter), drawn and finished
+// with a simplification tolerance of `range(0)` hundredths of a unit; `points/stroke` is what the document keeps.
+void BM_IngestStroke(bench::State& state) {
+  constexpr int kSamples = 1000;
+  std::mt19937 random(3);
+  std::uniform_real_distribution<float> jitter(-0.1f, 0.1f);
+  std::vector<StrokePoint> samples;
+  for (int index = 0; index < kSamples; ++index) {
+    const auto t = static_cast<float>(index) * 0.3f;
+    samples.push_back({t + jitter(random), 40 * std::sin(t / 50) + jitter(random)});
+  }
+  std::size_t kept = 0;
+  runOnFreshEngine(
+      state,
+      [&](Engine& engine) { engine.setSimplifyTolerance(static_cast<float>(state.range(0)) / 100); },
+      [&](Engine& engine) {
+        const auto stroke = engine.startStroke("ingest", samples[0].x, samples[0].y, 2, kColor);
+        for (std::size_t index = 1; index < samples.size(); ++index) {
+          engine.updateStroke(stroke, samples[index].x, samples[index].y);
+        }
+        engine.finishStroke(stroke);
+        kept = engine.shapes().points(0).size();
+      });
+  state.SetItemsProcessed(state.iterations() * kSamples);
+  state.counters["points/stroke"] = static_cast<double>(kept);
+}
+BENCHMARK(BM_IngestStroke)->Arg(0)->Arg(25)->Arg(50);
+
+// Steady drawing: one frame of appended points on top of a `range(0)`-shape document, then a delta.
+void BM_TickSinceAppend(bench::State& state) {
+  Engine engine;
+  for (std::int64_t index = 0; index < state.range(0); ++index) {
+    engine.createRectangle(static_cast<float>(index % 1000), static_cast<float>(index / 1000), 10, 10, kColor);
+  }
+  engine.startStroke("active", 0, 0, 4, kColor);
+  auto acknowledged = engine.revision();
+  engine.tickSince(acknowledged);
+  float step = 0;
+  for (auto _ : state) {
+    for (int point = 0; point < 4; ++point) {
+      engine.updateStroke("active", step, step);
+      step += 1;
+    }
+    bench::DoNotOptimize(engine.tickSince(acknowledged).data());
+    acknowledged = engine.revision();
+  }
+}
+BENCHMARK(BM_TickSinceAppend)->Arg(1000)->Arg(100000);
+
+// A board of `range(0)` finished 1000-point random-walk strokes, for the document benchmarks.
+void drawWalkBoard(Engine& engine, std::int64_t strokes) {
+  engine.setSimplifyTolerance(0);
+  std::mt19937 random(11);
+  std::uniform_real_distribution<float> step(-2, 2);
+  for (std::int64_t index = 0; index < strokes; ++index) {
+    auto x = static_cast<float>(index % 100) * 40;
+    auto y = static_cast<float>(index / 100) * 40;
+    const auto stroke = engine.startStroke(strokeId(index), x, y, 3, kColor);
+    for (int point = 1; point < 1000; ++point) {
+      x += step(random);
+      y += step(random);
+      engine.updateStroke(stroke, x, y);
+    }
+    engine.finishStroke(stroke);
+  }
+}
+
+std::vector<std::uint8_t> saveDocument(Engine& engine) {
+  std::vector<std::uint8_t> bytes;
+  engine.beginSave();
+  for (auto chunk = engine.saveChunk(); !chunk.empty(); chunk = engine.saveChunk()) {
+    bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+  }
+  return bytes;
+}
+
+// Encoding the whole board chunk by chunk; `bytes/point` is the size of the saved document per stroke point.
+void BM_SaveDocument(bench::State& state) {
+  Engine engine;
+  drawWalkBoard(engine, state.range(0));
+  std::size_t bytes = 0;
+  for (auto _ : state) {
+    bytes = 0;
+    engine.beginSave();
+    for (auto chunk = engine.saveChunk(); !chunk.empty(); chunk = engine.saveChunk()) {
+      bytes += chunk.size();
+      bench::DoNotOptimize(chunk.data());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(bytes));
+  state.counters["bytes/point"] = static_cast<double>(bytes) / static_cast<double>(state.range(0) * 1000);
+}
+BENCHMARK(BM_SaveDocument)->Arg(100)->Arg(1000);
+
+// Decoding the same board fed in 1 MiB pieces, as the worker reads a file stream, into a fresh engine.
+void BM_LoadDocument(bench::State& state) {
+  std::vector<std::uint8_t> bytes;
+  {
+    Engine source;
+    drawWalkBoard(source, state.range(0));
+    bytes = saveDocument(source);
+  }
+  constexpr std::size_t kPieceBytes = 1 << 20;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto engine = std::make_unique<Engine>();
+    state.ResumeTiming();
+    const std::span<const std::uint8_t> document(bytes);
+    engine->beginLoad();
+    for (std::size_t offset = 0; offset < document.size(); offset += kPieceBytes) {
+      engine->loadChunk(document.subspan(offset, std::min(kPieceBytes, document.size() - offset)));
+    }
+    bench::DoNotOptimize(engine->finishLoad());
+    state.PauseTiming();
+    engine.reset();
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(bytes.size()));
+}
+BENCHMARK(BM_LoadDocument)->Arg(100)->Arg(1000);
+
+// Opening the same board saved as an archive, mapped from a file: only shape records and strings are read, so the
+// cost follows the shape count rather than the points, which stay on disk until drawn.
+void BM_OpenArchive(bench::State& state) {
+  const auto path = (std::filesystem::temp_directory_path() / "figma_engine_bench.mdar").string();
+  std::size_t archive_bytes = 0;
+  {
+    Engine source;
+    drawWalkBoard(source, state.range(0));
+    std::ofstream file(path, std::ios::binary);
+    source.beginArchiveSave();
+    for (auto chunk = source.saveChunk(); !chunk.empty(); chunk = source.saveChunk()) {
+      file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+      archive_bytes += chunk.size();
+    }
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto engine = std::make_unique<Engine>();
+    state.ResumeTiming();
+    const auto file = MappedFile::open(path);
+    bench::DoNotOptimize(engine->openArchive(file->bytes(), file));
+    state.PauseTiming();
+    engine.reset();
+    state.ResumeTiming();
+  }
+  std::filesystem::remove(path);
+  state.counters["bytes/point"] = static_cast<double>(archive_bytes) / static_cast<double>(state.range(0) * 1000);
+}
+BENCHMARK(BM_OpenArchive)->Arg(100)->Arg(1000);
+
+// An autosave on a `range(0)`-shape board (every fifth a 100-point stroke) after a burst of edits: a short stroke
+// and a rectangle. range(1) = 0 appends the journal chunk, 1 writes the whole document as a save did before the
+// journal; `bytes/save` is what reaches storage.
+void BM_Autosave(bench::State& state) {
+  Engine engine;
+  engine.setJournaling(true);
+  engine.setSimplifyTolerance(0);
+  for (std::int64_t index = 0; index < state.range(0); ++index) {
+    const auto x = static_cast<float>(index % 250) * 16;
+    const auto y = static_cast<float>(index / 250) * 16;
+    if (index % 5 != 0) {
+      engine.createRectangle(x, y, 10, 10, kColor);
+      continue;
+    }
+    const auto stroke = engine.startStroke(strokeId(index), x, y, 2, kColor);
+    for (int point = 1; point < 100; ++point) {
+      engine.updateStroke(stroke, x + static_cast<float>(point) * 0.1f, y + static_cast<float>(point % 7));
+    }
+    engine.finishStroke(stroke);
+  }
+  engine.journalChunk();
+  const auto full_save = state.range(1) == 1;
+  std::size_t bytes = 0;
+  std::int64_t edit = 0;
+  for (auto _ : state) {
+    const auto stroke = engine.startStroke(strokeId(state.range(0) + edit), 0, 0, 2, kColor);
+    for (int point = 1; point < 32; ++point) {
+      engine.updateStroke(stroke, static_cast<float>(point), static_cast<float>(point % 5));
+    }
+    engine.finishStroke(stroke);
+    engine.createRectangle(static_cast<float>(edit % 100), 0, 5, 5, kColor);
+    ++edit;
+    bytes = 0;
+    if (full_save) {
+      engine.beginSave();
+      for (auto chunk = engine.saveChunk(); !chunk.empty(); chunk = engine.saveChunk()) {
+        bytes += chunk.size();
+        bench::DoNotOptimize(chunk.data());
+      }
+    } else {
+      const auto chunk = engine.journalChunk();
+      bytes = chunk.size();
+      bench::DoNotOptimize(chunk.data());
+    }
+  }
+  state.counters["bytes/save"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_Autosave)->Args({50000, 0})->Args({50000, 1});
+
+// Undo then redo of one action on a board of range(0) shapes: the stroke drawn last (range(1) == 0) or a stroke
+// removed from the middle of the z order (1), which shifts the rows above it both ways.
+void BM_UndoRedo(bench::State& state) {
+  Engine engine;
+  for (std::int64_t index = 0; index < state.range(0); ++index) {
+    const auto x = static_cast<float>(index % 250) * 16;
+    const auto y = static_cast<float>(index / 250) * 16;
+    if (index % 5 != 0) {
+      engine.createRectangle(x, y, 10, 10, kColor);
+      continue;
+    }
+    const auto stroke = engine.startStroke(strokeId(index), x, y, 2, kColor);
+    for (int point = 1; point < 100; ++point) {
+      engine.updateStroke(stroke, x + static_cast<float>(point) * 0.1f, y + static_cast<float>(point % 7));
+    }
+    engine.finishStroke(stroke);
+  }
+  if (state.range(1) == 1) {
+    engine.removeShape(engine.shapes().handle(static_cast<std::size_t>(state.range(0) / 2 / 5 * 5)));
+  }
+  for (auto _ : state) {
+    engine.undo();
+    engine.redo();
+  }
+  state.counters["history bytes"] = static_cast<double>(engine.historyBytes());
+}
+BENCHMARK(BM_UndoRedo)->Args({10000, 0})->Args({100000, 0})->Args({10000, 1})->Args({100000, 1});
+
+// Decoding every packed stroke of the walk board without the cache, as a save or snapshot does; items are points.
+// `bytes/point` is what the packed stream costs per point, against 8 for raw pairs.
+void BM_DecodeStrokes(bench::State& state) {
+  Engine engine;
+  drawWalkBoard(engine, state.range(0));
+  const auto& shapes = engine.shapes();
+  std::vector<StrokePoint> scratch;
+  std::size_t points = 0;
+  for (auto _ : state) {
+    points = 0;
+    for (std::size_t index = 0; index < shapes.count(); ++index) {
+      const auto decoded = shapes.points(index, scratch);
+      points += decoded.size();
+      bench::DoNotOptimize(decoded.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(points));
+  state.counters["bytes/point"] =
+      static_cast<double>(shapes.pointArena.packed().size()) / static_cast<double>(points);
+}
+BENCHMARK(BM_DecodeStrokes)->Arg(100)->Arg(1000);
+}  // namespace
+
+int main(int argc, char** argv) {
+  return bench::runRegistered(argc, argv);
+}
@@ -0,0 +1,195 @@
+#include "engine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Replays a session trace recorded by the worker (src/engine/sessionRecorder.ts) into a native Engine, one
+// executeBatch() per recorded frame followed by the worker's per-frame ticks, and reports frame timings.
+namespace {
+constexpr std::uint32_t kTraceMagic = 0x5254444D;  // "MDTR"
+constexpr std::uint16_t kTraceVersion = 1;
+constexpr std::uint16_t kTraceFrameMarker = 0xFFFF;
+
+struct Frame {
+  std::uint64_t timeMicros;
+  std::vector<std::uint8_t> commands;
+  std::size_t records;
+};
+
+struct Options {
+  std::string path;
+  bool recordedSpeed = false;
+  bool json = false;
+  int repeat = 1;
+};
+
+template <typename T>
+T readAt(const std::vector<std::uint8_t>& bytes, std::size_t offset) {
+  T value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(T));
+  return value;
+}
+
+bool loadFrames(const std::string& path, std::vector<Frame>& frames) {
+  std::ifstream file(path, std::ios::binary);
+  const std::vector<std::uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+  if (bytes.size() < 8 || readAt<std::uint32_t>(bytes, 0) != kTraceMagic ||
+      readAt<std::uint16_t>(bytes, 4) != kTraceVersion) {
+    return false;
+  }
+
+  std::size_t offset = readAt<std::uint16_t>(bytes, 6);
+  std::uint64_t time = 0;
+  Frame frame{0, {}, 0};
+  while (offset + 8 <= bytes.size()) {
+    time += readAt<std::uint32_t>(bytes, offset);
+    const auto header = readAt<std::uint32_t>(bytes, offset + 4);
+    const auto record_bytes = static_cast<std::size_t>(header >> 16) * 4;
+    if (record_bytes == 0 || offset + 4 + record_bytes > bytes.size()) {
+      break;
+    }
+
+    if ((header & 0xFFFF) == kTraceFrameMarker) {
+      frame.timeMicros = time;
+      frames.push_back(std::move(frame));
+      frame = Frame{0, {}, 0};
+    } else {
+      const auto* record = bytes.data() + offset + 4;
+      frame.commands.insert(frame.commands.end(), record, record + record_bytes);
+      ++frame.records;
+    }
+    offset += 4 + record_bytes;
+  }
+  if (!frame.commands.empty()) {
+    frame.timeMicros = time;
+    frames.push_back(std::move(frame));
+  }
+  return true;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  const auto index = static_cast<std::size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+double elapsedMicros(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* name, const std::vector<double>& values, bool json, bool last) {
+  double total = 0;
+  for (const auto value : values) {
+    total += value;
+  }
+  const auto mean = values.empty() ? 0 : total / static_cast<double>(values.size());
+  if (json) {
+    std::printf("    \"%s\": {\"mean_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, "
+                "\"max_us\": %.3f, \"total_us\": %.3f}%s\n",
+                name, mean, percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99),
+                percentile(values, 1.0), total, last ? "" : ",");
+    return;
+  }
+  std::printf("%-10s mean %9.2f us  p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f  total %12.1f us\n", name, mean,
+              percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99), percentile(values, 1.0),
+              total);
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+  for (int index = 1; index < argc; ++index) {
+    const std::string argument = argv[index];
+    if (argument == "--speed=recorded") {
+      options.recordedSpeed = true;
+    } else if (argument == "--speed=max") {
+      options.recordedSpeed = false;
+    } else if (argument == "--json") {
+      options.json = true;
+    } else if (argument.rfind("--repeat=", 0) == 0) {
+      options.repeat = std::max(1, std::stoi(argument.substr(9)));
+    } else if (options.path.empty() && argument.rfind("--", 0) != 0) {
+      options.path = argument;
+    } else {
+      return false;
+    }
+  }
+  return !options.path.empty();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    std::fprintf(stderr, "usage: %s <session.mdtr> [--speed=recorded|max] [--repeat=N] [--json]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Frame> frames;
+  if (!loadFrames(options.path, frames)) {
+    std::fprintf(stderr, "%s: not a session trace\n", options.path.c_str());
+    return 1;
+  }
+
+  std::vector<double> execute_times;
+  std::vector<double> tick_times;
+  std::vector<double> frame_times;
+  std::size_t records = 0;
+  for (int run = 0; run < options.repeat; ++run) {
+    Engine engine;
+    std::uint32_t acknowledged = 0;
+    const auto replay_start = std::chrono::steady_clock::now();
+    for (const auto& frame : frames) {
+      if (options.recordedSpeed) {
+        std::this_thread::sleep_until(replay_start + std::chrono::microseconds(frame.timeMicros));
+      }
+
+      // Same per-frame work as the worker's render loop: apply the batch, paint a snapshot, emit a delta.
+      const auto frame_start = std::chrono::steady_clock::now();
+      const auto byte_length = static_cast<std::uint32_t>(frame.commands.size());
+      std::memcpy(engine.commandBuffer(byte_length).data(), frame.commands.data(), byte_length);
+      engine.executeBatch(byte_length);
+      const auto execute_time = elapsedMicros(frame_start);
+
+      const auto tick_start = std::chrono::steady_clock::now();
+      engine.tickBinary();
+      engine.tickSince(acknowledged);
+      acknowledged = engine.revision();
+      const auto tick_time = elapsedMicros(tick_start);
+
+      execute_times.push_back(execute_time);
+      tick_times.push_back(tick_time);
+      frame_times.push_back(execute_time + tick_time);
+      records += frame.records;
+    }
+  }
+
+  const auto duration_ms = frames.empty() ? 0.0 : static_cast<double>(frames.back().timeMicros) / 1000.0;
+  if (options.json) {
+    std::printf("{\n  \"trace\": \"%s\",\n  \"frames\": %zu,\n  \"records\": %zu,\n  \"recorded_ms\": %.3f,\n"
+                "  \"repeat\": %d,\n  \"timings\": {\n",
+                options.path.c_str(), frames.size(), records / static_cast<std::size_t>(options.repeat), duration_ms,
+                options.repeat);
+    report("execute", execute_times, true, false);
+    report("tick", tick_times, true, false);
+    report("frame", frame_times, true, true);
+    std::printf("  }\n}\n");
+    return 0;
+  }
+
+  std::printf("%s: %zu frames, %zu records, %.1f ms recorded, %d run(s)\n", options.path.c_str(), frames.size(),
+              records / static_cast<std::size_t>(options.repeat), duration_ms, options.repeat);
+  report("execute", execute_times, false, false);
+  report("tick", tick_times, false, false);
+  report("frame", frame_times, false, true);
+  return 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "document_format.hpp"
+#include "shape_store.hpp"
+#include "string_table.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Mappable document layout ("MDAR"), for archives opened in place rather than decoded: a 16-byte header (magic,
+// version u16, headerBytes u16, sectionCount, flags), then a directory of 24-byte entries (section id, reserved,
+// offset u64, bytes u64) and the sections, each starting on a 64-byte boundary:
+//   1 meta:           shapeCount u64, pointCount u64, stringCount u64, rectangle and stroke counters u32
+//   2 shapes:         56 bytes per shape in z order: kind, RGBA, id, name and color string indices, size, then
+//                     x, y, width, height (f32; the stroke's point bounds), pointOffset u64, pointCount, reserved
+//   3 points:         x, y f32 pairs, each stroke's points contiguous
+//   4 string offsets: stringCount + 1 u64 offsets into the string bytes
+//   5 string bytes:   UTF-8, back to back
+// Points are stored exactly as StrokePoint, so they are used straight from the mapping and only the pages of the
+// strokes that are drawn or serialized are ever read. All values are little-endian.
+struct ArchiveShape {
+  ShapeKind kind;
+  std::uint32_t rgba;
+  std::uint32_t id;
+  std::uint32_t name;
+  std::uint32_t color;
+  float size;
+  float x;
+  float y;
+  float width;
+  float height;
+  std::uint64_t pointOffset;
+  std::uint32_t pointCount;
+};
+
+// Encodes a document in the mappable layout, chunk by chunk. Section sizes are known up front, so the directory
+// comes first and no byte is written twice. The store and table must not change until the last chunk.
+class ArchiveWriter {
+ public:
+  void begin(const ShapeStore& shapes, const StringTable& strings, DocumentCounters counters);
+  // The next chunk, valid until the following call; empty once the archive is written or after abort().
+  std::span<const std::uint8_t> next();
+  void abort();
+
+ private:
+  enum class Stage : std::uint8_t { Idle, Header, Shapes, Points, StringOffsets, StringBytes, Done };
+
+  void padTo(std::uint64_t offset);
+
+  const ShapeStore* shapes_ = nullptr;
+  const StringTable* strings_ = nullptr;
+  DocumentCounters counters_{};
+  Stage stage_ = Stage::Idle;
+  std::size_t cursor_ = 0;
+  std::uint64_t written_ = 0;
+  std::uint64_t pointCursor_ = 0;
+  std::uint64_t stringCursor_ = 0;
+  std::uint64_t pointCount_ = 0;
+  std::uint64_t stringBytes_ = 0;
+  // Archive string index per StringId (kNoStringIndex if unused), and the used strings in index order.
+  std::vector<std::uint32_t> stringIndex_;
+  std::vector<StringId> stringOrder_;
+  std::vector<std::uint64_t> sectionOffsets_;
+  std::vector<std::uint8_t> chunk_;
+  // Packed strokes are decoded here rather than in the arena's cache.
+  std::vector<StrokePoint> points_;
+};
+
+// Read-only view of an archive in memory. open() checks the header and that every section lies within the bytes,
+// in O(1) plus a pass over the string offsets; shape records are checked as they are read and points never are.
+class ArchiveView {
+ public:
+  static std::optional<ArchiveView> open(std::span<const std::uint8_t> bytes);
+
+  std::size_t shapeCount() const { return static_cast<std::size_t>(shapeCount_); }
+  ArchiveShape shape(std::size_t index) const;
+  std::span<const StrokePoint> points() const { return points_; }
+  std::size_t stringCount() const { return static_cast<std::size_t>(stringCount_); }
+  std::string_view string(std::size_t index) const;
+  DocumentCounters counters() const { return counters_; }
+  // CRC-32 of the shape records, which identifies the archive's document without reading its points.
+  std::uint32_t checksum() const { return crc32(shapes_); }
+
+ private:
+  std::uint64_t shapeCount_ = 0;
+  std::uint64_t stringCount_ = 0;
+  DocumentCounters counters_{};
+  std::span<const std::uint8_t> shapes_;
+  std::span<const StrokePoint> points_;
+  std::span<const std::uint8_t> stringOffsets_;
+  std::span<const std::uint8_t> stringBytes_;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "shape_store.hpp"
+#include "string_table.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Persistent document format ("MDDC"), written and read in pieces so that large boards never exist as one buffer.
+// After a fixed header comes a stream of records, each a tag byte, a varint payload length and the payload:
+//   - String: UTF-8 bytes; strings are numbered in the order they appear and written once, before their first use.
+//   - Rectangle: id, name and color string numbers (varints), then x, y, width, height (f32).
+//   - Stroke: id, name and color string numbers, brush size (f32), point encoding (u8), point count (varint), then
+//     the points: zigzag varint deltas of coordinates quantized to 1 / 2^pointScaleLog2 units, or raw f32 pairs for
+//     strokes reaching coordinates the quantized form cannot hold.
+//   - End: shape and string counts (varints) and the CRC-32 of every byte before the record.
+// Shapes are written in z order. All values are little-endian.
+struct DocumentCounters {
+  std::uint32_t rectangles;
+  std::uint32_t strokes;
+};
+
+// CRC-32 (IEEE) of `bytes`, continuing from a previous result (0 to start).
+std::uint32_t crc32(std::span<const std::uint8_t> bytes, std::uint32_t crc = 0);
+
+// Encodes a document chunk by chunk. The store and table must not change between begin() and the last chunk.
+class DocumentWriter {
+ public:
+  // Chunks end on the first record boundary past this size, so one long stroke can make a chunk larger.
+  static constexpr std::size_t kChunkBytes = 256 * 1024;
+  static constexpr std::uint32_t kPointScaleLog2 = 6;
+
+  void begin(const ShapeStore& shapes, const StringTable& strings, DocumentCounters counters);
+  // The next chunk, valid until the following call; empty once the document is written or after abort().
+  std::span<const std::uint8_t> next();
+  // Stops the save; the output lacks its End record, so readers reject it.
+  void abort();
+  // True once the End record was written; checksum() is then the CRC-32 it records.
+  bool done() const { return stage_ == Stage::Done; }
+  std::uint32_t checksum() const { return crc_; }
+
+ private:
+  enum class Stage : std::uint8_t { Idle, Header, Shapes, Done };
+
+  std::uint32_t stringNumber(StringId id);
+  void writeRecord(std::uint8_t tag);
+  void writeShape(std::size_t row);
+
+  const ShapeStore* shapes_ = nullptr;
+  const StringTable* strings_ = nullptr;
+  DocumentCounters counters_{};
+  Stage stage_ = Stage::Idle;
+  std::size_t row_ = 0;
+  std::uint32_t crc_ = 0;
+  // Document string number per StringId, or kNoStringNumber when not written yet.
+  std::vector<std::uint32_t> stringNumbers_;
+  std::uint32_t stringCount_ = 0;
+  std::vector<std::uint8_t> chunk_;
+  std::vector<std::uint8_t> payload_;
+  // Packed strokes are decoded here rather than in the arena's cache.
+  std::vector<StrokePoint> points_;
+};
+
+// Decodes a document from pieces of any size into a store of its own. Its strings are interned into the engine table
+// only when the shapes are taken, so that a rejected document leaves none behind.
+class DocumentReader {
+ public:
+  void begin(StringTable& strings);
+  // Decodes every whole record in what was received so far and keeps the rest for the next call. Returns false once
+  // the input is known to be invalid; later calls then do nothing.
+  bool feed(std::span<const std::uint8_t> bytes);
+  // True once the End record was read and matched the shapes, strings and checksum before it.
+  bool complete() const { return stage_ == Stage::Done; }
+  // Interns a complete document's strings and hands over its shapes, in z order, with keys 1..n and every stroke
+  // finished; their labels hold the document's string numbers until then.
+  ShapeStore takeShapes();
+  DocumentCounters counters() const { return counters_; }
+  // CRC-32 recorded in the End record of a complete document.
+  std::uint32_t checksum() const { return crc_; }
+  // Releases everything decoded so far.
+  void reset();
+
+ private:
+  enum class Stage : std::uint8_t { Idle, Header, Records, Done, Failed };
+
+  std::size_t parse(std::span<const std::uint8_t> bytes);
+  bool readRecord(std::uint8_t tag, std::span<const std::uint8_t> payload, std::span<const std::uint8_t> record);
+  bool readShape(std::uint8_t tag, std::span<const std::uint8_t> payload);
+
+  StringTable* strings_ = nullptr;
+  Stage stage_ = Stage::Idle;
+  std::uint32_t pointScaleLog2_ = 0;
+  std::uint32_t crc_ = 0;
+  DocumentCounters counters_{};
+  ShapeStore shapes_;
+  std::vector<std::string> documentStrings_;
+  // Packed colors of the document's strings, parsed the first time a shape uses them.
+  std::vector<std::optional<std::uint32_t>> documentColors_;
+  std::vector<StrokePoint> points_;
+  // Bytes of a record split across feed() calls.
+  std::vector<std::uint8_t> pending_;
+};
@@ -1,64 +1,321 @@
 #pragma once
 
-#include <emscripten/val.h>
+#include "archive_format.hpp"
+#include "document_format.hpp"
+#include "operation_journal.hpp"
+#include "shape_store.hpp"
+#include "string_table.hpp"
+#include "tile_cache.hpp"
+#include "undo_history.hpp"
+#include "work_stealing_pool.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
-struct Rectangle {
-  std::string id;
-  std::string name;
-  float x;
-  float y;
-  float width;
-  float height;
-  std::string color;
+enum class ChangeOp : std::uint8_t { Insert = 0, Update = 1, AppendPoints = 2, Remove = 3 };
+
+// Opcodes of the packed buffer consumed by Engine::executeBatch(); mirrored in src/engine/commandBuffer.ts.
+enum class CommandOp : std::uint16_t {
+  CreateRectangle = 1,
+  StartStroke = 2,
+  UpdateStroke = 3,
+  FinishStroke = 4,
+  PointerMove = 5,
+  DefineString = 6,
+  UpdateStrokeHandle = 7,
+  FinishStrokeHandle = 8,
+  RemoveShape = 9,
 };
 
+constexpr std::size_t kCommandOpCount = 10;
+
+// Compatibility shim for callers that still name commands ("createRectangle", …); nullopt for unknown names.
+std::optional<CommandOp> parseCommandOp(std::string_view name);
+
 struct Presence {
-  std::string id;
-  std::string color;
+  StringId id;
+  StringId color;
+  std::uint32_t rgba;
   float x;
   float y;
 };
 
-struct StrokePoint {
-  float x;
-  float y;
+// One entry per shape mutation, in revision order. `firstPoint` is the stroke length before an append. Changes name
+// shapes by handle so they stay valid when rows shift; `key` and `kind` are kept for removals.
+struct ShapeChange {
+  std::uint32_t revision;
+  ChangeOp op;
+  ShapeKind kind;
+  std::uint32_t key;
+  std::uint32_t firstPoint;
+  ShapeHandle handle;
 };
 
-struct Stroke {
-  std::string id;
-  std::string name;
-  std::string color;
-  float size;
-  std::vector<StrokePoint> points;
+// A change merged per shape, with the row resolved at the time the delta is written (unused for removals).
+struct PendingChange {
+  ChangeOp op;
+  ShapeKind kind;
+  std::uint32_t key;
+  std::uint32_t row;
+  std::uint32_t firstPoint;
 };
 
+// Pixels produced by Engine::render(), placed at (left, top) in device pixels of the whole canvas. Only the dirty
+// rectangle (frame pixels, empty when nothing changed) differs from the previous frame at the same place.
+struct RenderedFrame {
+  std::span<const std::uint8_t> pixels;
+  int left;
+  int top;
+  int width;
+  int height;
+  int dirtyLeft;
+  int dirtyTop;
+  int dirtyWidth;
+  int dirtyHeight;
+  int tilesRendered;
+};
+
+// Platform-neutral engine core. The Embind adapter in src/bindings.cpp maps it onto the JS API; native builds
+// drive it directly from tests and benchmarks.
 class Engine {
  public:
+  static constexpr int kMaxFrameSide = 4096;
+  // A quarter of a logical pixel: invisible at zoom levels up to about 2x, and still drops most mouse and pen jitter.
+  static constexpr float kDefaultSimplifyTolerance = 0.25f;
+  static constexpr std::uint64_t kDefaultJournalLimit = 4 * 1024 * 1024;
+
   Engine();
 
   void resize(int width, int height);
-  void execute(emscripten::val command);
-  void pointerEvent(emscripten::val event);
-  emscripten::val tick() const;
+  // Area of the document currently on screen; resize() resets it to the whole canvas.
+  void setViewport(float x, float y, float width, float height);
+  ShapeHandle createRectangle(float x, float y, float width, float height, const std::string& color);
+  ShapeHandle startStroke(const std::string& id, float x, float y, float size, const std::string& color);
+  void updateStroke(const std::string& id, float x, float y);
+  void finishStroke(const std::string& id);
+  // Same commands with strings already interned in strings(); executeBatch() goes through these.
+  ShapeHandle createRectangle(float x, float y, float width, float height, StringId color);
+  ShapeHandle startStroke(StringId id, float x, float y, float size, StringId color);
+  void updateStroke(StringId id, float x, float y);
+  void finishStroke(StringId id);
+  // Hot-path forms addressing a stroke by the handle returned when it was started; stale handles are ignored.
+  void updateStroke(ShapeHandle stroke, float x, float y);
+  void finishStroke(ShapeHandle stroke);
+  bool removeShape(ShapeHandle shape);
+  void pointerMove(int pointerId, float x, float y);
+  std::uint32_t internString(const std::string& value);
+  std::span<std::uint8_t> commandBuffer(std::uint32_t byteLength);
+  void executeBatch(std::uint32_t byteLength);
+  // Strokes started by the last executeBatch(), as (id string index, handle slot, handle generation) triples.
+  std::span<const std::uint32_t> startedStrokes() const { return startedStrokes_; }
+  // Shapes whose painted box meets the area, as rows in z order (the shape indices of tickBinary()). The spans
+  // stay valid until the next query.
+  std::span<const std::uint32_t> queryRect(float minX, float minY, float maxX, float maxY);
+  std::span<const std::uint32_t> queryPoint(float x, float y);
+  std::span<const std::uint32_t> queryRadius(float x, float y, float radius);
+  std::span<const std::uint8_t> tickBinary();
+  // tickBinary() layout restricted to the shapes whose painted box meets the viewport, still back to front. Kept in
+  // its own buffer, so it does not invalidate a tickBinary() view.
+  std::span<const std::uint8_t> tickVisible();
+  std::span<const std::uint8_t> tickSince(std::uint32_t revision);
+  // Rasterizes the shapes meeting the viewport over an opaque white background, at `scale` device pixels per
+  // document unit. The frame covers the viewport rounded out to whole pixels (at most kMaxFrameSide a side) and
+  // stays valid until the next render(). It is assembled from cached tiles; only tiles that edits marked dirty
+  // are rasterized again.
+  RenderedFrame render(float scale);
+  // Threads rasterizing dirty tiles, the calling one included; 0 (the default) uses the hardware concurrency. Only
+  // builds with FIGMA_ENGINE_THREADS go beyond one.
+  void setRenderThreads(std::size_t threads);
+  // Ingest-time stroke simplification, in document units (logical pixels at zoom 1). While a stroke is drawn,
+  // samples closer than this to its last kept point are held back; finishing it appends the last held sample and
+  // runs Ramer-Douglas-Peucker at the same tolerance. 0 keeps every sample. Defaults to kDefaultSimplifyTolerance.
+  void setSimplifyTolerance(float tolerance);
+  std::uint32_t revision() const;
+
+  // Saving (document_format.hpp): beginSave() then saveChunk() until it returns an empty span; each chunk is valid
+  // until the next call. Shapes must not change in between: an edit ends the save early, leaving a document that
+  // loading rejects. Strokes still being drawn are saved with the points they have so far.
+  void beginSave();
+  std::span<const std::uint8_t> saveChunk();
+  // Loading: beginLoad(), the document in pieces of any size through loadChunk(), then finishLoad(). The document is
+  // decoded aside and only replaces the current one if finishLoad() finds it whole and valid; it then comes back
+  // through tickSince() as a full resync. loadChunk() returns false once the input is known to be invalid.
+  void beginLoad();
+  bool loadChunk(std::span<const std::uint8_t> bytes);
+  // Same, from the first `byteLength` bytes of loadBuffer(), for callers that write into engine memory.
+  std::span<std::uint8_t> loadBuffer(std::uint32_t byteLength);
+  bool loadChunk(std::uint32_t byteLength);
+  bool finishLoad();
+  // Same save protocol, in the mappable layout of archive_format.hpp.
+  void beginArchiveSave();
+  // Opens an archive in place: shapes are built from its records while stroke points stay in `bytes`, which `owner`
+  // must keep alive (and unchanged) until another document replaces this one. Edits afterwards work as usual; new
+  // points go to the arena. Returns false, leaving the scene as it was, if the archive is malformed.
+  bool openArchive(std::span<const std::uint8_t> bytes, std::shared_ptr<const void> owner);
+  // Same, for callers that write the archive into engine memory: the first `byteLength` bytes of a fresh
+  // archiveBuffer(), which the engine then holds on to.
+  std::span<std::uint8_t> archiveBuffer(std::uint32_t byteLength);
+  bool openArchive(std::uint32_t byteLength);
+
+  // Operation journal (operation_journal.hpp): once enabled, every shape change is logged as it is applied, over the
+  // snapshot the engine last loaded or compacted into. journalChunk() returns what was logged since the last call,
+  // for the caller to append to its stored journal; it stays valid until the next change. Journaling is off by
+  // default, since only a caller that takes the chunks keeps the log from growing; changes made while it is off are
+  // not logged, so the journal asks for compaction once it is turned on.
+  void setJournaling(bool enabled);
+  std::span<const std::uint8_t> journalChunk();
+  std::uint64_t journalBytes() const;
+  // True once the journal outgrows setJournalLimit() (kDefaultJournalLimit by default) or misses changes, while
+  // journaling is on.
+  bool journalNeedsCompaction() const;
+  void setJournalLimit(std::uint64_t bytes);
+  // A save through saveChunk(), as beginSave(), after which the journal restarts over the saved snapshot: the caller
+  // stores the snapshot, then replaces its journal with the next journalChunk(). Strokes still being drawn are saved
+  // as they are and reopened by the new journal. The caller may spread the chunks over several tasks, and appends
+  // the journal to its old snapshot meanwhile; an edit or another save in between ends the compaction early.
+  void beginCompaction();
+  // True once the compaction last begun wrote its last chunk, so that the journal continues it; false while it is
+  // in progress or if it was cut short.
+  bool compactionComplete() const;
+  // Recovery, after loading the stored snapshot (or on a new engine if there is none): replays a journal over it and
+  // returns the length of the prefix applied. Replay stops at the first torn or damaged record; the caller truncates
+  // its journal there and appends to it again. Returns 0 if the journal does not continue this document or edits
+  // were made since; the caller then replaces its journal with the next journalChunk().
+  std::size_t replayJournal(std::span<const std::uint8_t> bytes);
+  // Same, from the first `byteLength` bytes of loadBuffer().
+  std::uint32_t replayJournal(std::uint32_t byteLength);
+
+  // Undo history (undo_history.hpp): creating and removing shapes can be undone and redone. A stroke is one action
+  // from start to finish, and undoing it while it is drawn ends it. A shape comes back at its row and with its key,
+  // under a new handle. Loading a document clears the history. Both return false when there is nothing to do.
+  bool undo();
+  bool redo();
+  bool canUndo() const;
+  bool canRedo() const;
+  // Makes the changes until the matching endUndoGroup() one action, such as removing a selection.
+  void beginUndoGroup();
+  void endUndoGroup();
+  // Memory the history may hold (UndoHistory::kDefaultLimit by default); the oldest actions are forgotten past it.
+  void setHistoryLimit(std::size_t bytes);
+  std::size_t historyBytes() const;
+
+  const ShapeStore& shapes() const { return shapes_; }
+  const StringTable& strings() const { return strings_; }
+  const std::unordered_map<int, Presence>& presences() const { return presences_; }
 
  private:
-  Rectangle makeRectangle(float x, float y, float width, float height, std::string color) const;
-  Stroke makeStroke(std::string id,
-                    std::string name,
-                    float x,
-                    float y,
-                    float size,
-                    std::string color) const;
-  Stroke* findStroke(const std::string& id);
+  friend struct CommandDispatch;
+
+  ShapeHandle strokeHandle(StringId id) const;
+  void adoptDocument(ShapeStore&& shapes, DocumentCounters counters, JournalBase base);
+  bool applyJournalRecord(const JournalRecord& record);
+  void replaceStrokePoints(std::size_t row, ShapeHandle stroke, std::span<const StrokePoint> points);
+  ShapeRecord removeRow(std::size_t row);
+  void restoreRow(std::size_t row, const ShapeRecord& shape);
+  void applyUndoStep(UndoStep& step, bool insert);
+  void forgetStroke(std::size_t row);
+  void appendStrokePoint(std::size_t row, ShapeHandle stroke, StrokePoint point);
+  void settleStroke(std::size_t row, ShapeHandle stroke);
+  std::span<const std::uint32_t> rowsInZOrder();
+  std::optional<StringId> commandString(std::uint32_t index) const;
+  void defineString(std::uint32_t index, std::string value);
   void updatePresence(int pointerId, float x, float y);
+  void recordChange(std::size_t row, ChangeOp op, std::uint32_t firstPoint);
+  void collectChanges(std::uint32_t base);
+  // A tile in the frame being rendered; dirty ones own `rowCount` shape rows at `firstRow` in tileRows_.
+  struct FrameTile {
+    TileCache::Tile* tile;
+    std::int32_t column;
+    std::int32_t row;
+    bool redrawn;
+    std::size_t firstRow;
+    std::size_t rowCount;
+  };
+
+  WorkStealingPool& renderPool();
+  std::span<const std::uint32_t> tileShapes(std::int32_t column, std::int32_t row);
+  void rasterizeTile(TileCache::Tile& tile,
+                     std::int32_t column,
+                     std::int32_t row,
+                     std::span<const std::uint32_t> rows,
+                     Rasterizer& rasterizer) const;
+  void writeSnapshot();
+  void writeVisibleSnapshot(std::span<const std::uint32_t> rows);
+  void writeDelta(std::uint32_t base);
 
   int width_;
   int height_;
-  std::vector<Rectangle> rectangles_;
-  std::vector<Stroke> strokes_;
-  std::unordered_map<std::string, std::size_t> strokeIndex_;
+  Bounds viewport_;
+  ShapeStore shapes_;
+  SpatialIndex spatial_;
+  std::vector<std::uint32_t> queryRows_;
+  StringTable strings_;
+  std::size_t rectangleCount_;
+  std::size_t strokeCount_;
+  // Open stroke per id, indexed directly by StringId (ids are dense); kNoShape when none.
+  std::vector<ShapeHandle> strokeIndex_;
+  float simplifyTolerance_;
+  // Latest sample of an open stroke that the radial filter held back, by handle slot; `stroke` is kNoShape when
+  // nothing is held.
+  struct HeldSample {
+    ShapeHandle stroke;
+    StrokePoint point;
+  };
+  std::vector<HeldSample> heldSamples_;
+  std::vector<StrokePoint> simplified_;
+  // Packed strokes decoded by passes over the whole document, which bypass the arena's decode cache.
+  std::vector<StrokePoint> pointScratch_;
   std::unordered_map<int, Presence> presences_;
+  std::uint32_t revision_;
+  std::uint32_t nextShapeKey_;
+  std::vector<ShapeChange> changes_;
+  std::uint32_t changesBase_;
+  std::vector<PendingChange> pending_;
+  std::unordered_map<std::uint64_t, std::size_t> pendingIndex_;
+  std::vector<std::uint8_t> snapshot_;
+  std::vector<std::uint8_t> visibleSnapshot_;
+  Framebuffer frame_;
+  int frameLeft_;
+  int frameTop_;
+  TileCache tiles_;
+  std::vector<FrameTile> frameTiles_;
+  std::vector<std::size_t> dirtyTiles_;
+  std::vector<std::uint32_t> tileRows_;
+  // Dirty tiles are rasterized in parallel in threaded builds; one rasterizer (and its scratch) per participant.
+  std::size_t renderThreads_;
+  std::unique_ptr<WorkStealingPool> pool_;
+  std::vector<Rasterizer> rasterizers_;
+  std::vector<std::uint8_t> delta_;
+  std::vector<std::uint8_t> commands_;
+  // Command-buffer string index -> interned string (kNoStringId if undefined), and back for internString().
+  std::vector<StringId> commandStrings_;
+  std::unordered_map<StringId, std::uint32_t> commandStringIndex_;
+  std::vector<std::uint32_t> startedStrokes_;
+  DocumentWriter documentWriter_;
+  DocumentReader documentReader_;
+  std::vector<std::uint8_t> loadBuffer_;
+  ArchiveWriter archiveWriter_;
+  bool savingArchive_;
+  std::shared_ptr<std::vector<std::uint8_t>> archiveBuffer_;
+  // Memory of the opened archive that shapes_ points into, if any.
+  std::shared_ptr<const void> archive_;
+  OperationJournal journal_;
+  std::uint64_t journalLimit_;
+  // Set while a journal is replayed, so that its changes are not logged again.
+  bool replaying_;
+  // The save in progress is a compaction; the last one begun wrote its last chunk.
+  bool compacting_;
+  bool compacted_;
+  UndoHistory history_;
+  // Set while undo() or redo() apply an entry, so that it is not recorded as a new action.
+  bool undoing_;
+  // Revision of the last shape change, and its value when the save in progress began.
+  std::uint32_t shapesRevision_;
+  std::uint32_t saveRevision_;
 };
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+// A file mapped read-only into memory (native builds only), for Engine::openArchive(): pages are read from disk as
+// they are first touched. Pass the shared pointer as the archive owner to keep the mapping alive.
+class MappedFile {
+ public:
+  // Nullptr if the file cannot be opened or mapped.
+  static std::shared_ptr<MappedFile> open(const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  std::span<const std::uint8_t> bytes() const { return {data_, size_}; }
+
+ private:
+  MappedFile(const std::uint8_t* data, std::size_t size) : data_(data), size_(size) {}
+
+  const std::uint8_t* data_;
+  std::size_t size_;
+};
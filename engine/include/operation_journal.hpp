@@ -0,0 +1,130 @@
+#pragma once
+
+#include "shape_store.hpp"
+#include "string_table.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Append-only log of shape changes ("MDJL"), so that autosaving costs the size of the edits rather than of the
+// document. A journal continues one snapshot, its base: a 16-byte header (magic, version u16, headerBytes u16, the
+// base's checksum and shape count) is followed by records of a u32 payload length, the payload's CRC-32 and the
+// payload, which starts with the op (u8) and the row it applies to (varint):
+//   - Insert: kind (u8), RGBA, size, x, y, width, height (f32), id, name and color strings (varint length and
+//     UTF-8 each), then the stroke's points (x, y f32 pairs) to the end of the payload; always at the last row.
+//   - Restore: the same payload, for a shape put back by undo or redo at its old row; a stroke comes back finished.
+//   - AppendPoints, ReplacePoints: an open stroke's new points, or all of them, to the end of the payload.
+//   - Finish, Reopen, Remove: nothing more. Reopen marks a stroke the snapshot saved while it was still drawn.
+// Changes are logged as they were applied, not as commands, so replay does not depend on simplification settings
+// or on which strokes were open. Rows follow the base's z order. All values are little-endian.
+enum class JournalOp : std::uint8_t {
+  Insert = 1,
+  AppendPoints = 2,
+  ReplacePoints = 3,
+  Finish = 4,
+  Reopen = 5,
+  Remove = 6,
+  Restore = 7,
+};
+
+// Identifies a snapshot: the CRC-32 recorded in its End record and its shape count. {0, 0} is the empty document
+// a new engine starts from.
+struct JournalBase {
+  std::uint32_t checksum;
+  std::uint32_t shapes;
+
+  bool operator==(const JournalBase&) const = default;
+};
+
+class OperationJournal {
+ public:
+  // Starts a new journal over `base`; everything not taken yet is dropped.
+  void restart(JournalBase base);
+  // Carries on a journal the caller already holds `bytes` of (after replaying it), without rewriting its header.
+  void resume(JournalBase base, std::uint64_t bytes);
+  // A journal logs nothing until enabled, for there may be nobody to take its bytes. Changes made while it is
+  // disabled leave it stale: it no longer continues its base until the next restart(). Disabling drops what was
+  // not taken.
+  void setEnabled(bool enabled);
+  bool enabled() const { return enabled_; }
+  bool stale() const { return stale_; }
+
+  void insert(const ShapeStore& shapes, const StringTable& strings, std::size_t row);
+  void restore(const ShapeStore& shapes, const StringTable& strings, std::size_t row);
+  // Appends to the same stroke extend one record until something else is logged or the bytes are taken.
+  void appendPoints(std::size_t row, std::span<const StrokePoint> points);
+  void replacePoints(std::size_t row, std::span<const StrokePoint> points);
+  void finish(std::size_t row);
+  void reopen(std::size_t row);
+  void remove(std::size_t row);
+
+  // Bytes logged since the last call, to append to the stored journal; valid until the next change is logged. None
+  // while disabled or stale.
+  std::span<const std::uint8_t> take();
+  // Length of the whole journal, taken or not.
+  std::uint64_t bytes() const { return taken_ + (handedOut_ ? 0 : buffer_.size()); }
+  JournalBase base() const { return base_; }
+  // True while nothing was logged or missed since restart() or resume().
+  bool empty() const { return !recorded_ && !stale_; }
+
+ private:
+  // False, marking the journal stale, when it is disabled and the change is not logged.
+  bool logging();
+  void beginRecord(JournalOp op, std::size_t row);
+  void sealRecord();
+  void writeShape(JournalOp op, const ShapeStore& shapes, const StringTable& strings, std::size_t row);
+
+  JournalBase base_{};
+  std::uint64_t taken_ = 0;
+  std::vector<std::uint8_t> buffer_;
+  std::vector<StrokePoint> points_;
+  // buffer_ was returned by take() and is cleared before the next record.
+  bool handedOut_ = false;
+  bool recorded_ = false;
+  bool enabled_ = false;
+  bool stale_ = false;
+  // Record still being written at the end of buffer_ (its length and CRC are filled in when sealed), if any.
+  bool open_ = false;
+  std::size_t openOffset_ = 0;
+  JournalOp openOp_ = JournalOp::Insert;
+  std::size_t openRow_ = 0;
+};
+
+// One decoded record; strings and points stay valid until the reader's next call.
+struct JournalRecord {
+  JournalOp op;
+  std::size_t row;
+  ShapeKind kind;
+  std::uint32_t rgba;
+  float size;
+  float x;
+  float y;
+  float width;
+  float height;
+  std::string_view id;
+  std::string_view name;
+  std::string_view color;
+  std::span<const StrokePoint> points;
+};
+
+// Reads a journal up to its first incomplete or damaged record, which is where a crash mid-append leaves off.
+class JournalReader {
+ public:
+  // Nullopt if the header is missing or of another version.
+  static std::optional<JournalReader> open(std::span<const std::uint8_t> bytes);
+
+  JournalBase base() const { return base_; }
+  // The next whole, intact record, or nullopt at the end of the valid prefix.
+  std::optional<JournalRecord> next();
+  // Bytes up to the end of the last record next() returned.
+  std::size_t validBytes() const { return offset_; }
+
+ private:
+  std::span<const std::uint8_t> bytes_;
+  JournalBase base_{};
+  std::size_t offset_ = 0;
+  std::vector<StrokePoint> points_;
+};
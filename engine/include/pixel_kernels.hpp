@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// One row of the stroke rasterizer's capsule test, in pixels: the centers of pixels firstColumn, firstColumn + 1, ...
+// measured against the segment from (originX, row center - offsetY) to that point plus (dx, dy).
+struct CapsuleRow {
+  int firstColumn;
+  float originX;
+  float offsetY;
+  float dx;
+  float dy;
+  // 1 / (dx² + dy²), or 0 for a zero-length segment.
+  float inverseLength;
+  // Brush radius plus half a pixel: coverage is reach minus the distance, clamped to [0, 1].
+  float reach;
+};
+
+// Inner loops of the rasterizer over runs of premultiplied pixels (packed like parseColor). Every implementation
+// produces the same bytes as the scalar one, so the choice only affects speed.
+struct PixelKernels {
+  const char* name;
+  // Sets `count` pixels to a premultiplied color.
+  void (*fill)(std::uint32_t* pixels, std::size_t count, std::uint32_t color);
+  // Source-over of a premultiplied color at one coverage (0-255) for the whole run.
+  void (*blend)(std::uint32_t* pixels, std::size_t count, std::uint32_t color, std::uint32_t coverage);
+  // Source-over of a premultiplied color at per-pixel coverage.
+  void (*blendMask)(std::uint32_t* pixels, const std::uint8_t* mask, std::size_t count, std::uint32_t color);
+  // Raises mask[i] to the coverage of pixel firstColumn + i by the capsule, for i in [0, count).
+  void (*accumulateCapsule)(std::uint8_t* mask, std::size_t count, const CapsuleRow& row);
+};
+
+const PixelKernels& scalarPixelKernels();
+// The fastest kernels of this build: 128-bit SIMD where the target has it (SSE2, NEON, or Wasm compiled with
+// -msimd128), the scalar ones otherwise.
+const PixelKernels& pixelKernels();
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct StrokePoint {
+  float x;
+  float y;
+};
+
+// Where a stroke's points live: a slot in the active chunks while the stroke is being drawn, then a run of the
+// sealed slab once it is finished, or of the packed stream if its points lie on a packing grid.
+struct PointRange {
+  std::uint32_t offset;
+  std::uint32_t length;
+  bool open;
+  // Sealed into the packed stream; `offset` is then a byte offset.
+  bool packed;
+};
+
+// Point storage shared by every stroke. Strokes being drawn append into recycled chunks that keep their capacity,
+// so steady drawing stops hitting the allocator. Finishing a stroke moves its points out of the chunk, which goes
+// back to the free list, into the packed stream when they lie on the 1/16 grid (or the document format's 1/64 one):
+// a grid-scale byte, then zigzag varint deltas of the grid coordinates, about 2 to 4 bytes a point instead of 8.
+// Other finished points go to one contiguous slab of raw pairs. Sealed points are never moved or overwritten.
+//
+// Packed strokes are decoded on use into a cache that keeps the strokes used recently, up to kMaxDecodedPoints: each
+// stroke decoded evicts the least recently used ones beyond it. Between beginFrame() and endFrame() the strokes used
+// in the frame are kept past the budget instead, so that a frame may hold spans to all the strokes it draws. Spans
+// handed out are invalidated by the next open/append/seal, and decoded ones, outside a frame, by the next points().
+class PointArena {
+ public:
+  static constexpr std::uint8_t kGridScaleLog2 = 4;
+  static constexpr std::size_t kMaxDecodedPoints = std::size_t{1} << 19;
+
+  // Rounds points to the 1/16 grid, which finished strokes are packed on; returns whether any moved. Strokes with a
+  // point beyond the grid's range are left as they are and sealed raw.
+  static bool snapToGrid(std::span<StrokePoint> points);
+  // Moved only: the decode cache holds iterators into its own recency list.
+  PointArena() = default;
+  PointArena(const PointArena&) = delete;
+  PointArena(PointArena&&) = default;
+  PointArena& operator=(PointArena&&) = default;
+
+  PointRange open(StrokePoint first);
+  void append(PointRange& range, StrokePoint point);
+  // Replaces an open range's points; `points` must not alias them.
+  void assign(PointRange& range, std::span<const StrokePoint> points);
+  void seal(PointRange& range);
+  // Seals points straight away, for strokes that arrive finished (a loaded document).
+  PointRange store(std::span<const StrokePoint> points);
+  // Returns an open range's chunk to the free list; sealed points stay where they are.
+  void release(PointRange& range);
+  // A packed range is decoded through the cache. Not safe to call concurrently unless the range was already used in
+  // this frame, as Engine::render() does for the strokes it rasterizes in parallel.
+  std::span<const StrokePoint> points(const PointRange& range) const;
+  // Same, but a packed range not in the cache is decoded into `scratch` instead, for passes over every stroke that
+  // should not flush the strokes on screen out of the cache.
+  std::span<const StrokePoint> read(const PointRange& range, std::vector<StrokePoint>& scratch) const;
+
+  // Frame bounds: strokes used in between stay decoded until endFrame(), which trims the cache back to its budget.
+  void beginFrame();
+  void endFrame();
+  std::size_t decodedPoints() const { return decodedPoints_; }
+  std::span<const std::uint8_t> packed() const { return packed_; }
+
+  // Finished points kept outside the arena, such as a memory-mapped archive; only on an empty arena. Unpacked sealed
+  // offsets below their count refer to them and the slab continues after them. They must outlive the arena's use.
+  void mapSealed(std::span<const StrokePoint> points);
+  std::span<const StrokePoint> mapped() const { return mapped_; }
+  // Finished strokes' raw points, in the order they were sealed, at sealed offsets mapped().size() onwards.
+  std::span<const StrokePoint> slab() const { return slab_; }
+
+ private:
+  struct DecodedStroke {
+    std::vector<StrokePoint> points;
+    std::uint32_t lastUsed;
+    std::list<std::uint32_t>::iterator order;
+  };
+
+  PointRange seal(std::span<const StrokePoint> points);
+  void decode(const PointRange& range, std::vector<StrokePoint>& out) const;
+  // Evicts least recently used strokes down to the budget, short of `keep` and, in a frame, of the frame's strokes.
+  void trim(std::uint32_t keep) const;
+
+  std::span<const StrokePoint> mapped_;
+  std::vector<StrokePoint> slab_;
+  std::vector<std::uint8_t> packed_;
+  std::vector<std::vector<StrokePoint>> chunks_;
+  std::vector<std::uint32_t> freeChunks_;
+  // Decoded packed strokes by byte offset.
+  mutable std::unordered_map<std::uint32_t, DecodedStroke> decoded_;
+  // Their offsets, least recently used first; the strokes used in the current frame are last.
+  mutable std::list<std::uint32_t> order_;
+  mutable std::size_t decodedPoints_ = 0;
+  std::uint32_t frame_ = 0;
+  bool inFrame_ = false;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "point_arena.hpp"
+
+#include <span>
+#include <vector>
+
+// Radial-distance test used while a stroke is drawn: a sample closer than `tolerance` to the last kept point adds
+// nothing visible and is held back instead of stored.
+bool withinTolerance(StrokePoint kept, StrokePoint sample, float tolerance);
+
+// Ramer-Douglas-Peucker: the subset of `points` (first and last always kept) such that no dropped point lies further
+// than `tolerance` from the kept polyline. Iterative, so long strokes do not recurse deeply. Writes into `kept`.
+void simplifyPolyline(std::span<const StrokePoint> points, float tolerance, std::vector<StrokePoint>& kept);
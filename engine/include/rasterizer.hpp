@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pixel_kernels.hpp"
+#include "point_arena.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Premultiplied RGBA8 render target, rows top to bottom. Pixels are packed like parseColor(), so the bytes read
+// R, G, B, A in memory; over an opaque background they are also valid straight-alpha ImageData.
+class Framebuffer {
+ public:
+  void resize(int width, int height);
+  // Fills every pixel with a straight-alpha color.
+  void clear(std::uint32_t rgba);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  std::uint32_t pixel(int x, int y) const { return pixels_[static_cast<std::size_t>(y) * width_ + x]; }
+  std::uint32_t* row(int y) { return pixels_.data() + static_cast<std::size_t>(y) * width_; }
+  std::span<const std::uint8_t> bytes() const;
+
+ private:
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<std::uint32_t> pixels_;
+};
+
+// 8-bit coverage of one stroke over a rectangle of a render target. Kept between frames, it lets the stroke be
+// composited again without touching its points, and it grows as points are appended.
+struct CoverageMask {
+  // Target pixels the mask covers.
+  int left = 0;
+  int top = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<std::uint8_t> coverage;
+  // Per mask row, the target columns holding coverage; start > end on empty rows.
+  std::vector<std::int32_t> spanStart;
+  std::vector<std::int32_t> spanEnd;
+  // Stroke points already accumulated.
+  std::size_t points = 0;
+
+  std::size_t bytes() const { return coverage.size() + (spanStart.size() + spanEnd.size()) * sizeof(std::int32_t); }
+};
+
+// Anti-aliased scan conversion of the engine's two primitives. Coordinates are document units mapped to pixels by
+// the transform, colors straight RGBA as stored in ShapeStore::rgba; everything is composited source-over.
+class Rasterizer {
+ public:
+  // pixel = (point - origin) * scale
+  void setTransform(float originX, float originY, float scale);
+  // Defaults to pixelKernels(); the output does not depend on the choice.
+  void setKernels(const PixelKernels& kernels) { kernels_ = &kernels; }
+
+  void fillRect(Framebuffer& target, float x, float y, float width, float height, std::uint32_t rgba);
+  // Round caps and joins, like a canvas stroke with lineCap/lineJoin "round"; a single point draws a dot. Coverage
+  // is merged across segments before compositing, so translucent strokes do not darken where segments overlap.
+  void strokePolyline(Framebuffer& target, std::span<const StrokePoint> points, float width, std::uint32_t rgba);
+  // strokePolyline() in two steps, for strokes whose coverage is cached. Accumulating only adds the segments that
+  // end past mask.points, so `points` may only have been appended to since (a shorter stroke restarts the mask), and
+  // the transform and target size must not change in between. Compositing leaves the mask as it is.
+  void accumulateStroke(CoverageMask& mask, const Framebuffer& target, std::span<const StrokePoint> points, float width);
+  void compositeMask(Framebuffer& target, const CoverageMask& mask, std::uint32_t rgba);
+
+ private:
+  float originX_ = 0;
+  float originY_ = 0;
+  float scale_ = 1;
+  const PixelKernels* kernels_ = &pixelKernels();
+  static void clearMask(CoverageMask& mask);
+  // Makes `mask` cover the target pixels [left, right] x [top, bottom], keeping its coverage.
+  static void growMask(CoverageMask& mask, const Framebuffer& target, int left, int top, int right, int bottom);
+
+  // Coverage of the stroke strokePolyline() is drawing, over the whole target; empty between strokes.
+  CoverageMask scratch_;
+};
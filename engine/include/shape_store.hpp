@@ -0,0 +1,131 @@
+#pragma once
+
+#include "point_arena.hpp"
+#include "spatial_index.hpp"
+#include "string_table.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+enum class ShapeKind : std::uint8_t { Rectangle = 0, Stroke = 1 };
+
+// Stable reference to a shape: survives other shapes being added or removed, and stops resolving once its own
+// shape is removed (the slot's generation moves on when the slot is reused).
+struct ShapeHandle {
+  std::uint32_t slot;
+  std::uint32_t generation;
+
+  std::uint64_t bits() const { return (static_cast<std::uint64_t>(generation) << 32) | slot; }
+  friend bool operator==(const ShapeHandle&, const ShapeHandle&) = default;
+};
+
+constexpr ShapeHandle kNoShape = ShapeHandle{0xFFFFFFFF, 0};
+
+// A shape as it stood in its row, without its handle, enough to put it back with ShapeStore::insert(). Only finished
+// strokes are recorded: their points are a sealed run, which the arena never moves or overwrites.
+struct ShapeRecord {
+  ShapeKind kind;
+  std::uint32_t key;
+  float x;
+  float y;
+  float width;
+  float height;
+  float size;
+  std::uint32_t rgba;
+  PointRange points;
+  StringId id;
+  StringId name;
+  StringId color;
+};
+
+// Cold per-shape data, only read when serializing or looking shapes up by id. Handles into the engine's StringTable.
+struct ShapeLabels {
+  std::vector<StringId> ids;
+  std::vector<StringId> names;
+  std::vector<StringId> colors;
+};
+
+// Columnar storage for every shape in paint (z) order, rectangles and strokes interleaved. Rendering and culling
+// loops read the hot columns only; for strokes `x/y/width/height` hold the bounds of the points (without the
+// brush size) and `size` the brush diameter, for rectangles `size` is 0 and `pointRange` empty.
+//
+// Rows stay dense and ordered; a generational slot map (`slotRow`/`slotGeneration`, indexed by handle slot) gives
+// every shape a handle that resolves to its current row in O(1), and `slot` maps rows back.
+struct ShapeStore {
+  std::vector<ShapeKind> kind;
+  std::vector<std::uint32_t> key;
+  std::vector<std::uint32_t> createdRevision;
+  std::vector<std::uint32_t> revision;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> width;
+  std::vector<float> height;
+  std::vector<float> size;
+  std::vector<std::uint32_t> rgba;
+  std::vector<PointRange> pointRange;
+  PointArena pointArena;
+  ShapeLabels labels;
+  std::vector<std::uint32_t> slot;
+
+  std::vector<std::uint32_t> slotRow;
+  std::vector<std::uint32_t> slotGeneration;
+  std::vector<std::uint32_t> freeSlots;
+
+  std::size_t count() const { return kind.size(); }
+  ShapeHandle handle(std::size_t index) const { return ShapeHandle{slot[index], slotGeneration[slot[index]]}; }
+  std::optional<std::size_t> find(ShapeHandle handle) const;
+  // Area the shape paints: its box, widened by half the brush for strokes.
+  Bounds paintBounds(std::size_t index) const;
+  std::span<const StrokePoint> points(std::size_t index) const { return pointArena.points(pointRange[index]); }
+  // Same, without keeping a packed stroke decoded (PointArena::read()).
+  std::span<const StrokePoint> points(std::size_t index, std::vector<StrokePoint>& scratch) const {
+    return pointArena.read(pointRange[index], scratch);
+  }
+
+  std::size_t addRectangle(std::uint32_t shapeKey,
+                           std::uint32_t shapeRevision,
+                           float left,
+                           float top,
+                           float rectWidth,
+                           float rectHeight,
+                           std::uint32_t color);
+  std::size_t addStroke(std::uint32_t shapeKey,
+                        std::uint32_t shapeRevision,
+                        StrokePoint first,
+                        float brushSize,
+                        std::uint32_t color);
+  // A finished stroke whose points go straight to the sealed slab; `points` must not be empty.
+  std::size_t addSealedStroke(std::uint32_t shapeKey,
+                              std::uint32_t shapeRevision,
+                              std::span<const StrokePoint> points,
+                              float brushSize,
+                              std::uint32_t color);
+  // A finished stroke whose points already sit at `sealed` in the arena (a mapped archive), with its box as stored
+  // alongside them, so the points are not read.
+  std::size_t addSealedStroke(std::uint32_t shapeKey,
+                              std::uint32_t shapeRevision,
+                              PointRange sealed,
+                              float left,
+                              float top,
+                              float boxWidth,
+                              float boxHeight,
+                              float brushSize,
+                              std::uint32_t color);
+  // Appends to a stroke and grows its bounds.
+  void appendPoint(std::size_t index, StrokePoint point);
+  // Replaces the points of a stroke still being drawn and recomputes its bounds; `points` must not be empty.
+  void replacePoints(std::size_t index, std::span<const StrokePoint> points);
+  // Moves a finished stroke's points into the arena's contiguous slab.
+  void sealPoints(std::size_t index);
+  // Copies a finished stroke's points back into an open range, so it can be drawn on again.
+  void reopenPoints(std::size_t index);
+  // The shape at `index`; a stroke must be finished.
+  ShapeRecord record(std::size_t index) const;
+  // Puts a recorded shape back at row `index` (at most count()), shifting the rows after it, under a new handle.
+  std::size_t insert(std::size_t index, const ShapeRecord& shape, std::uint32_t shapeRevision);
+  // Removes a row, keeping the others in order; the removed shape's handle no longer resolves. Points of a finished
+  // stroke stay in the arena slab, unreferenced.
+  void remove(std::size_t index);
+};
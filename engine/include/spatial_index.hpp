@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct Bounds {
+  float minX;
+  float minY;
+  float maxX;
+  float maxY;
+};
+
+// Hierarchical grid over shape bounding boxes, keyed by ShapeHandle slot. Level `l` has cells of
+// kBaseCellSize * 2^l; a box lives in the finest level whose cells are at least as large as its longest side, so it
+// touches at most 2x2 cells there. Boxes larger than the coarsest cell go to a short list scanned by every query.
+// Cells are hashed, so the canvas is unbounded and empty space costs nothing.
+class SpatialIndex {
+ public:
+  static constexpr float kBaseCellSize = 64;
+  static constexpr std::size_t kLevels = 16;
+
+  void insert(std::uint32_t slot, Bounds bounds);
+  // Cheap when the box still covers the same cells, which is the common case while a stroke grows.
+  void update(std::uint32_t slot, const Bounds& bounds);
+  void remove(std::uint32_t slot);
+
+  // Appends the slots whose boxes intersect `area` (edges included), each once, in no particular order.
+  void query(Bounds area, std::vector<std::uint32_t>& slots);
+  // Box of an indexed slot; callers refine candidates with it.
+  const Bounds& bounds(std::uint32_t slot) const { return entries_[slot].bounds; }
+
+ private:
+  struct Entry {
+    Bounds bounds;
+    // Area covered by the linked cells and the extents that keep the box on its level; update() relinks only when
+    // the box leaves them.
+    Bounds cells;
+    float minExtent;
+    float maxExtent;
+    std::int32_t cellMinX;
+    std::int32_t cellMinY;
+    std::int32_t cellMaxX;
+    std::int32_t cellMaxY;
+    std::uint8_t level;
+    bool present;
+  };
+
+  using Cells = std::unordered_map<std::uint64_t, std::vector<std::uint32_t>>;
+
+  void link(std::uint32_t slot);
+  void unlink(std::uint32_t slot);
+
+  std::vector<Entry> entries_;
+  std::array<Cells, kLevels> levels_;
+  std::vector<std::uint32_t> oversized_;
+  // Per-slot query stamp, so a box spanning several cells is reported once.
+  std::vector<std::uint32_t> stamps_;
+  std::uint32_t stamp_ = 0;
+};
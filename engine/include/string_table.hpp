@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Handle to a string interned in a StringTable; equal handles mean equal strings within one table.
+enum class StringId : std::uint32_t {};
+
+// Never returned by StringTable::intern(); marks empty slots in tables indexed by something else.
+constexpr StringId kNoStringId = StringId{0xFFFFFFFF};
+
+// Engine-wide interner for shape ids, names and colors. Each distinct string is stored once and referred to by a
+// 32-bit handle; colors are parsed into packed RGBA the first time they are asked for.
+class StringTable {
+ public:
+  StringId intern(std::string_view value);
+  std::optional<StringId> find(std::string_view value) const;
+  const std::string& get(StringId id) const { return values_[static_cast<std::size_t>(id)]; }
+  std::size_t size() const { return values_.size(); }
+  std::uint32_t rgba(StringId color);
+
+ private:
+  // A deque keeps the strings in place as it grows, so the index can key on views into them.
+  std::deque<std::string> values_;
+  std::unordered_map<std::string_view, StringId> index_;
+  std::vector<std::optional<std::uint32_t>> rgba_;
+};
+
+// Packs "#rgb", "#rrggbb" or "#rrggbbaa" so that the bytes read R, G, B, A in memory.
+std::uint32_t parseColor(std::string_view color);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "rasterizer.hpp"
+#include "spatial_index.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+
+// Render-target tiles of kTileSize device pixels on a grid anchored at the document origin, kept across frames and
+// scrolling. Edits mark the tiles under their painted area dirty, so a frame only rasterizes what changed or what
+// scrolled into view. Tiles are in device pixels: changing the scale drops them all.
+class TileCache {
+ public:
+  static constexpr int kTileSize = 256;
+  // ~48 MB of pixels; tiles used by the current frame are never evicted, even past this.
+  static constexpr std::size_t kMaxTiles = 192;
+  // Stroke coverage a tile may cache, as much again as its pixels; strokes past it are rasterized from their points.
+  static constexpr std::size_t kMaxStrokeBytes = kTileSize * kTileSize * 4;
+
+  struct CachedStroke {
+    CoverageMask mask;
+    bool drawn = false;
+  };
+
+  struct Tile {
+    Framebuffer pixels;
+    // Coverage of the long strokes crossing the tile, by shape handle bits, so redrawing the tile composites them
+    // without walking their points again.
+    std::unordered_map<std::uint64_t, CachedStroke> strokes;
+    std::size_t strokeBytes = 0;
+    bool dirty = true;
+    std::uint32_t lastUsed = 0;
+  };
+
+  float scale() const { return scale_; }
+  void setScale(float scale);
+  // Marks dirty every cached tile that `area` (document units) reaches, including its anti-aliased fringe.
+  void invalidate(const Bounds& area);
+
+  // Forgets a stroke's cached coverage in every tile, for strokes whose points changed other than by appending.
+  void dropStroke(std::uint64_t handle);
+
+  void beginFrame() { ++frame_; }
+  // The tile at (column, row), created dirty if missing, and marked as used by the current frame.
+  Tile& tile(std::int32_t column, std::int32_t row);
+  // Drops the least recently used tiles beyond kMaxTiles.
+  void evict();
+  std::size_t size() const { return tiles_.size(); }
+
+ private:
+  float scale_ = 0;
+  std::uint32_t frame_ = 0;
+  std::unordered_map<std::uint64_t, Tile> tiles_;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "shape_store.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+// What an action did to one row: a shape inserted there, or the shape removed from there. Rows are those of the
+// moment the step happened; undoing entries newest first brings the rows back to exactly that layout, so they stay
+// valid. An insert's shape is recorded when it is undone, so a stroke can be recorded long after it was started.
+struct UndoStep {
+  enum class Op : std::uint8_t { Insert, Remove };
+
+  Op op;
+  std::uint32_t row;
+  ShapeRecord shape;
+};
+
+struct UndoEntry {
+  std::vector<UndoStep> steps;
+};
+
+// Linear undo/redo history of shape insertions and removals. An entry holds only the rows its action changed, and
+// a finished stroke's points are referenced in the arena's sealed slab rather than copied, so an entry costs the
+// shapes it touched whatever the document holds. Past the memory limit the oldest entries are dropped.
+class UndoHistory {
+ public:
+  static constexpr std::size_t kDefaultLimit = 8 * 1024 * 1024;
+
+  // Steps between beginGroup() and the matching endGroup() form one entry; outside a group each step is its own.
+  void beginGroup();
+  void endGroup();
+  // Logs a step of a new action, which drops the entries that could be redone.
+  void record(const UndoStep& step);
+
+  // The newest entry to undo (or redo), moved out; the caller applies it, updates its shapes and hands it back with
+  // pushRedo() (or pushUndo()). Both close an open group.
+  std::optional<UndoEntry> popUndo();
+  std::optional<UndoEntry> popRedo();
+  void pushUndo(UndoEntry entry);
+  void pushRedo(UndoEntry entry);
+
+  bool canUndo() const { return !undo_.empty(); }
+  bool canRedo() const { return !redo_.empty(); }
+  // Memory held by the entries, undo and redo.
+  std::size_t bytes() const { return bytes_; }
+  // Drops the oldest entries beyond `bytes`; the newest undo entry is always kept.
+  void setLimit(std::size_t bytes);
+  void clear();
+
+ private:
+  static std::size_t entryBytes(const UndoEntry& entry);
+  void trim();
+
+  std::deque<UndoEntry> undo_;
+  std::vector<UndoEntry> redo_;
+  std::size_t bytes_ = 0;
+  std::size_t limit_ = kDefaultLimit;
+  std::size_t groupDepth_ = 0;
+  // The open group already has its entry at the back of undo_.
+  bool groupStarted_ = false;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool for frame-sized batches of independent tasks. run() deals the task indices round-robin into one
+// queue per participant; each participant pops from the back of its own queue and, once it is empty, steals from
+// the front of the others, so one expensive task does not leave the rest idle. The calling thread is participant 0
+// and works too. Built without FIGMA_ENGINE_THREADS (or with a single participant) everything runs inline.
+class WorkStealingPool {
+ public:
+  // `participants` counts the calling thread; 0 picks the hardware concurrency.
+  explicit WorkStealingPool(std::size_t participants);
+  ~WorkStealingPool();
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  std::size_t size() const { return queues_.size(); }
+  // Calls task(index, participant) once for every index in [0, count) and returns when all calls have returned.
+  void run(std::size_t count, const std::function<void(std::size_t, std::size_t)>& task);
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::size_t> tasks;
+  };
+
+  bool take(std::size_t participant, std::size_t& task);
+  void drain(std::size_t participant);
+  void workerLoop(std::size_t participant);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(std::size_t, std::size_t)>* task_ = nullptr;
+  std::atomic<std::size_t> remaining_ = 0;
+  std::uint64_t generation_ = 0;
+  bool stopping_ = false;
+};
@@ -0,0 +1,280 @@
+#include "archive_format.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace {
+constexpr std::uint32_t kArchiveMagic = 0x5241444D;  // "MDAR"
+constexpr std::uint16_t kArchiveVersion = 1;
+constexpr std::size_t kArchiveHeaderBytes = 16;
+constexpr std::size_t kDirectoryEntryBytes = 24;
+constexpr std::size_t kMetaBytes = 32;
+constexpr std::size_t kShapeRecordBytes = 56;
+constexpr std::size_t kPointBytes = sizeof(StrokePoint);
+constexpr std::uint64_t kSectionAlignment = 64;
+constexpr std::uint32_t kMaxSections = 64;
+constexpr std::uint32_t kNoStringIndex = 0xFFFFFFFF;
+
+enum SectionId : std::uint32_t { Meta = 1, Shapes = 2, Points = 3, StringOffsets = 4, StringBytes = 5 };
+constexpr std::array<SectionId, 5> kSections = {Meta, Shapes, Points, StringOffsets, StringBytes};
+
+static_assert(sizeof(StrokePoint) == 8, "archive points are stored as StrokePoint");
+
+std::uint64_t alignSection(std::uint64_t offset) {
+  return (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+}
+
+template <typename T>
+void appendValue(std::vector<std::uint8_t>& out, T value) {
+  const auto offset = out.size();
+  out.resize(offset + sizeof(T));
+  std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+T readAt(std::span<const std::uint8_t> bytes, std::size_t offset) {
+  T value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(T));
+  return value;
+}
+}  // namespace
+
+void ArchiveWriter::begin(const ShapeStore& shapes, const StringTable& strings, DocumentCounters counters) {
+  shapes_ = &shapes;
+  strings_ = &strings;
+  counters_ = counters;
+  stage_ = Stage::Header;
+  cursor_ = 0;
+  written_ = 0;
+  pointCursor_ = 0;
+  stringCursor_ = 0;
+
+  // Sizes first: the directory at the head of the file needs every section's offset.
+  pointCount_ = 0;
+  stringBytes_ = 0;
+  stringIndex_.assign(strings.size(), kNoStringIndex);
+  stringOrder_.clear();
+  const auto& labels = shapes.labels;
+  for (std::size_t row = 0; row < shapes.count(); ++row) {
+    pointCount_ += shapes.pointRange[row].length;
+    for (const auto id : {labels.ids[row], labels.names[row], labels.colors[row]}) {
+      auto& index = stringIndex_[static_cast<std::size_t>(id)];
+      if (index == kNoStringIndex) {
+        index = static_cast<std::uint32_t>(stringOrder_.size());
+        stringOrder_.push_back(id);
+        stringBytes_ += strings.get(id).size();
+      }
+    }
+  }
+
+  const auto meta = alignSection(kArchiveHeaderBytes + kSections.size() * kDirectoryEntryBytes);
+  const auto shape_records = alignSection(meta + kMetaBytes);
+  const auto points = alignSection(shape_records + shapes.count() * kShapeRecordBytes);
+  const auto string_offsets = alignSection(points + pointCount_ * kPointBytes);
+  const auto string_bytes = alignSection(string_offsets + (stringOrder_.size() + 1) * sizeof(std::uint64_t));
+  sectionOffsets_ = {meta, shape_records, points, string_offsets, string_bytes};
+}
+
+void ArchiveWriter::abort() {
+  stage_ = Stage::Idle;
+  shapes_ = nullptr;
+  strings_ = nullptr;
+}
+
+void ArchiveWriter::padTo(std::uint64_t offset) {
+  chunk_.resize(static_cast<std::size_t>(offset - written_), 0);
+}
+
+std::span<const std::uint8_t> ArchiveWriter::next() {
+  chunk_.clear();
+  if (stage_ == Stage::Idle) {
+    return {};
+  }
+  const auto& shapes = *shapes_;
+  const auto shape_count = shapes.count();
+  const auto string_count = stringOrder_.size();
+  while (stage_ != Stage::Done && chunk_.size() < DocumentWriter::kChunkBytes) {
+    switch (stage_) {
+      case Stage::Header: {
+        appendValue(chunk_, kArchiveMagic);
+        appendValue(chunk_, kArchiveVersion);
+        appendValue(chunk_, static_cast<std::uint16_t>(kArchiveHeaderBytes));
+        appendValue(chunk_, static_cast<std::uint32_t>(kSections.size()));
+        appendValue(chunk_, std::uint32_t{0});
+        const std::array<std::uint64_t, 5> section_bytes = {kMetaBytes,
+                                                            shape_count * kShapeRecordBytes,
+                                                            pointCount_ * kPointBytes,
+                                                            (string_count + 1) * sizeof(std::uint64_t),
+                                                            stringBytes_};
+        for (std::size_t section = 0; section < kSections.size(); ++section) {
+          appendValue(chunk_, static_cast<std::uint32_t>(kSections[section]));
+          appendValue(chunk_, std::uint32_t{0});
+          appendValue(chunk_, sectionOffsets_[section]);
+          appendValue(chunk_, section_bytes[section]);
+        }
+        padTo(sectionOffsets_[0]);
+        appendValue(chunk_, static_cast<std::uint64_t>(shape_count));
+        appendValue(chunk_, pointCount_);
+        appendValue(chunk_, static_cast<std::uint64_t>(string_count));
+        appendValue(chunk_, counters_.rectangles);
+        appendValue(chunk_, counters_.strokes);
+        padTo(sectionOffsets_[1]);
+        stage_ = Stage::Shapes;
+        break;
+      }
+      case Stage::Shapes:
+        if (cursor_ == shape_count) {
+          padTo(sectionOffsets_[2]);
+          stage_ = Stage::Points;
+          cursor_ = 0;
+          break;
+        }
+        appendValue(chunk_, static_cast<std::uint32_t>(shapes.kind[cursor_]));
+        appendValue(chunk_, shapes.rgba[cursor_]);
+        appendValue(chunk_, stringIndex_[static_cast<std::size_t>(shapes.labels.ids[cursor_])]);
+        appendValue(chunk_, stringIndex_[static_cast<std::size_t>(shapes.labels.names[cursor_])]);
+        appendValue(chunk_, stringIndex_[static_cast<std::size_t>(shapes.labels.colors[cursor_])]);
+        appendValue(chunk_, shapes.size[cursor_]);
+        appendValue(chunk_, shapes.x[cursor_]);
+        appendValue(chunk_, shapes.y[cursor_]);
+        appendValue(chunk_, shapes.width[cursor_]);
+        appendValue(chunk_, shapes.height[cursor_]);
+        appendValue(chunk_, pointCursor_);
+        appendValue(chunk_, shapes.pointRange[cursor_].length);
+        appendValue(chunk_, std::uint32_t{0});
+        pointCursor_ += shapes.pointRange[cursor_].length;
+        ++cursor_;
+        break;
+      case Stage::Points: {
+        if (cursor_ == shape_count) {
+          padTo(sectionOffsets_[3]);
+          stage_ = Stage::StringOffsets;
+          cursor_ = 0;
+          break;
+        }
+        const auto points = shapes.points(cursor_++, points_);
+        const auto* bytes = reinterpret_cast<const std::uint8_t*>(points.data());
+        chunk_.insert(chunk_.end(), bytes, bytes + points.size_bytes());
+        break;
+      }
+      case Stage::StringOffsets:
+        appendValue(chunk_, stringCursor_);
+        if (cursor_ == string_count) {
+          padTo(sectionOffsets_[4]);
+          stage_ = Stage::StringBytes;
+          cursor_ = 0;
+          break;
+        }
+        stringCursor_ += strings_->get(stringOrder_[cursor_++]).size();
+        break;
+      case Stage::StringBytes: {
+        if (cursor_ == string_count) {
+          stage_ = Stage::Done;
+          break;
+        }
+        const auto& value = strings_->get(stringOrder_[cursor_++]);
+        chunk_.insert(chunk_.end(), value.begin(), value.end());
+        break;
+      }
+      case Stage::Idle:
+      case Stage::Done:
+        break;
+    }
+  }
+  written_ += chunk_.size();
+  return chunk_;
+}
+
+std::optional<ArchiveView> ArchiveView::open(std::span<const std::uint8_t> bytes) {
+  if (bytes.size() < kArchiveHeaderBytes || readAt<std::uint32_t>(bytes, 0) != kArchiveMagic ||
+      readAt<std::uint16_t>(bytes, 4) != kArchiveVersion) {
+    return std::nullopt;
+  }
+  const auto header_bytes = readAt<std::uint16_t>(bytes, 6);
+  const auto section_count = readAt<std::uint32_t>(bytes, 8);
+  if (header_bytes < kArchiveHeaderBytes || section_count > kMaxSections ||
+      header_bytes + section_count * kDirectoryEntryBytes > bytes.size()) {
+    return std::nullopt;
+  }
+
+  // Sections are found by id, so later versions may add some; unknown ones are ignored.
+  std::array<std::span<const std::uint8_t>, kSections.size()> sections{};
+  std::array<bool, kSections.size()> found{};
+  for (std::uint32_t entry = 0; entry < section_count; ++entry) {
+    const auto offset = header_bytes + entry * kDirectoryEntryBytes;
+    const auto id = readAt<std::uint32_t>(bytes, offset);
+    const auto section_offset = readAt<std::uint64_t>(bytes, offset + 8);
+    const auto section_bytes = readAt<std::uint64_t>(bytes, offset + 16);
+    if (section_offset > bytes.size() || section_bytes > bytes.size() - section_offset) {
+      return std::nullopt;
+    }
+    if (id >= Meta && id <= StringBytes) {
+      sections[id - Meta] =
+          bytes.subspan(static_cast<std::size_t>(section_offset), static_cast<std::size_t>(section_bytes));
+      found[id - Meta] = true;
+    }
+  }
+  for (const auto present : found) {
+    if (!present) {
+      return std::nullopt;
+    }
+  }
+
+  ArchiveView view;
+  const auto meta = sections[0];
+  if (meta.size() < kMetaBytes) {
+    return std::nullopt;
+  }
+  view.shapeCount_ = readAt<std::uint64_t>(meta, 0);
+  const auto point_count = readAt<std::uint64_t>(meta, 8);
+  view.stringCount_ = readAt<std::uint64_t>(meta, 16);
+  view.counters_ = DocumentCounters{readAt<std::uint32_t>(meta, 24), readAt<std::uint32_t>(meta, 28)};
+
+  // Counts are checked by division so that hostile values cannot overflow; point offsets must fit a PointRange.
+  view.shapes_ = sections[1];
+  const auto points = sections[2];
+  view.stringOffsets_ = sections[3];
+  view.stringBytes_ = sections[4];
+  if (view.shapes_.size() / kShapeRecordBytes != view.shapeCount_ || view.shapes_.size() % kShapeRecordBytes != 0 ||
+      points.size() / kPointBytes != point_count || points.size() % kPointBytes != 0 ||
+      point_count > 0xFFFFFFFF ||
+      reinterpret_cast<std::uintptr_t>(points.data()) % alignof(StrokePoint) != 0 ||
+      view.stringOffsets_.size() / sizeof(std::uint64_t) != view.stringCount_ + 1 ||
+      view.stringOffsets_.size() % sizeof(std::uint64_t) != 0) {
+    return std::nullopt;
+  }
+  std::uint64_t previous = 0;
+  for (std::size_t index = 0; index <= view.stringCount_; ++index) {
+    const auto offset = readAt<std::uint64_t>(view.stringOffsets_, index * sizeof(std::uint64_t));
+    if (offset < previous || offset > view.stringBytes_.size()) {
+      return std::nullopt;
+    }
+    previous = offset;
+  }
+  view.points_ = std::span<const StrokePoint>(reinterpret_cast<const StrokePoint*>(points.data()),
+                                              static_cast<std::size_t>(point_count));
+  return view;
+}
+
+ArchiveShape ArchiveView::shape(std::size_t index) const {
+  const auto record = shapes_.subspan(index * kShapeRecordBytes, kShapeRecordBytes);
+  return ArchiveShape{static_cast<ShapeKind>(readAt<std::uint32_t>(record, 0)),
+                      readAt<std::uint32_t>(record, 4),
+                      readAt<std::uint32_t>(record, 8),
+                      readAt<std::uint32_t>(record, 12),
+                      readAt<std::uint32_t>(record, 16),
+                      readAt<float>(record, 20),
+                      readAt<float>(record, 24),
+                      readAt<float>(record, 28),
+                      readAt<float>(record, 32),
+                      readAt<float>(record, 36),
+                      readAt<std::uint64_t>(record, 40),
+                      readAt<std::uint32_t>(record, 48)};
+}
+
+std::string_view ArchiveView::string(std::size_t index) const {
+  const auto begin = readAt<std::uint64_t>(stringOffsets_, index * sizeof(std::uint64_t));
+  const auto end = readAt<std::uint64_t>(stringOffsets_, (index + 1) * sizeof(std::uint64_t));
+  return std::string_view(reinterpret_cast<const char*>(stringBytes_.data()) + begin,
+                          static_cast<std::size_t>(end - begin));
+}
@@ -0,0 +1,252 @@
+#include "engine.hpp"
+
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+#include <memory>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Embind adapter: translates JS command/event objects into calls on the platform-neutral Engine core and exposes
+// the engine-owned buffers as typed-array views into Wasm memory.
+namespace {
+float floatField(const emscripten::val& object, const char* name) {
+  return static_cast<float>(object[name].as<double>());
+}
+
+std::string stringField(const emscripten::val& object, const char* name) {
+  return object[name].as<std::string>();
+}
+
+using CommandHandler = void (*)(Engine&, const emscripten::val&);
+
+void createRectangle(Engine& engine, const emscripten::val& command) {
+  engine.createRectangle(floatField(command, "x"),
+                         floatField(command, "y"),
+                         floatField(command, "width"),
+                         floatField(command, "height"),
+                         stringField(command, "color"));
+}
+
+void startStroke(Engine& engine, const emscripten::val& command) {
+  engine.startStroke(stringField(command, "id"),
+                     floatField(command, "x"),
+                     floatField(command, "y"),
+                     floatField(command, "size"),
+                     stringField(command, "color"));
+}
+
+void updateStroke(Engine& engine, const emscripten::val& command) {
+  engine.updateStroke(stringField(command, "id"), floatField(command, "x"), floatField(command, "y"));
+}
+
+void finishStroke(Engine& engine, const emscripten::val& command) {
+  engine.finishStroke(stringField(command, "id"));
+}
+
+// Indexed by CommandOp; ops that only exist in the packed batch format have no object form.
+constexpr std::array<CommandHandler, kCommandOpCount> kCommandHandlers = {
+    nullptr, &createRectangle, &startStroke, &updateStroke, &finishStroke, nullptr, nullptr, nullptr, nullptr, nullptr};
+
+// Commands carrying a numeric `op` (CommandOp) skip the string shim entirely; `type` is only read as a fallback.
+void execute(Engine& engine, emscripten::val command) {
+  std::size_t op = 0;
+  if (const auto op_val = command["op"]; op_val.isNumber()) {
+    op = op_val.as<std::size_t>();
+  } else if (const auto parsed = parseCommandOp(stringField(command, "type")); parsed.has_value()) {
+    op = static_cast<std::size_t>(*parsed);
+  }
+
+  if (op < kCommandHandlers.size() && kCommandHandlers[op] != nullptr) {
+    kCommandHandlers[op](engine, command);
+  }
+}
+
+void pointerEvent(Engine& engine, emscripten::val event) {
+  const auto type = event["type"].as<std::string>();
+  if (type != "pointerMove") {
+    return;
+  }
+
+  engine.pointerMove(event["pointerId"].as<int>(), floatField(event, "x"), floatField(event, "y"));
+}
+
+emscripten::val tick(const Engine& engine) {
+  const auto& store = engine.shapes();
+  const auto& strings = engine.strings();
+  auto shapes = emscripten::val::array();
+  std::vector<StrokePoint> scratch;
+  for (std::size_t index = 0; index < store.count(); ++index) {
+    auto shape = emscripten::val::object();
+    shape.set("id", strings.get(store.labels.ids[index]));
+    shape.set("name", strings.get(store.labels.names[index]));
+    shape.set("color", strings.get(store.labels.colors[index]));
+    if (store.kind[index] == ShapeKind::Rectangle) {
+      shape.set("kind", std::string("rectangle"));
+      shape.set("x", store.x[index]);
+      shape.set("y", store.y[index]);
+      shape.set("width", store.width[index]);
+      shape.set("height", store.height[index]);
+    } else {
+      shape.set("kind", std::string("stroke"));
+      shape.set("size", store.size[index]);
+      auto points = emscripten::val::array();
+      const auto stroke_points = store.points(index, scratch);
+      for (std::size_t point_index = 0; point_index < stroke_points.size(); ++point_index) {
+        auto point_val = emscripten::val::object();
+        point_val.set("x", stroke_points[point_index].x);
+        point_val.set("y", stroke_points[point_index].y);
+        points.set(point_index, point_val);
+      }
+      shape.set("points", points);
+    }
+    shapes.set(index, shape);
+  }
+
+  auto presences = emscripten::val::array();
+  std::size_t presence_index = 0;
+  for (const auto& [id, presence] : engine.presences()) {
+    auto presence_val = emscripten::val::object();
+    presence_val.set("id", strings.get(presence.id));
+    presence_val.set("color", strings.get(presence.color));
+    presence_val.set("x", presence.x);
+    presence_val.set("y", presence.y);
+    presences.set(presence_index++, presence_val);
+  }
+
+  auto document = emscripten::val::object();
+  document.set("id", std::string("doc-native"));
+  document.set("name", std::string("Composition native"));
+  document.set("shapes", shapes);
+
+  auto state = emscripten::val::object();
+  state.set("document", document);
+  state.set("presences", presences);
+  return state;
+}
+
+template <typename T>
+emscripten::val memoryView(std::span<T> bytes) {
+  return emscripten::val(emscripten::typed_memory_view(bytes.size(), bytes.data()));
+}
+
+emscripten::val commandBuffer(Engine& engine, std::uint32_t byte_length) {
+  return memoryView(engine.commandBuffer(byte_length));
+}
+
+emscripten::val startedStrokes(const Engine& engine) {
+  return memoryView(engine.startedStrokes());
+}
+
+emscripten::val queryRect(Engine& engine, float min_x, float min_y, float max_x, float max_y) {
+  return memoryView(engine.queryRect(min_x, min_y, max_x, max_y));
+}
+
+emscripten::val queryPoint(Engine& engine, float x, float y) {
+  return memoryView(engine.queryPoint(x, y));
+}
+
+emscripten::val queryRadius(Engine& engine, float x, float y, float radius) {
+  return memoryView(engine.queryRadius(x, y, radius));
+}
+
+emscripten::val tickBinary(Engine& engine) {
+  return memoryView(engine.tickBinary());
+}
+
+emscripten::val tickVisible(Engine& engine) {
+  return memoryView(engine.tickVisible());
+}
+
+emscripten::val tickSince(Engine& engine, std::uint32_t revision) {
+  return memoryView(engine.tickSince(revision));
+}
+
+// Each chunk aliases engine memory until the next saveChunk() call; empty once the document is written.
+emscripten::val saveChunk(Engine& engine) {
+  return memoryView(engine.saveChunk());
+}
+
+emscripten::val loadBuffer(Engine& engine, std::uint32_t byte_length) {
+  return memoryView(engine.loadBuffer(byte_length));
+}
+
+// Aliases engine memory until the next shape change; empty when nothing was logged since the last call.
+emscripten::val journalChunk(Engine& engine) {
+  return memoryView(engine.journalChunk());
+}
+
+// The archive is copied in once and then used in place, so its points are never decoded.
+emscripten::val archiveBuffer(Engine& engine, std::uint32_t byte_length) {
+  return memoryView(engine.archiveBuffer(byte_length));
+}
+
+// { pixels, left, top, width, height, dirty… }; `pixels` aliases the engine's framebuffer until the next render().
+emscripten::val render(Engine& engine, float scale) {
+  const auto frame = engine.render(scale);
+  auto result = emscripten::val::object();
+  result.set("pixels", memoryView(frame.pixels));
+  result.set("left", frame.left);
+  result.set("top", frame.top);
+  result.set("width", frame.width);
+  result.set("height", frame.height);
+  result.set("dirtyLeft", frame.dirtyLeft);
+  result.set("dirtyTop", frame.dirtyTop);
+  result.set("dirtyWidth", frame.dirtyWidth);
+  result.set("dirtyHeight", frame.dirtyHeight);
+  return result;
+}
+
+std::shared_ptr<Engine> createEngine(int width, int height) {
+  auto engine = std::make_shared<Engine>();
+  engine->resize(width, height);
+  return engine;
+}
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(figma_engine_module) {
+  emscripten::class_<Engine>("Engine")
+      .smart_ptr<std::shared_ptr<Engine>>("Engine")
+      .function("resize", &Engine::resize)
+      .function("setViewport", &Engine::setViewport)
+      .function("setSimplifyTolerance", &Engine::setSimplifyTolerance)
+      .function("execute", &execute)
+      .function("internString", &Engine::internString)
+      .function("commandBuffer", &commandBuffer)
+      .function("executeBatch", &Engine::executeBatch)
+      .function("startedStrokes", &startedStrokes)
+      .function("pointerEvent", &pointerEvent)
+      .function("tick", &tick)
+      .function("queryRect", &queryRect)
+      .function("queryPoint", &queryPoint)
+      .function("queryRadius", &queryRadius)
+      .function("tickBinary", &tickBinary)
+      .function("tickVisible", &tickVisible)
+      .function("tickSince", &tickSince)
+      .function("render", &render)
+      .function("beginSave", &Engine::beginSave)
+      .function("saveChunk", &saveChunk)
+      .function("beginLoad", &Engine::beginLoad)
+      .function("loadBuffer", &loadBuffer)
+      .function("loadChunk", emscripten::select_overload<bool(std::uint32_t)>(&Engine::loadChunk))
+      .function("finishLoad", &Engine::finishLoad)
+      .function("beginArchiveSave", &Engine::beginArchiveSave)
+      .function("archiveBuffer", &archiveBuffer)
+      .function("openArchive", emscripten::select_overload<bool(std::uint32_t)>(&Engine::openArchive))
+      .function("setJournaling", &Engine::setJournaling)
+      .function("journalChunk", &journalChunk)
+      .function("journalNeedsCompaction", &Engine::journalNeedsCompaction)
+      .function("beginCompaction", &Engine::beginCompaction)
+      .function("compactionComplete", &Engine::compactionComplete)
+      .function("replayJournal", emscripten::select_overload<std::uint32_t(std::uint32_t)>(&Engine::replayJournal))
+      .function("undo", &Engine::undo)
+      .function("redo", &Engine::redo)
+      .function("canUndo", &Engine::canUndo)
+      .function("canRedo", &Engine::canRedo)
+      .function("beginUndoGroup", &Engine::beginUndoGroup)
+      .function("endUndoGroup", &Engine::endUndoGroup)
+      .function("revision", &Engine::revision);
+
+  emscripten::function("createEngine", &createEngine);
+}
@@ -0,0 +1,465 @@
+#include "document_format.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+namespace {
+constexpr std::uint32_t kDocumentMagic = 0x4344444D;  // "MDDC"
+constexpr std::uint16_t kDocumentVersion = 1;
+constexpr std::size_t kDocumentHeaderBytes = 24;
+constexpr std::uint8_t kTagString = 1;
+constexpr std::uint8_t kTagRectangle = 2;
+constexpr std::uint8_t kTagStroke = 3;
+constexpr std::uint8_t kTagEnd = 4;
+constexpr std::uint8_t kPointsQuantized = 0;
+constexpr std::uint8_t kPointsRaw = 1;
+// Larger payload lengths are taken as corruption rather than waited for.
+constexpr std::uint64_t kMaxRecordBytes = std::uint64_t{1} << 30;
+// Quantized coordinates stay within this magnitude, so deltas and their sums never overflow.
+constexpr double kMaxQuantized = 1 << 30;
+constexpr std::uint32_t kNoStringNumber = 0xFFFFFFFF;
+// A varint of a 64-bit value.
+constexpr std::size_t kMaxVarintBytes = 10;
+
+// Slicing-by-8 tables: table[0] is the classic bytewise one, table[k] advances a byte through k more zero bytes.
+constexpr std::array<std::array<std::uint32_t, 256>, 8> kCrcTables = [] {
+  std::array<std::array<std::uint32_t, 256>, 8> tables{};
+  for (std::uint32_t index = 0; index < 256; ++index) {
+    auto value = index;
+    for (int bit = 0; bit < 8; ++bit) {
+      value = (value & 1) != 0 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+    }
+    tables[0][index] = value;
+  }
+  for (std::size_t slice = 1; slice < tables.size(); ++slice) {
+    for (std::size_t index = 0; index < 256; ++index) {
+      const auto previous = tables[slice - 1][index];
+      tables[slice][index] = tables[0][previous & 0xFF] ^ (previous >> 8);
+    }
+  }
+  return tables;
+}();
+
+template <typename T>
+void appendValue(std::vector<std::uint8_t>& out, T value) {
+  const auto offset = out.size();
+  out.resize(offset + sizeof(T));
+  std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+void appendVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+
+std::uint64_t zigzag(std::int64_t value) {
+  return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value) {
+  return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+// Bounds-checked little-endian reads over one record; every method fails once the bytes run out.
+class ByteReader {
+ public:
+  explicit ByteReader(std::span<const std::uint8_t> bytes) : bytes_(bytes) {}
+
+  std::size_t offset() const { return offset_; }
+  std::size_t remaining() const { return bytes_.size() - offset_; }
+
+  bool varint(std::uint64_t& value) {
+    // Most point deltas fit in one byte.
+    if (offset_ < bytes_.size() && bytes_[offset_] < 0x80) {
+      value = bytes_[offset_++];
+      return true;
+    }
+    value = 0;
+    for (std::size_t index = 0; index < kMaxVarintBytes && offset_ < bytes_.size(); ++index) {
+      const auto byte = bytes_[offset_++];
+      value |= static_cast<std::uint64_t>(byte & 0x7F) << (7 * index);
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename T>
+  bool value(T& result) {
+    if (remaining() < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&result, bytes_.data() + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+ private:
+  std::span<const std::uint8_t> bytes_;
+  std::size_t offset_ = 0;
+};
+
+bool quantizable(std::span<const StrokePoint> points, double scale) {
+  return std::all_of(points.begin(), points.end(), [scale](StrokePoint point) {
+    return std::abs(point.x * scale) <= kMaxQuantized && std::abs(point.y * scale) <= kMaxQuantized;
+  });
+}
+}  // namespace
+
+std::uint32_t crc32(std::span<const std::uint8_t> bytes, std::uint32_t crc) {
+  const auto& tables = kCrcTables;
+  crc = ~crc;
+  std::size_t offset = 0;
+  for (; offset + 8 <= bytes.size(); offset += 8) {
+    std::uint32_t low;
+    std::uint32_t high;
+    std::memcpy(&low, bytes.data() + offset, 4);
+    std::memcpy(&high, bytes.data() + offset + 4, 4);
+    low ^= crc;
+    crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+          tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+  }
+  for (; offset < bytes.size(); ++offset) {
+    crc = tables[0][(crc ^ bytes[offset]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void DocumentWriter::begin(const ShapeStore& shapes, const StringTable& strings, DocumentCounters counters) {
+  shapes_ = &shapes;
+  strings_ = &strings;
+  counters_ = counters;
+  stage_ = Stage::Header;
+  row_ = 0;
+  crc_ = 0;
+  stringNumbers_.assign(strings.size(), kNoStringNumber);
+  stringCount_ = 0;
+}
+
+void DocumentWriter::abort() {
+  stage_ = Stage::Idle;
+  shapes_ = nullptr;
+  strings_ = nullptr;
+}
+
+std::span<const std::uint8_t> DocumentWriter::next() {
+  chunk_.clear();
+  if (stage_ == Stage::Idle || stage_ == Stage::Done) {
+    return {};
+  }
+  if (stage_ == Stage::Header) {
+    appendValue(chunk_, kDocumentMagic);
+    appendValue(chunk_, kDocumentVersion);
+    appendValue(chunk_, static_cast<std::uint16_t>(kDocumentHeaderBytes));
+    appendValue(chunk_, std::uint32_t{0});
+    appendValue(chunk_, counters_.rectangles);
+    appendValue(chunk_, counters_.strokes);
+    appendValue(chunk_, kPointScaleLog2);
+    stage_ = Stage::Shapes;
+  }
+
+  while (row_ < shapes_->count() && chunk_.size() < kChunkBytes) {
+    writeShape(row_++);
+  }
+  crc_ = crc32(chunk_, crc_);
+  if (row_ == shapes_->count() && chunk_.size() < kChunkBytes) {
+    payload_.clear();
+    appendVarint(payload_, shapes_->count());
+    appendVarint(payload_, stringCount_);
+    appendValue(payload_, crc_);
+    writeRecord(kTagEnd);
+    stage_ = Stage::Done;
+  }
+  return chunk_;
+}
+
+void DocumentWriter::writeRecord(std::uint8_t tag) {
+  chunk_.push_back(tag);
+  appendVarint(chunk_, payload_.size());
+  chunk_.insert(chunk_.end(), payload_.begin(), payload_.end());
+}
+
+// Writes the string record the first time a string is used.
+std::uint32_t DocumentWriter::stringNumber(StringId id) {
+  auto& number = stringNumbers_[static_cast<std::size_t>(id)];
+  if (number == kNoStringNumber) {
+    const auto& value = strings_->get(id);
+    payload_.assign(value.begin(), value.end());
+    writeRecord(kTagString);
+    number = stringCount_++;
+  }
+  return number;
+}
+
+void DocumentWriter::writeShape(std::size_t row) {
+  const auto& shapes = *shapes_;
+  const auto id = stringNumber(shapes.labels.ids[row]);
+  const auto name = stringNumber(shapes.labels.names[row]);
+  const auto color = stringNumber(shapes.labels.colors[row]);
+  payload_.clear();
+  appendVarint(payload_, id);
+  appendVarint(payload_, name);
+  appendVarint(payload_, color);
+  if (shapes.kind[row] == ShapeKind::Rectangle) {
+    appendValue(payload_, shapes.x[row]);
+    appendValue(payload_, shapes.y[row]);
+    appendValue(payload_, shapes.width[row]);
+    appendValue(payload_, shapes.height[row]);
+    writeRecord(kTagRectangle);
+    return;
+  }
+
+  const auto points = shapes.points(row, points_);
+  constexpr double scale = 1 << kPointScaleLog2;
+  appendValue(payload_, shapes.size[row]);
+  if (!quantizable(points, scale)) {
+    appendValue(payload_, kPointsRaw);
+    appendVarint(payload_, points.size());
+    for (const auto& point : points) {
+      appendValue(payload_, point.x);
+      appendValue(payload_, point.y);
+    }
+    writeRecord(kTagStroke);
+    return;
+  }
+  // Neighbouring samples are close, so deltas of the quantized coordinates mostly fit in one or two bytes.
+  appendValue(payload_, kPointsQuantized);
+  appendVarint(payload_, points.size());
+  std::int64_t previous_x = 0;
+  std::int64_t previous_y = 0;
+  for (const auto& point : points) {
+    const auto x = std::llround(point.x * scale);
+    const auto y = std::llround(point.y * scale);
+    appendVarint(payload_, zigzag(x - previous_x));
+    appendVarint(payload_, zigzag(y - previous_y));
+    previous_x = x;
+    previous_y = y;
+  }
+  writeRecord(kTagStroke);
+}
+
+void DocumentReader::begin(StringTable& strings) {
+  reset();
+  strings_ = &strings;
+  stage_ = Stage::Header;
+}
+
+void DocumentReader::reset() {
+  strings_ = nullptr;
+  stage_ = Stage::Idle;
+  pointScaleLog2_ = 0;
+  crc_ = 0;
+  counters_ = {};
+  shapes_ = ShapeStore{};
+  documentStrings_ = {};
+  documentColors_ = {};
+  points_ = {};
+  pending_ = {};
+}
+
+bool DocumentReader::feed(std::span<const std::uint8_t> bytes) {
+  if (stage_ == Stage::Idle || stage_ == Stage::Failed) {
+    return false;
+  }
+  // Whole records are decoded in place; only a split record's head is copied and completed by later pieces.
+  if (pending_.empty()) {
+    const auto consumed = parse(bytes);
+    pending_.assign(bytes.begin() + static_cast<std::ptrdiff_t>(consumed), bytes.end());
+  } else {
+    pending_.insert(pending_.end(), bytes.begin(), bytes.end());
+    const auto consumed = parse(pending_);
+    pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(consumed));
+  }
+  if (stage_ == Stage::Done && !pending_.empty()) {
+    stage_ = Stage::Failed;
+  }
+  if (stage_ == Stage::Failed) {
+    pending_ = {};
+    return false;
+  }
+  return true;
+}
+
+// Consumes the header and whole records from `bytes`; returns how many bytes were used.
+std::size_t DocumentReader::parse(std::span<const std::uint8_t> bytes) {
+  std::size_t offset = 0;
+  if (stage_ == Stage::Header) {
+    if (bytes.size() < kDocumentHeaderBytes) {
+      return 0;
+    }
+    ByteReader header(bytes);
+    std::uint32_t magic = 0;
+    std::uint16_t version = 0;
+    std::uint16_t header_bytes = 0;
+    std::uint32_t flags = 0;
+    header.value(magic);
+    header.value(version);
+    header.value(header_bytes);
+    header.value(flags);
+    header.value(counters_.rectangles);
+    header.value(counters_.strokes);
+    header.value(pointScaleLog2_);
+    if (magic != kDocumentMagic || version != kDocumentVersion || header_bytes < kDocumentHeaderBytes ||
+        pointScaleLog2_ > 24) {
+      stage_ = Stage::Failed;
+      return 0;
+    }
+    // Later minor revisions may append header fields; they are skipped.
+    if (bytes.size() < header_bytes) {
+      return 0;
+    }
+    crc_ = crc32(bytes.first(header_bytes), crc_);
+    offset = header_bytes;
+    stage_ = Stage::Records;
+  }
+
+  while (stage_ == Stage::Records && offset < bytes.size()) {
+    ByteReader reader(bytes.subspan(offset + 1));
+    std::uint64_t length = 0;
+    if (!reader.varint(length)) {
+      if (reader.remaining() == 0 && bytes.size() - offset - 1 < kMaxVarintBytes) {
+        break;
+      }
+      stage_ = Stage::Failed;
+      break;
+    }
+    if (length > kMaxRecordBytes) {
+      stage_ = Stage::Failed;
+      break;
+    }
+    const auto payload_offset = offset + 1 + reader.offset();
+    if (bytes.size() - payload_offset < length) {
+      break;
+    }
+    const auto record = bytes.subspan(offset, payload_offset - offset + length);
+    if (!readRecord(bytes[offset], bytes.subspan(payload_offset, length), record)) {
+      stage_ = Stage::Failed;
+      break;
+    }
+    offset += record.size();
+  }
+  return offset;
+}
+
+bool DocumentReader::readRecord(std::uint8_t tag,
+                                std::span<const std::uint8_t> payload,
+                                std::span<const std::uint8_t> record) {
+  if (tag == kTagEnd) {
+    ByteReader reader(payload);
+    std::uint64_t shape_count = 0;
+    std::uint64_t string_count = 0;
+    std::uint32_t crc = 0;
+    if (!reader.varint(shape_count) || !reader.varint(string_count) || !reader.value(crc) ||
+        shape_count != shapes_.count() || string_count != documentStrings_.size() || crc != crc_) {
+      return false;
+    }
+    stage_ = Stage::Done;
+    return true;
+  }
+
+  crc_ = crc32(record, crc_);
+  if (tag == kTagString) {
+    documentStrings_.emplace_back(reinterpret_cast<const char*>(payload.data()), payload.size());
+    documentColors_.emplace_back();
+    return true;
+  }
+  return readShape(tag, payload);
+}
+
+bool DocumentReader::readShape(std::uint8_t tag, std::span<const std::uint8_t> payload) {
+  if (tag != kTagRectangle && tag != kTagStroke) {
+    return false;
+  }
+  ByteReader reader(payload);
+  std::array<StringId, 3> labels{};
+  for (auto& label : labels) {
+    std::uint64_t number = 0;
+    if (!reader.varint(number) || number >= documentStrings_.size()) {
+      return false;
+    }
+    label = static_cast<StringId>(number);
+  }
+  auto& color = documentColors_[static_cast<std::size_t>(labels[2])];
+  if (!color.has_value()) {
+    color = parseColor(documentStrings_[static_cast<std::size_t>(labels[2])]);
+  }
+  const auto rgba = *color;
+  const auto key = static_cast<std::uint32_t>(shapes_.count() + 1);
+
+  std::size_t row = 0;
+  if (tag == kTagRectangle) {
+    float left = 0;
+    float top = 0;
+    float width = 0;
+    float height = 0;
+    if (!reader.value(left) || !reader.value(top) || !reader.value(width) || !reader.value(height)) {
+      return false;
+    }
+    row = shapes_.addRectangle(key, 0, left, top, width, height, rgba);
+  } else {
+    float size = 0;
+    std::uint8_t encoding = 0;
+    std::uint64_t count = 0;
+    if (!reader.value(size) || !reader.value(encoding) || !reader.varint(count) || count == 0) {
+      return false;
+    }
+    // Checked against the bytes left before allocating: a quantized point takes at least two, a raw one eight.
+    if ((encoding == kPointsQuantized && count > reader.remaining() / 2) ||
+        (encoding == kPointsRaw && count != reader.remaining() / 8) ||
+        (encoding != kPointsQuantized && encoding != kPointsRaw)) {
+      return false;
+    }
+    points_.resize(count);
+    if (encoding == kPointsRaw) {
+      for (auto& point : points_) {
+        reader.value(point.x);
+        reader.value(point.y);
+      }
+    } else {
+      const auto step = 1 / static_cast<double>(1 << pointScaleLog2_);
+      std::uint64_t x = 0;
+      std::uint64_t y = 0;
+      for (auto& point : points_) {
+        std::uint64_t dx = 0;
+        std::uint64_t dy = 0;
+        if (!reader.varint(dx) || !reader.varint(dy)) {
+          return false;
+        }
+        // Unsigned sums wrap instead of overflowing on hostile input.
+        x += static_cast<std::uint64_t>(unzigzag(dx));
+        y += static_cast<std::uint64_t>(unzigzag(dy));
+        point = StrokePoint{static_cast<float>(static_cast<double>(static_cast<std::int64_t>(x)) * step),
+                            static_cast<float>(static_cast<double>(static_cast<std::int64_t>(y)) * step)};
+      }
+    }
+    row = shapes_.addSealedStroke(key, 0, points_, size, rgba);
+  }
+  if (reader.remaining() != 0) {
+    return false;
+  }
+  shapes_.labels.ids[row] = labels[0];
+  shapes_.labels.names[row] = labels[1];
+  shapes_.labels.colors[row] = labels[2];
+  return true;
+}
+
+ShapeStore DocumentReader::takeShapes() {
+  std::vector<StringId> interned(documentStrings_.size());
+  for (std::size_t number = 0; number < interned.size(); ++number) {
+    interned[number] = strings_->intern(documentStrings_[number]);
+  }
+  for (auto* labels : {&shapes_.labels.ids, &shapes_.labels.names, &shapes_.labels.colors}) {
+    for (auto& label : *labels) {
+      label = interned[static_cast<std::size_t>(label)];
+    }
+  }
+  return std::move(shapes_);
+}
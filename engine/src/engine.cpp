@@ -1,42 +1,189 @@
 #include "engine.hpp"
 
-#include <emscripten/bind.h>
-#include <memory>
-#include <utility>
+#include "polyline_simplify.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
-#include <sstream>
+#include <cstring>
 #include <string>
+#include <utility>
 
 namespace {
-std::string makeRectangleId(std::size_t index) {
-  std::ostringstream stream;
-  stream << "rect-" << index + 1;
-  return stream.str();
+// "rect-3", "Trace 12", …: generated labels are built once per shape and interned.
+StringId internNumbered(StringTable& strings, std::string_view prefix, std::size_t index) {
+  std::string value(prefix);
+  value += std::to_string(index + 1);
+  return strings.intern(value);
+}
+
+// Matches the canvas element's CSS background, so frames can be blitted without unpremultiplying.
+constexpr std::uint32_t kRenderBackground = 0xFFFFFFFF;
+// Strokes with fewer points are rasterized from their points on every tile redraw, which is about as cheap as
+// compositing a cached mask.
+constexpr std::size_t kCachedStrokePoints = 16;
+// Keeps viewport-derived pixel coordinates well inside int range.
+constexpr float kMaxPixelCoordinate = 1e9f;
+
+int floorDiv(int value, int divisor) {
+  return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
 }
 
-std::string makeRectangleName(std::size_t index) {
-  std::ostringstream stream;
-  stream << "Rectangle " << index + 1;
-  return stream.str();
+// Area a new stroke segment paints.
+Bounds segmentBounds(StrokePoint from, StrokePoint to, float size) {
+  const auto pad = size / 2;
+  return Bounds{std::min(from.x, to.x) - pad, std::min(from.y, to.y) - pad, std::max(from.x, to.x) + pad,
+                std::max(from.y, to.y) + pad};
 }
 
-std::string makeStrokeName(std::size_t index) {
-  std::ostringstream stream;
-  stream << "Trace " << index + 1;
-  return stream.str();
+// Layout of the buffer produced by tickBinary(); mirrored in src/engine/snapshot.ts.
+constexpr std::uint32_t kSnapshotMagic = 0x4E53444D;  // "MDSN"
+constexpr std::uint16_t kSnapshotVersion = 1;
+constexpr std::size_t kSnapshotHeaderBytes = 32;
+constexpr std::size_t kSnapshotShapeBytes = 32;
+constexpr std::size_t kSnapshotPresenceBytes = 16;
+constexpr std::size_t kSnapshotPointBytes = 8;
+constexpr std::uint32_t kDeltaMagic = 0x4C44444D;  // "MDDL"
+constexpr std::uint16_t kDeltaVersion = 1;
+constexpr std::size_t kDeltaHeaderBytes = 40;
+constexpr std::size_t kDeltaRecordBytes = 8 + kSnapshotShapeBytes;
+constexpr std::uint32_t kDeltaFlagFullResync = 1;
+// Past this many unacknowledged changes the journal is dropped and stale readers get a full resync.
+constexpr std::size_t kMaxPendingChanges = 1 << 16;
+
+std::size_t paddedStringBytes(const std::string& value) {
+  return 4 + ((value.size() + 3) & ~static_cast<std::size_t>(3));
+}
+
+// Bytes taken in the string section by a shape's id and name.
+std::size_t labelBytes(const StringTable& strings, const ShapeStore& shapes, std::size_t index) {
+  return paddedStringBytes(strings.get(shapes.labels.ids[index])) +
+         paddedStringBytes(strings.get(shapes.labels.names[index]));
+}
+
+template <typename T>
+T readAt(const std::uint8_t* buffer, std::size_t offset) {
+  T value;
+  std::memcpy(&value, buffer + offset, sizeof(T));
+  return value;
+}
+
+template <typename T>
+void writeAt(std::uint8_t* buffer, std::size_t offset, T value) {
+  std::memcpy(buffer + offset, &value, sizeof(T));
+}
+
+std::uint32_t writeString(std::uint8_t* buffer, std::size_t strings_offset, std::size_t& cursor, const std::string& value) {
+  const auto relative = static_cast<std::uint32_t>(cursor);
+  writeAt(buffer, strings_offset + cursor, static_cast<std::uint32_t>(value.size()));
+  std::memcpy(buffer + strings_offset + cursor + 4, value.data(), value.size());
+  cursor += paddedStringBytes(value);
+  return relative;
+}
+
+void writeRectangleBody(std::uint8_t* buffer,
+                        std::size_t offset,
+                        const ShapeStore& shapes,
+                        std::size_t index,
+                        std::uint32_t id_ref,
+                        std::uint32_t name_ref) {
+  writeAt(buffer, offset, static_cast<std::uint32_t>(ShapeKind::Rectangle));
+  writeAt(buffer, offset + 4, shapes.rgba[index]);
+  writeAt(buffer, offset + 8, id_ref);
+  writeAt(buffer, offset + 12, name_ref);
+  writeAt(buffer, offset + 16, shapes.x[index]);
+  writeAt(buffer, offset + 20, shapes.y[index]);
+  writeAt(buffer, offset + 24, shapes.width[index]);
+  writeAt(buffer, offset + 28, shapes.height[index]);
+}
+
+// Stroke body referencing `point_count` points starting at `point_cursor` in the points section; `first_point` is the
+// index of the first of them within the stroke (non-zero only for appended points in a delta).
+void writeStrokeBody(std::uint8_t* buffer,
+                     std::size_t offset,
+                     const ShapeStore& shapes,
+                     std::size_t index,
+                     std::uint32_t id_ref,
+                     std::uint32_t name_ref,
+                     std::size_t point_cursor,
+                     std::size_t point_count,
+                     std::size_t first_point) {
+  writeAt(buffer, offset, static_cast<std::uint32_t>(ShapeKind::Stroke));
+  writeAt(buffer, offset + 4, shapes.rgba[index]);
+  writeAt(buffer, offset + 8, id_ref);
+  writeAt(buffer, offset + 12, name_ref);
+  writeAt(buffer, offset + 16, shapes.size[index]);
+  writeAt(buffer, offset + 20, static_cast<std::uint32_t>(point_cursor));
+  writeAt(buffer, offset + 24, static_cast<std::uint32_t>(point_count));
+  writeAt(buffer, offset + 28, static_cast<std::uint32_t>(first_point));
+}
+
+void copyPoints(std::uint8_t* buffer,
+                std::size_t points_offset,
+                std::size_t point_cursor,
+                std::span<const StrokePoint> points) {
+  if (!points.empty()) {
+    std::memcpy(buffer + points_offset + point_cursor * kSnapshotPointBytes,
+                points.data(),
+                points.size() * kSnapshotPointBytes);
+  }
 }
 
-std::string colorForPointer(int pointer_id) {
-  static constexpr std::array<const char*, 6> palette = {
+void writeSnapshotHeader(std::uint8_t* buffer,
+                         std::uint32_t revision,
+                         std::size_t shape_count,
+                         std::size_t presence_count,
+                         std::size_t point_count,
+                         std::size_t string_bytes) {
+  writeAt(buffer, 0, kSnapshotMagic);
+  writeAt(buffer, 4, kSnapshotVersion);
+  writeAt(buffer, 6, static_cast<std::uint16_t>(kSnapshotHeaderBytes));
+  writeAt(buffer, 8, revision);
+  writeAt(buffer, 12, static_cast<std::uint32_t>(shape_count));
+  writeAt(buffer, 16, static_cast<std::uint32_t>(presence_count));
+  writeAt(buffer, 20, static_cast<std::uint32_t>(point_count));
+  writeAt(buffer, 24, static_cast<std::uint32_t>(string_bytes));
+  writeAt(buffer, 28, std::uint32_t{0});
+}
+
+void writePresenceRecord(std::uint8_t* buffer, std::size_t offset, int pointer_id, const Presence& presence) {
+  writeAt(buffer, offset, static_cast<std::int32_t>(pointer_id));
+  writeAt(buffer, offset + 4, presence.rgba);
+  writeAt(buffer, offset + 8, presence.x);
+  writeAt(buffer, offset + 12, presence.y);
+}
+
+std::string_view colorForPointer(int pointer_id) {
+  static constexpr std::array<std::string_view, 6> palette = {
       "#22d3ee", "#f97316", "#a855f7", "#facc15", "#34d399", "#ef4444"};
   const auto normalized = std::abs(pointer_id) % static_cast<int>(palette.size());
   return palette[normalized];
 }
 }  // namespace
 
-Engine::Engine() : width_(0), height_(0) {}
+Engine::Engine()
+    : width_(0),
+      height_(0),
+      viewport_{0, 0, 0, 0},
+      rectangleCount_(0),
+      strokeCount_(0),
+      simplifyTolerance_(kDefaultSimplifyTolerance),
+      revision_(0),
+      nextShapeKey_(1),
+      changesBase_(0),
+      frameLeft_(0),
+      frameTop_(0),
+      renderThreads_(0),
+      savingArchive_(false),
+      journalLimit_(kDefaultJournalLimit),
+      replaying_(false),
+      compacting_(false),
+      compacted_(false),
+      undoing_(false),
+      shapesRevision_(0),
+      saveRevision_(0) {
+  journal_.restart(JournalBase{0, 0});
+}
 
 void Engine::resize(int width, int height) {
   width_ = width;
@@ -48,183 +195,1294 @@ void Engine::resize(int width, int height) {
   if (height_ < 0) {
     height_ = 0;
   }
+  viewport_ = Bounds{0, 0, static_cast<float>(width_), static_cast<float>(height_)};
 }
 
-Rectangle Engine::makeRectangle(float x, float y, float width, float height, std::string color) const {
-  const auto index = rectangles_.size();
-  return Rectangle{
-      makeRectangleId(index),
-      makeRectangleName(index),
-      x,
-      y,
-      width,
-      height,
-      std::move(color)};
-}
-
-Stroke Engine::makeStroke(std::string id,
-                          std::string name,
-                          float x,
-                          float y,
-                          float size,
-                          std::string color) const {
-  Stroke stroke;
-  stroke.id = std::move(id);
-  stroke.name = std::move(name);
-  stroke.color = std::move(color);
-  stroke.size = size;
-  stroke.points.push_back(StrokePoint{x, y});
-  return stroke;
-}
-
-Stroke* Engine::findStroke(const std::string& id) {
-  auto iterator = strokeIndex_.find(id);
-  if (iterator == strokeIndex_.end()) {
-    return nullptr;
-  }
-  const auto index = iterator->second;
-  if (index >= strokes_.size()) {
-    return nullptr;
-  }
-  return &strokes_[index];
-}
-
-void Engine::execute(emscripten::val command) {
-  const auto type = command["type"].as<std::string>();
-  if (type == "createRectangle") {
-    const auto x = static_cast<float>(command["x"].as<double>());
-    const auto y = static_cast<float>(command["y"].as<double>());
-    const auto width = static_cast<float>(command["width"].as<double>());
-    const auto height = static_cast<float>(command["height"].as<double>());
-    const auto color = command["color"].as<std::string>();
-    rectangles_.push_back(makeRectangle(x, y, width, height, color));
+void Engine::setViewport(float x, float y, float width, float height) {
+  if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(width) || !std::isfinite(height)) {
     return;
   }
+  viewport_ = Bounds{std::min(x, x + width), std::min(y, y + height), std::max(x, x + width), std::max(y, y + height)};
+}
+
+ShapeHandle Engine::strokeHandle(StringId id) const {
+  const auto slot = static_cast<std::size_t>(id);
+  return slot < strokeIndex_.size() ? strokeIndex_[slot] : kNoShape;
+}
+
+// Drops the id -> stroke binding if it still points at this row's stroke.
+void Engine::forgetStroke(std::size_t row) {
+  const auto slot = static_cast<std::size_t>(shapes_.labels.ids[row]);
+  if (shapes_.kind[row] == ShapeKind::Stroke && slot < strokeIndex_.size() &&
+      strokeIndex_[slot] == shapes_.handle(row)) {
+    strokeIndex_[slot] = kNoShape;
+  }
+}
+
+ShapeHandle Engine::createRectangle(float x, float y, float width, float height, const std::string& color) {
+  return createRectangle(x, y, width, height, strings_.intern(color));
+}
+
+ShapeHandle Engine::startStroke(const std::string& id, float x, float y, float size, const std::string& color) {
+  return startStroke(strings_.intern(id), x, y, size, strings_.intern(color));
+}
+
+// Unknown ids cannot name a live stroke, so they are looked up without being interned.
+void Engine::updateStroke(const std::string& id, float x, float y) {
+  const auto interned = strings_.find(id);
+  updateStroke(interned.has_value() ? strokeHandle(*interned) : kNoShape, x, y);
+}
+
+void Engine::finishStroke(const std::string& id) {
+  const auto interned = strings_.find(id);
+  finishStroke(interned.has_value() ? strokeHandle(*interned) : kNoShape);
+}
+
+ShapeHandle Engine::createRectangle(float x, float y, float width, float height, StringId color) {
+  ++revision_;
+  const auto index = shapes_.addRectangle(nextShapeKey_++, revision_, x, y, width, height, strings_.rgba(color));
+  shapes_.labels.ids[index] = internNumbered(strings_, "rect-", rectangleCount_);
+  shapes_.labels.names[index] = internNumbered(strings_, "Rectangle ", rectangleCount_);
+  shapes_.labels.colors[index] = color;
+  ++rectangleCount_;
+  spatial_.insert(shapes_.slot[index], shapes_.paintBounds(index));
+  tiles_.invalidate(shapes_.paintBounds(index));
+  recordChange(index, ChangeOp::Insert, 0);
+  return shapes_.handle(index);
+}
+
+ShapeHandle Engine::startStroke(StringId id, float x, float y, float size, StringId color) {
+  ++revision_;
+  const auto index = shapes_.addStroke(nextShapeKey_++, revision_, StrokePoint{x, y}, size, strings_.rgba(color));
+  shapes_.labels.ids[index] = id;
+  shapes_.labels.names[index] = internNumbered(strings_, "Trace ", strokeCount_);
+  shapes_.labels.colors[index] = color;
+  ++strokeCount_;
+  const auto handle = shapes_.handle(index);
+  const auto slot = static_cast<std::size_t>(id);
+  if (slot >= strokeIndex_.size()) {
+    strokeIndex_.resize(slot + 1, kNoShape);
+  }
+  strokeIndex_[slot] = handle;
+  spatial_.insert(handle.slot, shapes_.paintBounds(index));
+  tiles_.invalidate(shapes_.paintBounds(index));
+  recordChange(index, ChangeOp::Insert, 0);
+  return handle;
+}
+
+void Engine::updateStroke(StringId id, float x, float y) {
+  updateStroke(strokeHandle(id), x, y);
+}
 
-  if (type == "startStroke") {
-    const auto id = command["id"].as<std::string>();
-    const auto x = static_cast<float>(command["x"].as<double>());
-    const auto y = static_cast<float>(command["y"].as<double>());
-    const auto size = static_cast<float>(command["size"].as<double>());
-    const auto color = command["color"].as<std::string>();
-    const auto name = makeStrokeName(strokes_.size());
-    auto stroke = makeStroke(id, name, x, y, size, color);
-    strokeIndex_[stroke.id] = strokes_.size();
-    strokes_.push_back(std::move(stroke));
+void Engine::finishStroke(StringId id) {
+  finishStroke(strokeHandle(id));
+}
+
+// Moves against a finished or missing stroke, and samples held back, change nothing: the revision stays, so no
+// delta or repaint follows.
+void Engine::updateStroke(ShapeHandle stroke, float x, float y) {
+  const auto index = shapes_.find(stroke);
+  if (!index.has_value() || !shapes_.pointRange[*index].open) {
+    return;
+  }
+  const auto sample = StrokePoint{x, y};
+  if (simplifyTolerance_ > 0 && withinTolerance(shapes_.points(*index).back(), sample, simplifyTolerance_)) {
+    if (stroke.slot >= heldSamples_.size()) {
+      heldSamples_.resize(stroke.slot + 1, HeldSample{kNoShape, {}});
+    }
+    heldSamples_[stroke.slot] = HeldSample{stroke, sample};
     return;
   }
+  if (stroke.slot < heldSamples_.size()) {
+    heldSamples_[stroke.slot].stroke = kNoShape;
+  }
+  ++revision_;
+  appendStrokePoint(*index, stroke, sample);
+}
 
-  if (type == "updateStroke") {
-    const auto id = command["id"].as<std::string>();
-    const auto x = static_cast<float>(command["x"].as<double>());
-    const auto y = static_cast<float>(command["y"].as<double>());
-    if (auto* stroke = findStroke(id); stroke != nullptr) {
-      stroke->points.push_back(StrokePoint{x, y});
+void Engine::finishStroke(ShapeHandle stroke) {
+  if (const auto index = shapes_.find(stroke); index.has_value()) {
+    if (shapes_.pointRange[*index].open) {
+      ++revision_;
+      // The stroke ends where the pointer was released, even if that last move was within tolerance.
+      if (stroke.slot < heldSamples_.size() && heldSamples_[stroke.slot].stroke == stroke) {
+        heldSamples_[stroke.slot].stroke = kNoShape;
+        appendStrokePoint(*index, stroke, heldSamples_[stroke.slot].point);
+      }
+      settleStroke(*index, stroke);
+      shapes_.sealPoints(*index);
+      journal_.finish(*index);
     }
+    forgetStroke(*index);
+  }
+}
+
+void Engine::appendStrokePoint(std::size_t row, ShapeHandle stroke, StrokePoint point) {
+  const auto first_point = shapes_.pointRange[row].length;
+  const auto previous = shapes_.points(row).back();
+  shapes_.appendPoint(row, point);
+  shapes_.revision[row] = revision_;
+  spatial_.update(stroke.slot, shapes_.paintBounds(row));
+  // Only the new segment changes pixels, not the whole stroke.
+  tiles_.invalidate(segmentBounds(previous, point, shapes_.size[row]));
+  recordChange(row, ChangeOp::AppendPoints, first_point);
+}
+
+// Runs once per stroke, on finish: simplified and snapped to the grid it is packed on (PointArena), the points are
+// replaced wholesale, so mirrors receive an Update record and the tiles drop the coverage they had accumulated from
+// the drawn points. Snapping here rather than when sealing keeps mirrors and the journal on the stored points.
+void Engine::settleStroke(std::size_t row, ShapeHandle stroke) {
+  if (!shapes_.pointRange[row].open) {
+    return;
+  }
+  const auto points = shapes_.points(row);
+  if (simplifyTolerance_ > 0) {
+    simplifyPolyline(points, simplifyTolerance_, simplified_);
+  } else {
+    simplified_.assign(points.begin(), points.end());
+  }
+  const auto snapped = PointArena::snapToGrid(simplified_);
+  if (!snapped && simplified_.size() == shapes_.pointRange[row].length) {
+    return;
+  }
+  replaceStrokePoints(row, stroke, simplified_);
+}
+
+void Engine::replaceStrokePoints(std::size_t row, ShapeHandle stroke, std::span<const StrokePoint> points) {
+  const auto painted = shapes_.paintBounds(row);
+  shapes_.replacePoints(row, points);
+  shapes_.revision[row] = revision_;
+  spatial_.update(stroke.slot, shapes_.paintBounds(row));
+  tiles_.invalidate(painted);
+  tiles_.dropStroke(stroke.bits());
+  recordChange(row, ChangeOp::Update, 0);
+}
+
+void Engine::setSimplifyTolerance(float tolerance) {
+  simplifyTolerance_ = std::isfinite(tolerance) ? std::max(tolerance, 0.0f) : 0.0f;
+}
+
+bool Engine::removeShape(ShapeHandle shape) {
+  const auto index = shapes_.find(shape);
+  if (!index.has_value()) {
+    return false;
+  }
+  ++revision_;
+  removeRow(*index);
+  return true;
+}
+
+// A stroke still being drawn is finished as it stands first, so that the returned record keeps its points.
+ShapeRecord Engine::removeRow(std::size_t row) {
+  const auto handle = shapes_.handle(row);
+  forgetStroke(row);
+  if (handle.slot < heldSamples_.size()) {
+    heldSamples_[handle.slot].stroke = kNoShape;
+  }
+  if (shapes_.pointRange[row].open) {
+    shapes_.sealPoints(row);
+  }
+  recordChange(row, ChangeOp::Remove, 0);
+  const auto shape = shapes_.record(row);
+  spatial_.remove(handle.slot);
+  tiles_.invalidate(shapes_.paintBounds(row));
+  shapes_.remove(row);
+  return shape;
+}
+
+void Engine::restoreRow(std::size_t row, const ShapeRecord& shape) {
+  const auto index = shapes_.insert(row, shape, revision_);
+  spatial_.insert(shapes_.slot[index], shapes_.paintBounds(index));
+  tiles_.invalidate(shapes_.paintBounds(index));
+  recordChange(index, ChangeOp::Insert, 0);
+}
+
+// Puts a step's shape back (`insert`) or takes it out again, keeping what it took for the way back. Rows are
+// checked even though the history keeps them consistent.
+void Engine::applyUndoStep(UndoStep& step, bool insert) {
+  if (insert && step.row <= shapes_.count()) {
+    restoreRow(step.row, step.shape);
+  } else if (!insert && step.row < shapes_.count()) {
+    step.shape = removeRow(step.row);
+  }
+}
+
+bool Engine::undo() {
+  auto entry = history_.popUndo();
+  if (!entry.has_value()) {
+    return false;
+  }
+  ++revision_;
+  undoing_ = true;
+  for (auto step = entry->steps.rbegin(); step != entry->steps.rend(); ++step) {
+    applyUndoStep(*step, step->op == UndoStep::Op::Remove);
+  }
+  undoing_ = false;
+  history_.pushRedo(std::move(*entry));
+  return true;
+}
+
+bool Engine::redo() {
+  auto entry = history_.popRedo();
+  if (!entry.has_value()) {
+    return false;
+  }
+  ++revision_;
+  undoing_ = true;
+  for (auto& step : entry->steps) {
+    applyUndoStep(step, step.op == UndoStep::Op::Insert);
+  }
+  undoing_ = false;
+  history_.pushUndo(std::move(*entry));
+  return true;
+}
+
+bool Engine::canUndo() const {
+  return history_.canUndo();
+}
+
+bool Engine::canRedo() const {
+  return history_.canRedo();
+}
+
+void Engine::beginUndoGroup() {
+  history_.beginGroup();
+}
+
+void Engine::endUndoGroup() {
+  history_.endGroup();
+}
+
+void Engine::setHistoryLimit(std::size_t bytes) {
+  history_.setLimit(bytes);
+}
+
+std::size_t Engine::historyBytes() const {
+  return history_.bytes();
+}
+
+// Turns the slots collected in queryRows_ into rows, back to front.
+std::span<const std::uint32_t> Engine::rowsInZOrder() {
+  for (auto& row : queryRows_) {
+    row = shapes_.slotRow[row];
+  }
+  std::sort(queryRows_.begin(), queryRows_.end());
+  return queryRows_;
+}
+
+std::span<const std::uint32_t> Engine::queryRect(float min_x, float min_y, float max_x, float max_y) {
+  queryRows_.clear();
+  spatial_.query(
+      Bounds{std::min(min_x, max_x), std::min(min_y, max_y), std::max(min_x, max_x), std::max(min_y, max_y)},
+      queryRows_);
+  return rowsInZOrder();
+}
+
+std::span<const std::uint32_t> Engine::queryPoint(float x, float y) {
+  queryRows_.clear();
+  spatial_.query(Bounds{x, y, x, y}, queryRows_);
+  return rowsInZOrder();
+}
+
+std::span<const std::uint32_t> Engine::queryRadius(float x, float y, float radius) {
+  radius = std::abs(radius);
+  queryRows_.clear();
+  spatial_.query(Bounds{x - radius, y - radius, x + radius, y + radius}, queryRows_);
+  // The grid returns the enclosing square; keep boxes whose nearest point lies within the circle.
+  std::erase_if(queryRows_, [&](std::uint32_t slot) {
+    const auto& box = spatial_.bounds(slot);
+    const auto dx = std::max({box.minX - x, 0.0f, x - box.maxX});
+    const auto dy = std::max({box.minY - y, 0.0f, y - box.maxY});
+    return dx * dx + dy * dy > radius * radius;
+  });
+  return rowsInZOrder();
+}
+
+std::optional<CommandOp> parseCommandOp(std::string_view name) {
+  static const std::unordered_map<std::string_view, CommandOp> ops = {
+      {"createRectangle", CommandOp::CreateRectangle},
+      {"startStroke", CommandOp::StartStroke},
+      {"updateStroke", CommandOp::UpdateStroke},
+      {"finishStroke", CommandOp::FinishStroke},
+  };
+  const auto iterator = ops.find(name);
+  if (iterator == ops.end()) {
+    return std::nullopt;
+  }
+  return iterator->second;
+}
+
+std::uint32_t Engine::internString(const std::string& value) {
+  const auto id = strings_.intern(value);
+  auto iterator = commandStringIndex_.find(id);
+  if (iterator != commandStringIndex_.end()) {
+    return iterator->second;
+  }
+  const auto index = static_cast<std::uint32_t>(commandStrings_.size());
+  commandStrings_.push_back(id);
+  commandStringIndex_.emplace(id, index);
+  return index;
+}
+
+std::optional<StringId> Engine::commandString(std::uint32_t index) const {
+  if (index >= commandStrings_.size() || commandStrings_[index] == kNoStringId) {
+    return std::nullopt;
+  }
+  return commandStrings_[index];
+}
+
+// Lets producers that cannot call internString() synchronously (the UI thread's shared ring) name their own strings.
+void Engine::defineString(std::uint32_t index, std::string value) {
+  if (index >= commandStrings_.size()) {
+    commandStrings_.resize(static_cast<std::size_t>(index) + 1, kNoStringId);
+  } else if (auto previous = commandStringIndex_.find(commandStrings_[index]);
+             previous != commandStringIndex_.end() && previous->second == index) {
+    commandStringIndex_.erase(previous);
+  }
+  const auto id = strings_.intern(value);
+  commandStringIndex_[id] = index;
+  commandStrings_[index] = id;
+}
+
+std::span<std::uint8_t> Engine::commandBuffer(std::uint32_t byte_length) {
+  commands_.resize((byte_length + 3) & ~std::uint32_t{3});
+  return commands_;
+}
+
+// Typed handlers for executeBatch() records, indexed by CommandOp. Each reads its fixed fields once from the
+// record; a handler whose string indices are unknown drops the command.
+struct CommandDispatch {
+  using Handler = void (*)(Engine&, const std::uint8_t*);
+
+  struct Entry {
+    Handler handler;
+    std::size_t words;
+  };
+
+  static void createRectangle(Engine& engine, const std::uint8_t* record) {
+    if (const auto color = engine.commandString(readAt<std::uint32_t>(record, 20)); color.has_value()) {
+      engine.createRectangle(readAt<float>(record, 4),
+                             readAt<float>(record, 8),
+                             readAt<float>(record, 12),
+                             readAt<float>(record, 16),
+                             *color);
+    }
+  }
+
+  static void startStroke(Engine& engine, const std::uint8_t* record) {
+    const auto id = engine.commandString(readAt<std::uint32_t>(record, 4));
+    const auto color = engine.commandString(readAt<std::uint32_t>(record, 20));
+    if (id.has_value() && color.has_value()) {
+      const auto handle =
+          engine.startStroke(*id, readAt<float>(record, 8), readAt<float>(record, 12), readAt<float>(record, 16), *color);
+      engine.startedStrokes_.insert(engine.startedStrokes_.end(),
+                                    {readAt<std::uint32_t>(record, 4), handle.slot, handle.generation});
+    }
+  }
+
+  static void updateStroke(Engine& engine, const std::uint8_t* record) {
+    if (const auto id = engine.commandString(readAt<std::uint32_t>(record, 4)); id.has_value()) {
+      engine.updateStroke(*id, readAt<float>(record, 8), readAt<float>(record, 12));
+    }
+  }
+
+  static void finishStroke(Engine& engine, const std::uint8_t* record) {
+    if (const auto id = engine.commandString(readAt<std::uint32_t>(record, 4)); id.has_value()) {
+      engine.finishStroke(*id);
+    }
+  }
+
+  static ShapeHandle handleAt(const std::uint8_t* record, std::size_t offset) {
+    return ShapeHandle{readAt<std::uint32_t>(record, offset), readAt<std::uint32_t>(record, offset + 4)};
+  }
+
+  static void updateStrokeHandle(Engine& engine, const std::uint8_t* record) {
+    engine.updateStroke(handleAt(record, 4), readAt<float>(record, 12), readAt<float>(record, 16));
+  }
+
+  static void finishStrokeHandle(Engine& engine, const std::uint8_t* record) {
+    engine.finishStroke(handleAt(record, 4));
+  }
+
+  static void removeShape(Engine& engine, const std::uint8_t* record) {
+    engine.removeShape(handleAt(record, 4));
+  }
+
+  static void pointerMove(Engine& engine, const std::uint8_t* record) {
+    engine.pointerMove(readAt<std::int32_t>(record, 4), readAt<float>(record, 8), readAt<float>(record, 12));
+  }
+
+  // Variable length: the record size bounds the UTF-8 payload and is checked by the caller.
+  static void defineString(Engine& engine, const std::uint8_t* record) {
+    const auto record_bytes = static_cast<std::size_t>(readAt<std::uint32_t>(record, 0) >> 16) * 4;
+    const auto length = static_cast<std::size_t>(readAt<std::uint32_t>(record, 8));
+    if (12 + length <= record_bytes) {
+      engine.defineString(readAt<std::uint32_t>(record, 4), std::string(reinterpret_cast<const char*>(record + 12), length));
+    }
+  }
+
+  // Minimum record words, header included.
+  static constexpr std::array<Entry, kCommandOpCount> table = {{
+      {nullptr, 0},
+      {&createRectangle, 6},
+      {&startStroke, 6},
+      {&updateStroke, 4},
+      {&finishStroke, 2},
+      {&pointerMove, 4},
+      {&defineString, 3},
+      {&updateStrokeHandle, 5},
+      {&finishStrokeHandle, 3},
+      {&removeShape, 3},
+  }};
+};
+
+void Engine::executeBatch(std::uint32_t byte_length) {
+  startedStrokes_.clear();
+  const auto end = std::min<std::size_t>(byte_length, commands_.size()) & ~static_cast<std::size_t>(3);
+  const auto* buffer = commands_.data();
+  std::size_t offset = 0;
+  while (offset + 4 <= end) {
+    const auto header = readAt<std::uint32_t>(buffer, offset);
+    const auto op = static_cast<std::size_t>(header & 0xFFFF);
+    const auto words = static_cast<std::size_t>(header >> 16);
+    if (words == 0 || offset + words * 4 > end) {
+      break;
+    }
+
+    // Unknown opcodes and truncated records are skipped using the length in their header.
+    if (op < CommandDispatch::table.size()) {
+      const auto& entry = CommandDispatch::table[op];
+      if (entry.handler != nullptr && words >= entry.words) {
+        entry.handler(*this, buffer + offset);
+      }
+    }
+    offset += words * 4;
+  }
+}
+
+std::uint32_t Engine::revision() const {
+  return revision_;
+}
+
+void Engine::recordChange(std::size_t row, ChangeOp op, std::uint32_t first_point) {
+  shapesRevision_ = revision_;
+  // Undo and redo make a whole entry's changes under one revision, so those dropped may belong to this one too:
+  // only mirrors already at it can still be caught up.
+  if (changes_.size() >= kMaxPendingChanges) {
+    changes_.clear();
+    changesBase_ = revision_;
+  }
+  changes_.push_back(
+      ShapeChange{revision_, op, shapes_.kind[row], shapes_.key[row], first_point, shapes_.handle(row)});
+  if (replaying_) {
     return;
   }
+  switch (op) {
+    case ChangeOp::Insert:
+      if (undoing_) {
+        journal_.restore(shapes_, strings_, row);
+      } else {
+        journal_.insert(shapes_, strings_, row);
+      }
+      break;
+    case ChangeOp::Update:
+      journal_.replacePoints(row, shapes_.points(row));
+      break;
+    case ChangeOp::AppendPoints:
+      journal_.appendPoints(row, shapes_.points(row).subspan(first_point));
+      break;
+    case ChangeOp::Remove:
+      journal_.remove(row);
+      break;
+  }
+  if (undoing_) {
+    return;
+  }
+  if (op == ChangeOp::Insert) {
+    history_.record(UndoStep{UndoStep::Op::Insert, static_cast<std::uint32_t>(row), ShapeRecord{}});
+  } else if (op == ChangeOp::Remove) {
+    history_.record(UndoStep{UndoStep::Op::Remove, static_cast<std::uint32_t>(row), shapes_.record(row)});
+  }
+}
+
+void Engine::collectChanges(std::uint32_t base) {
+  pending_.clear();
+  pendingIndex_.clear();
 
-  if (type == "finishStroke") {
-    const auto id = command["id"].as<std::string>();
-    strokeIndex_.erase(id);
+  const auto first = std::partition_point(
+      changes_.begin(), changes_.end(), [base](const ShapeChange& change) { return change.revision <= base; });
+  changes_.erase(changes_.begin(), first);
+  changesBase_ = base;
+
+  for (const auto& change : changes_) {
+    auto iterator = pendingIndex_.find(change.handle.bits());
+    if (iterator == pendingIndex_.end()) {
+      // Every mutation precedes this tick, so the current row is the one to serialize; a shape that no longer
+      // resolves has a Remove later in the journal.
+      const auto row = static_cast<std::uint32_t>(shapes_.find(change.handle).value_or(0));
+      pendingIndex_.emplace(change.handle.bits(), pending_.size());
+      pending_.push_back(PendingChange{change.op, change.kind, change.key, row, change.firstPoint});
+      continue;
+    }
+
+    auto& pending = pending_[iterator->second];
+    if (change.op == ChangeOp::Remove) {
+      pending.op = ChangeOp::Remove;
+    } else if (change.op == ChangeOp::Update && pending.op == ChangeOp::AppendPoints) {
+      pending.op = ChangeOp::Update;
+    }
   }
 }
 
 void Engine::updatePresence(int pointer_id, float x, float y) {
   auto iterator = presences_.find(pointer_id);
   if (iterator == presences_.end()) {
-    presences_.emplace(pointer_id, Presence{std::to_string(pointer_id), colorForPointer(pointer_id), x, y});
-  } else {
+    ++revision_;
+    const auto color = strings_.intern(colorForPointer(pointer_id));
+    presences_.emplace(pointer_id,
+                       Presence{strings_.intern(std::to_string(pointer_id)), color, strings_.rgba(color), x, y});
+  } else if (iterator->second.x != x || iterator->second.y != y) {
+    ++revision_;
     iterator->second.x = x;
     iterator->second.y = y;
   }
 }
 
-void Engine::pointerEvent(emscripten::val event) {
-  const auto type = event["type"].as<std::string>();
-  if (type != "pointerMove") {
-    return;
+void Engine::pointerMove(int pointer_id, float x, float y) {
+  updatePresence(pointer_id, x, y);
+}
+
+void Engine::writeSnapshot() {
+  // Points are written stroke by stroke in z order; packed strokes are decoded on the way without filling the
+  // arena's decode cache with the whole document.
+  const auto shape_count = shapes_.count();
+  std::size_t point_count = 0;
+  std::size_t string_bytes = 0;
+  for (std::size_t index = 0; index < shape_count; ++index) {
+    point_count += shapes_.pointRange[index].length;
+    string_bytes += labelBytes(strings_, shapes_, index);
   }
 
-  const auto pointer_id = event["pointerId"].as<int>();
-  const auto x = static_cast<float>(event["x"].as<double>());
-  const auto y = static_cast<float>(event["y"].as<double>());
-  updatePresence(pointer_id, x, y);
+  const auto shapes_offset = kSnapshotHeaderBytes;
+  const auto presences_offset = shapes_offset + shape_count * kSnapshotShapeBytes;
+  const auto points_offset = presences_offset + presences_.size() * kSnapshotPresenceBytes;
+  const auto strings_offset = points_offset + point_count * kSnapshotPointBytes;
+  snapshot_.resize(strings_offset + string_bytes);
+  auto* buffer = snapshot_.data();
+
+  writeSnapshotHeader(buffer, revision_, shape_count, presences_.size(), point_count, string_bytes);
+
+  // Shapes are written in z order, so a consumer paints them back to front as they appear.
+  const auto& labels = shapes_.labels;
+  auto shape_offset = shapes_offset;
+  std::size_t string_cursor = 0;
+  std::size_t point_cursor = 0;
+  for (std::size_t index = 0; index < shape_count; ++index) {
+    const auto id_ref = writeString(buffer, strings_offset, string_cursor, strings_.get(labels.ids[index]));
+    const auto name_ref = writeString(buffer, strings_offset, string_cursor, strings_.get(labels.names[index]));
+    if (shapes_.kind[index] == ShapeKind::Rectangle) {
+      writeRectangleBody(buffer, shape_offset, shapes_, index, id_ref, name_ref);
+    } else {
+      const auto points = shapes_.points(index, pointScratch_);
+      writeStrokeBody(buffer, shape_offset, shapes_, index, id_ref, name_ref, point_cursor, points.size(), 0);
+      copyPoints(buffer, points_offset, point_cursor, points);
+      point_cursor += points.size();
+    }
+    shape_offset += kSnapshotShapeBytes;
+  }
+
+  auto presence_offset = presences_offset;
+  for (const auto& [pointer_id, presence] : presences_) {
+    writePresenceRecord(buffer, presence_offset, pointer_id, presence);
+    presence_offset += kSnapshotPresenceBytes;
+  }
+}
+
+void Engine::writeVisibleSnapshot(std::span<const std::uint32_t> rows) {
+  // Only the listed strokes' points are copied, packed in row order; the slab is not copied wholesale.
+  std::size_t point_count = 0;
+  std::size_t string_bytes = 0;
+  for (const auto row : rows) {
+    point_count += shapes_.pointRange[row].length;
+    string_bytes += labelBytes(strings_, shapes_, row);
+  }
+
+  const auto shapes_offset = kSnapshotHeaderBytes;
+  const auto presences_offset = shapes_offset + rows.size() * kSnapshotShapeBytes;
+  const auto points_offset = presences_offset + presences_.size() * kSnapshotPresenceBytes;
+  const auto strings_offset = points_offset + point_count * kSnapshotPointBytes;
+  visibleSnapshot_.resize(strings_offset + string_bytes);
+  auto* buffer = visibleSnapshot_.data();
+  writeSnapshotHeader(buffer, revision_, rows.size(), presences_.size(), point_count, string_bytes);
+
+  const auto& labels = shapes_.labels;
+  auto shape_offset = shapes_offset;
+  std::size_t string_cursor = 0;
+  std::size_t point_cursor = 0;
+  for (const auto index : rows) {
+    const auto id_ref = writeString(buffer, strings_offset, string_cursor, strings_.get(labels.ids[index]));
+    const auto name_ref = writeString(buffer, strings_offset, string_cursor, strings_.get(labels.names[index]));
+    if (shapes_.kind[index] == ShapeKind::Rectangle) {
+      writeRectangleBody(buffer, shape_offset, shapes_, index, id_ref, name_ref);
+    } else {
+      const auto points = shapes_.points(index);
+      writeStrokeBody(buffer, shape_offset, shapes_, index, id_ref, name_ref, point_cursor, points.size(), 0);
+      copyPoints(buffer, points_offset, point_cursor, points);
+      point_cursor += points.size();
+    }
+    shape_offset += kSnapshotShapeBytes;
+  }
+
+  auto presence_offset = presences_offset;
+  for (const auto& [pointer_id, presence] : presences_) {
+    writePresenceRecord(buffer, presence_offset, pointer_id, presence);
+    presence_offset += kSnapshotPresenceBytes;
+  }
+}
+
+void Engine::writeDelta(std::uint32_t base) {
+  const bool full_resync = base > revision_ || base < changesBase_;
+  if (full_resync) {
+    pending_.clear();
+    for (std::size_t index = 0; index < shapes_.count(); ++index) {
+      pending_.push_back(
+          PendingChange{ChangeOp::Insert, shapes_.kind[index], shapes_.key[index], static_cast<std::uint32_t>(index), 0});
+    }
+    changes_.clear();
+    changesBase_ = revision_;
+  } else {
+    collectChanges(base);
+  }
+
+  std::size_t point_count = 0;
+  std::size_t string_bytes = 0;
+  for (const auto& pending : pending_) {
+    if (pending.op == ChangeOp::Remove) {
+      continue;
+    }
+    const auto point_total = shapes_.pointRange[pending.row].length;
+    if (pending.op == ChangeOp::AppendPoints) {
+      point_count += point_total - pending.firstPoint;
+    } else {
+      point_count += point_total;
+      string_bytes += labelBytes(strings_, shapes_, pending.row);
+    }
+  }
+
+  const auto records_offset = kDeltaHeaderBytes;
+  const auto presences_offset = records_offset + pending_.size() * kDeltaRecordBytes;
+  const auto points_offset = presences_offset + presences_.size() * kSnapshotPresenceBytes;
+  const auto strings_offset = points_offset + point_count * kSnapshotPointBytes;
+  delta_.assign(strings_offset + string_bytes, 0);
+  auto* buffer = delta_.data();
+
+  writeAt(buffer, 0, kDeltaMagic);
+  writeAt(buffer, 4, kDeltaVersion);
+  writeAt(buffer, 6, static_cast<std::uint16_t>(kDeltaHeaderBytes));
+  writeAt(buffer, 8, full_resync ? kDeltaFlagFullResync : std::uint32_t{0});
+  writeAt(buffer, 12, full_resync ? std::uint32_t{0} : base);
+  writeAt(buffer, 16, revision_);
+  writeAt(buffer, 20, static_cast<std::uint32_t>(pending_.size()));
+  writeAt(buffer, 24, static_cast<std::uint32_t>(presences_.size()));
+  writeAt(buffer, 28, static_cast<std::uint32_t>(point_count));
+  writeAt(buffer, 32, static_cast<std::uint32_t>(string_bytes));
+
+  const auto& labels = shapes_.labels;
+  auto record_offset = records_offset;
+  std::size_t string_cursor = 0;
+  std::size_t point_cursor = 0;
+  for (const auto& pending : pending_) {
+    const auto index = pending.row;
+    const auto body_offset = record_offset + 8;
+    writeAt(buffer, record_offset, static_cast<std::uint32_t>(pending.op));
+    writeAt(buffer, record_offset + 4, pending.key);
+    if (pending.op == ChangeOp::Remove) {
+      writeAt(buffer, body_offset, static_cast<std::uint32_t>(pending.kind));
+    } else if (pending.op == ChangeOp::AppendPoints) {
+      const auto appended = shapes_.points(index, pointScratch_).subspan(pending.firstPoint);
+      writeStrokeBody(buffer, body_offset, shapes_, index, 0, 0, point_cursor, appended.size(), pending.firstPoint);
+      copyPoints(buffer, points_offset, point_cursor, appended);
+      point_cursor += appended.size();
+    } else {
+      const auto id_ref = writeString(buffer, strings_offset, string_cursor, strings_.get(labels.ids[index]));
+      const auto name_ref = writeString(buffer, strings_offset, string_cursor, strings_.get(labels.names[index]));
+      if (shapes_.kind[index] == ShapeKind::Rectangle) {
+        writeRectangleBody(buffer, body_offset, shapes_, index, id_ref, name_ref);
+      } else {
+        const auto points = shapes_.points(index, pointScratch_);
+        writeStrokeBody(buffer, body_offset, shapes_, index, id_ref, name_ref, point_cursor, points.size(), 0);
+        copyPoints(buffer, points_offset, point_cursor, points);
+        point_cursor += points.size();
+      }
+    }
+    record_offset += kDeltaRecordBytes;
+  }
+
+  auto presence_offset = presences_offset;
+  for (const auto& [pointer_id, presence] : presences_) {
+    writePresenceRecord(buffer, presence_offset, pointer_id, presence);
+    presence_offset += kSnapshotPresenceBytes;
+  }
+}
+
+std::span<const std::uint8_t> Engine::tickSince(std::uint32_t revision) {
+  writeDelta(revision);
+  return delta_;
+}
+
+std::span<const std::uint8_t> Engine::tickBinary() {
+  writeSnapshot();
+  return snapshot_;
+}
+
+RenderedFrame Engine::render(float scale) {
+  if (!(scale > 0) || !std::isfinite(scale)) {
+    scale = 1;
+  }
+  const auto left = std::clamp(std::floor(viewport_.minX * scale), -kMaxPixelCoordinate, kMaxPixelCoordinate);
+  const auto top = std::clamp(std::floor(viewport_.minY * scale), -kMaxPixelCoordinate, kMaxPixelCoordinate);
+  const auto right = std::clamp(std::ceil(viewport_.maxX * scale), left, left + static_cast<float>(kMaxFrameSide));
+  const auto bottom = std::clamp(std::ceil(viewport_.maxY * scale), top, top + static_cast<float>(kMaxFrameSide));
+  const auto frame_left = static_cast<int>(left);
+  const auto frame_top = static_cast<int>(top);
+  const auto width = static_cast<int>(right - left);
+  const auto height = static_cast<int>(bottom - top);
+
+  tiles_.setScale(scale);
+  tiles_.beginFrame();
+  shapes_.pointArena.beginFrame();
+  // A moved or resized frame is reassembled from the cache in full; otherwise only redrawn tiles are copied in.
+  const auto moved =
+      frame_left != frameLeft_ || frame_top != frameTop_ || width != frame_.width() || height != frame_.height();
+  if (moved) {
+    frame_.resize(width, height);
+    frameLeft_ = frame_left;
+    frameTop_ = frame_top;
+  }
+
+  // The engine thread resolves every dirty tile's shapes up front and blocks while the tiles are rasterized, so the
+  // scene is frozen for the parallel section: workers only read it and each writes its own tiles.
+  frameTiles_.clear();
+  dirtyTiles_.clear();
+  tileRows_.clear();
+  if (width > 0 && height > 0) {
+    const auto first_column = floorDiv(frame_left, TileCache::kTileSize);
+    const auto first_row = floorDiv(frame_top, TileCache::kTileSize);
+    const auto last_column = floorDiv(frame_left + width - 1, TileCache::kTileSize);
+    const auto last_row = floorDiv(frame_top + height - 1, TileCache::kTileSize);
+    for (auto row = first_row; row <= last_row; ++row) {
+      for (auto column = first_column; column <= last_column; ++column) {
+        auto& tile = tiles_.tile(column, row);
+        FrameTile entry{&tile, column, row, tile.dirty, tileRows_.size(), 0};
+        if (tile.dirty) {
+          const auto rows = tileShapes(column, row);
+          tileRows_.insert(tileRows_.end(), rows.begin(), rows.end());
+          entry.rowCount = rows.size();
+          dirtyTiles_.push_back(frameTiles_.size());
+        }
+        frameTiles_.push_back(entry);
+      }
+    }
+  }
+
+  // Packed strokes are decoded here, so that workers find them in the arena's cache and only ever read it.
+  for (const auto row : tileRows_) {
+    if (shapes_.pointRange[row].packed) {
+      shapes_.points(row);
+    }
+  }
+
+  renderPool().run(dirtyTiles_.size(), [this](std::size_t job, std::size_t participant) {
+    const auto& entry = frameTiles_[dirtyTiles_[job]];
+    rasterizeTile(*entry.tile,
+                  entry.column,
+                  entry.row,
+                  std::span<const std::uint32_t>(tileRows_).subspan(entry.firstRow, entry.rowCount),
+                  rasterizers_[participant]);
+  });
+  shapes_.pointArena.endFrame();
+
+  auto dirty_left = width;
+  auto dirty_top = height;
+  auto dirty_right = 0;
+  auto dirty_bottom = 0;
+  for (const auto& entry : frameTiles_) {
+    if (!entry.redrawn && !moved) {
+      continue;
+    }
+
+    // Part of the tile inside the frame, in frame pixels.
+    const auto tile_left = entry.column * TileCache::kTileSize - frame_left;
+    const auto tile_top = entry.row * TileCache::kTileSize - frame_top;
+    const auto x0 = std::max(tile_left, 0);
+    const auto y0 = std::max(tile_top, 0);
+    const auto x1 = std::min(tile_left + TileCache::kTileSize, width);
+    const auto y1 = std::min(tile_top + TileCache::kTileSize, height);
+    for (auto y = y0; y < y1; ++y) {
+      std::memcpy(frame_.row(y) + x0,
+                  entry.tile->pixels.row(y - tile_top) + (x0 - tile_left),
+                  static_cast<std::size_t>(x1 - x0) * sizeof(std::uint32_t));
+    }
+    dirty_left = std::min(dirty_left, x0);
+    dirty_top = std::min(dirty_top, y0);
+    dirty_right = std::max(dirty_right, x1);
+    dirty_bottom = std::max(dirty_bottom, y1);
+  }
+  tiles_.evict();
+
+  if (dirty_left >= dirty_right || dirty_top >= dirty_bottom) {
+    dirty_left = dirty_top = dirty_right = dirty_bottom = 0;
+  }
+  return RenderedFrame{frame_.bytes(),
+                       frame_left,
+                       frame_top,
+                       width,
+                       height,
+                       dirty_left,
+                       dirty_top,
+                       dirty_right - dirty_left,
+                       dirty_bottom - dirty_top,
+                       static_cast<int>(dirtyTiles_.size())};
+}
+
+void Engine::setRenderThreads(std::size_t threads) {
+  renderThreads_ = threads;
+  pool_.reset();
+}
+
+WorkStealingPool& Engine::renderPool() {
+  if (!pool_) {
+    pool_ = std::make_unique<WorkStealingPool>(renderThreads_);
+    rasterizers_.resize(pool_->size());
+  }
+  return *pool_;
+}
+
+// Shapes to draw into a tile, back to front. Anti-aliasing reaches half a pixel past a shape's painted box.
+std::span<const std::uint32_t> Engine::tileShapes(std::int32_t column, std::int32_t row) {
+  const auto scale = tiles_.scale();
+  const auto extent = static_cast<float>(TileCache::kTileSize) / scale;
+  const auto origin_x = static_cast<float>(column) * extent;
+  const auto origin_y = static_cast<float>(row) * extent;
+  const auto margin = 1 / scale;
+  queryRows_.clear();
+  spatial_.query(Bounds{origin_x - margin, origin_y - margin, origin_x + extent + margin, origin_y + extent + margin},
+                 queryRows_);
+  return rowsInZOrder();
+}
+
+void Engine::rasterizeTile(TileCache::Tile& tile,
+                           std::int32_t column,
+                           std::int32_t row,
+                           std::span<const std::uint32_t> rows,
+                           Rasterizer& rasterizer) const {
+  const auto scale = tiles_.scale();
+  const auto extent = static_cast<float>(TileCache::kTileSize) / scale;
+  tile.pixels.resize(TileCache::kTileSize, TileCache::kTileSize);
+  tile.pixels.clear(kRenderBackground);
+  rasterizer.setTransform(static_cast<float>(column) * extent, static_cast<float>(row) * extent, scale);
+  for (auto& [key, stroke] : tile.strokes) {
+    stroke.drawn = false;
+  }
+  for (const auto index : rows) {
+    if (shapes_.kind[index] == ShapeKind::Rectangle) {
+      rasterizer.fillRect(tile.pixels,
+                          shapes_.x[index],
+                          shapes_.y[index],
+                          shapes_.width[index],
+                          shapes_.height[index],
+                          shapes_.rgba[index]);
+      continue;
+    }
+
+    // Long strokes keep their coverage in the tile: a redraw only adds the segments appended since, then composites,
+    // so its cost no longer depends on the point count. Strokes only ever change by appending points.
+    const auto points = shapes_.points(index);
+    auto cached = tile.strokes.find(shapes_.handle(index).bits());
+    if (cached == tile.strokes.end()) {
+      if (points.size() < kCachedStrokePoints || tile.strokeBytes >= TileCache::kMaxStrokeBytes) {
+        rasterizer.strokePolyline(tile.pixels, points, shapes_.size[index], shapes_.rgba[index]);
+        continue;
+      }
+      cached = tile.strokes.emplace(shapes_.handle(index).bits(), TileCache::CachedStroke{}).first;
+    }
+    auto& mask = cached->second.mask;
+    const auto bytes_before = mask.bytes();
+    rasterizer.accumulateStroke(mask, tile.pixels, points, shapes_.size[index]);
+    tile.strokeBytes += mask.bytes() - bytes_before;
+    rasterizer.compositeMask(tile.pixels, mask, shapes_.rgba[index]);
+    cached->second.drawn = true;
+  }
+  // Strokes that left the tile (removed, or no longer reaching it) release their coverage.
+  std::erase_if(tile.strokes, [&tile](const auto& entry) {
+    if (entry.second.drawn) {
+      return false;
+    }
+    tile.strokeBytes -= entry.second.mask.bytes();
+    return true;
+  });
+  tile.dirty = false;
+}
+
+void Engine::beginSave() {
+  documentWriter_.begin(shapes_,
+                        strings_,
+                        DocumentCounters{static_cast<std::uint32_t>(rectangleCount_),
+                                         static_cast<std::uint32_t>(strokeCount_)});
+  archiveWriter_.abort();
+  savingArchive_ = false;
+  compacting_ = false;
+  compacted_ = false;
+  saveRevision_ = shapesRevision_;
+}
+
+void Engine::beginArchiveSave() {
+  archiveWriter_.begin(shapes_,
+                       strings_,
+                       DocumentCounters{static_cast<std::uint32_t>(rectangleCount_),
+                                        static_cast<std::uint32_t>(strokeCount_)});
+  documentWriter_.abort();
+  savingArchive_ = true;
+  compacting_ = false;
+  compacted_ = false;
+  saveRevision_ = shapesRevision_;
+}
+
+std::span<const std::uint8_t> Engine::saveChunk() {
+  if (shapesRevision_ != saveRevision_) {
+    documentWriter_.abort();
+    archiveWriter_.abort();
+    compacting_ = false;
+  }
+  if (savingArchive_) {
+    return archiveWriter_.next();
+  }
+  const auto chunk = documentWriter_.next();
+  if (compacting_ && documentWriter_.done()) {
+    // The snapshot holds everything logged so far; what the caller has not taken yet is dropped with the rest.
+    compacting_ = false;
+    compacted_ = true;
+    journal_.restart(JournalBase{documentWriter_.checksum(), static_cast<std::uint32_t>(shapes_.count())});
+    for (std::size_t row = 0; row < shapes_.count(); ++row) {
+      if (shapes_.pointRange[row].open) {
+        journal_.reopen(row);
+      }
+    }
+  }
+  return chunk;
+}
+
+void Engine::beginLoad() {
+  documentReader_.begin(strings_);
+}
+
+bool Engine::loadChunk(std::span<const std::uint8_t> bytes) {
+  return documentReader_.feed(bytes);
+}
+
+std::span<std::uint8_t> Engine::loadBuffer(std::uint32_t byte_length) {
+  loadBuffer_.resize(byte_length);
+  return loadBuffer_;
+}
+
+bool Engine::loadChunk(std::uint32_t byte_length) {
+  const auto length = std::min<std::size_t>(byte_length, loadBuffer_.size());
+  return loadChunk(std::span<const std::uint8_t>(loadBuffer_).first(length));
+}
+
+bool Engine::finishLoad() {
+  loadBuffer_ = {};
+  if (!documentReader_.complete()) {
+    documentReader_.reset();
+    return false;
+  }
+  const auto counters = documentReader_.counters();
+  auto shapes = documentReader_.takeShapes();
+  const JournalBase base{documentReader_.checksum(), static_cast<std::uint32_t>(shapes.count())};
+  adoptDocument(std::move(shapes), counters, base);
+  documentReader_.reset();
+  return true;
+}
+
+bool Engine::openArchive(std::span<const std::uint8_t> bytes, std::shared_ptr<const void> owner) {
+  const auto archive = ArchiveView::open(bytes);
+  if (!archive) {
+    return false;
+  }
+  // Records are checked here rather than in ArchiveView, as they are read; points are used as they are. Strings are
+  // interned only once every record passed, so that a rejected archive leaves none behind in the engine's table.
+  const auto string_count = archive->stringCount();
+  const auto points = archive->points();
+  ShapeStore shapes;
+  shapes.pointArena.mapSealed(points);
+  for (std::size_t row = 0; row < archive->shapeCount(); ++row) {
+    const auto shape = archive->shape(row);
+    if (shape.id >= string_count || shape.name >= string_count || shape.color >= string_count) {
+      return false;
+    }
+    const auto key = static_cast<std::uint32_t>(row + 1);
+    if (shape.kind == ShapeKind::Rectangle) {
+      shapes.addRectangle(key, 0, shape.x, shape.y, shape.width, shape.height, shape.rgba);
+    } else if (shape.kind == ShapeKind::Stroke && shape.pointCount > 0 && shape.pointOffset <= points.size() &&
+               shape.pointCount <= points.size() - shape.pointOffset) {
+      const PointRange sealed{static_cast<std::uint32_t>(shape.pointOffset), shape.pointCount, false, false};
+      shapes.addSealedStroke(key, 0, sealed, shape.x, shape.y, shape.width, shape.height, shape.size, shape.rgba);
+    } else {
+      return false;
+    }
+  }
+  std::vector<StringId> archive_strings(string_count, kNoStringId);
+  const auto intern = [&](std::uint32_t index) {
+    if (archive_strings[index] == kNoStringId) {
+      archive_strings[index] = strings_.intern(archive->string(index));
+    }
+    return archive_strings[index];
+  };
+  // The store was filled in archive order, so rows line up with the archive's.
+  for (std::size_t row = 0; row < shapes.count(); ++row) {
+    const auto shape = archive->shape(row);
+    shapes.labels.ids[row] = intern(shape.id);
+    shapes.labels.names[row] = intern(shape.name);
+    shapes.labels.colors[row] = intern(shape.color);
+  }
+  const JournalBase base{archive->checksum(), static_cast<std::uint32_t>(shapes.count())};
+  adoptDocument(std::move(shapes), archive->counters(), base);
+  archive_ = std::move(owner);
+  return true;
+}
+
+std::span<std::uint8_t> Engine::archiveBuffer(std::uint32_t byte_length) {
+  // A fresh buffer each time: the previous one may still back the open document.
+  archiveBuffer_ = std::make_shared<std::vector<std::uint8_t>>(byte_length);
+  return *archiveBuffer_;
+}
+
+bool Engine::openArchive(std::uint32_t byte_length) {
+  if (!archiveBuffer_) {
+    return false;
+  }
+  auto buffer = std::move(archiveBuffer_);
+  const auto length = std::min<std::size_t>(byte_length, buffer->size());
+  const std::span<const std::uint8_t> bytes(buffer->data(), length);
+  return openArchive(bytes, std::move(buffer));
+}
+
+void Engine::adoptDocument(ShapeStore&& shapes, DocumentCounters counters, JournalBase base) {
+  // Everything keyed by handle or row belongs to the old document: open strokes, held samples, the spatial index,
+  // cached tiles and the change journal start over, and mirrors get a full resync.
+  ++revision_;
+  // Handles into the old document must not resolve to the new shapes that reuse their slots: every old slot moves on
+  // a generation. The new store is padded to the old slot count, the slots it does not use yet being free, so that
+  // they too are reused at the bumped generation rather than from 0.
+  const auto new_slots = shapes.slotGeneration.size();
+  for (std::size_t slot = 0; slot < shapes_.slotGeneration.size(); ++slot) {
+    const auto generation = shapes_.slotGeneration[slot] + 1;
+    if (slot < new_slots) {
+      shapes.slotGeneration[slot] = std::max(shapes.slotGeneration[slot], generation);
+    } else {
+      shapes.slotRow.push_back(0);
+      shapes.slotGeneration.push_back(generation);
+    }
+  }
+  // Lowest first off the back of the free list, as a fresh store would hand them out.
+  for (auto slot = shapes.slotGeneration.size(); slot > new_slots; --slot) {
+    shapes.freeSlots.push_back(static_cast<std::uint32_t>(slot - 1));
+  }
+  shapes_ = std::move(shapes);
+  // The old document's points are gone with its store, so an archive it was opened from can go too.
+  archive_.reset();
+  std::fill(shapes_.createdRevision.begin(), shapes_.createdRevision.end(), revision_);
+  std::fill(shapes_.revision.begin(), shapes_.revision.end(), revision_);
+  rectangleCount_ = counters.rectangles;
+  strokeCount_ = counters.strokes;
+  nextShapeKey_ = static_cast<std::uint32_t>(shapes_.count() + 1);
+  strokeIndex_.clear();
+  heldSamples_.clear();
+  spatial_ = SpatialIndex{};
+  for (std::size_t row = 0; row < shapes_.count(); ++row) {
+    spatial_.insert(shapes_.slot[row], shapes_.paintBounds(row));
+  }
+  tiles_ = TileCache{};
+  changes_.clear();
+  changesBase_ = revision_;
+  shapesRevision_ = revision_;
+  journal_.restart(base);
+  history_.clear();
+}
+
+void Engine::setJournaling(bool enabled) {
+  journal_.setEnabled(enabled);
+}
+
+std::span<const std::uint8_t> Engine::journalChunk() {
+  return journal_.take();
+}
+
+std::uint64_t Engine::journalBytes() const {
+  return journal_.bytes();
+}
+
+bool Engine::journalNeedsCompaction() const {
+  return journal_.enabled() && (journal_.stale() || journal_.bytes() > journalLimit_);
+}
+
+void Engine::setJournalLimit(std::uint64_t bytes) {
+  journalLimit_ = bytes;
+}
+
+void Engine::beginCompaction() {
+  beginSave();
+  compacting_ = true;
+}
+
+bool Engine::compactionComplete() const {
+  return compacted_;
+}
+
+std::size_t Engine::replayJournal(std::span<const std::uint8_t> bytes) {
+  auto reader = JournalReader::open(bytes);
+  if (!reader || reader->base() != journal_.base() || !journal_.empty()) {
+    return 0;
+  }
+  replaying_ = true;
+  auto valid = reader->validBytes();
+  auto restored = false;
+  while (const auto record = reader->next()) {
+    if (!applyJournalRecord(*record)) {
+      break;
+    }
+    restored = restored || record->op == JournalOp::Restore;
+    valid = reader->validBytes();
+  }
+  replaying_ = false;
+  // Restored shapes took new keys out of z order; keys are renumbered as a load would, with a full resync.
+  if (restored) {
+    for (std::size_t row = 0; row < shapes_.count(); ++row) {
+      shapes_.key[row] = static_cast<std::uint32_t>(row + 1);
+    }
+    nextShapeKey_ = static_cast<std::uint32_t>(shapes_.count() + 1);
+    changes_.clear();
+    changesBase_ = revision_;
+  }
+  journal_.resume(journal_.base(), valid);
+  // Nobody is drawing the strokes left open by the crash: they end where the journal does.
+  for (std::size_t row = 0; row < shapes_.count(); ++row) {
+    if (shapes_.pointRange[row].open) {
+      forgetStroke(row);
+      shapes_.sealPoints(row);
+      journal_.finish(row);
+    }
+  }
+  return valid;
+}
+
+std::uint32_t Engine::replayJournal(std::uint32_t byte_length) {
+  const auto length = std::min<std::size_t>(byte_length, loadBuffer_.size());
+  const auto valid = replayJournal(std::span<const std::uint8_t>(loadBuffer_).first(length));
+  loadBuffer_ = {};
+  return static_cast<std::uint32_t>(valid);
+}
+
+// Applies one logged change after checking it fits the current shapes, through the same steps as the command
+// that produced it; false leaves the shapes untouched.
+bool Engine::applyJournalRecord(const JournalRecord& record) {
+  if (record.op == JournalOp::Insert) {
+    if (record.row != shapes_.count() || (record.kind == ShapeKind::Stroke && record.points.empty())) {
+      return false;
+    }
+    ++revision_;
+    std::size_t index = 0;
+    if (record.kind == ShapeKind::Rectangle) {
+      index = shapes_.addRectangle(
+          nextShapeKey_++, revision_, record.x, record.y, record.width, record.height, record.rgba);
+      ++rectangleCount_;
+    } else {
+      index = shapes_.addStroke(nextShapeKey_++, revision_, record.points.front(), record.size, record.rgba);
+      shapes_.replacePoints(index, record.points);
+      ++strokeCount_;
+    }
+    shapes_.labels.ids[index] = strings_.intern(record.id);
+    shapes_.labels.names[index] = strings_.intern(record.name);
+    shapes_.labels.colors[index] = strings_.intern(record.color);
+    spatial_.insert(shapes_.slot[index], shapes_.paintBounds(index));
+    tiles_.invalidate(shapes_.paintBounds(index));
+    recordChange(index, ChangeOp::Insert, 0);
+    return true;
+  }
+
+  if (record.op == JournalOp::Restore) {
+    if (record.row > shapes_.count() || (record.kind == ShapeKind::Stroke && record.points.empty())) {
+      return false;
+    }
+    ++revision_;
+    auto shape = ShapeRecord{record.kind,
+                             nextShapeKey_++,
+                             record.x,
+                             record.y,
+                             record.width,
+                             record.height,
+                             record.size,
+                             record.rgba,
+                             PointRange{0, 0, false, false},
+                             strings_.intern(record.id),
+                             strings_.intern(record.name),
+                             strings_.intern(record.color)};
+    if (record.kind == ShapeKind::Stroke) {
+      shape.points = shapes_.pointArena.store(record.points);
+    }
+    restoreRow(record.row, shape);
+    return true;
+  }
+
+  if (record.row >= shapes_.count()) {
+    return false;
+  }
+  const auto row = record.row;
+  const auto handle = shapes_.handle(row);
+  if (record.op == JournalOp::Remove) {
+    return removeShape(handle);
+  }
+  const auto open = shapes_.kind[row] == ShapeKind::Stroke && shapes_.pointRange[row].open;
+  switch (record.op) {
+    case JournalOp::AppendPoints:
+      if (!open) {
+        return false;
+      }
+      ++revision_;
+      for (const auto point : record.points) {
+        appendStrokePoint(row, handle, point);
+      }
+      return true;
+    case JournalOp::ReplacePoints:
+      if (!open || record.points.empty()) {
+        return false;
+      }
+      ++revision_;
+      replaceStrokePoints(row, handle, record.points);
+      return true;
+    case JournalOp::Finish:
+      if (!open) {
+        return false;
+      }
+      shapes_.sealPoints(row);
+      return true;
+    case JournalOp::Reopen:
+      if (shapes_.kind[row] != ShapeKind::Stroke || open) {
+        return false;
+      }
+      shapes_.reopenPoints(row);
+      return true;
+    case JournalOp::Insert:
+    case JournalOp::Remove:
+    case JournalOp::Restore:
+      break;
+  }
+  return false;
 }
 
-emscripten::val Engine::tick() const {
-  auto shapes = emscripten::val::array();
-  std::size_t shape_index = 0;
-  for (std::size_t index = 0; index < rectangles_.size(); ++index) {
-    const auto& rect = rectangles_[index];
-    auto shape = emscripten::val::object();
-    shape.set("id", rect.id);
-    shape.set("name", rect.name);
-    shape.set("kind", std::string("rectangle"));
-    shape.set("x", rect.x);
-    shape.set("y", rect.y);
-    shape.set("width", rect.width);
-    shape.set("height", rect.height);
-    shape.set("color", rect.color);
-    shapes.set(shape_index++, shape);
-  }
-
-  for (const auto& stroke : strokes_) {
-    auto shape = emscripten::val::object();
-    shape.set("id", stroke.id);
-    shape.set("name", stroke.name);
-    shape.set("kind", std::string("stroke"));
-    shape.set("color", stroke.color);
-    shape.set("size", stroke.size);
-
-    auto points = emscripten::val::array();
-    for (std::size_t index = 0; index < stroke.points.size(); ++index) {
-      const auto& point = stroke.points[index];
-      auto point_val = emscripten::val::object();
-      point_val.set("x", point.x);
-      point_val.set("y", point.y);
-      points.set(index, point_val);
-    }
-
-    shape.set("points", points);
-    shapes.set(shape_index++, shape);
-  }
-
-  auto presences = emscripten::val::array();
-  std::size_t presence_index = 0;
-  for (const auto& [id, presence] : presences_) {
-    auto presence_val = emscripten::val::object();
-    presence_val.set("id", presence.id);
-    presence_val.set("color", presence.color);
-    presence_val.set("x", presence.x);
-    presence_val.set("y", presence.y);
-    presences.set(presence_index++, presence_val);
-  }
-
-  auto document = emscripten::val::object();
-  document.set("id", std::string("doc-native"));
-  document.set("name", std::string("Composition native"));
-  document.set("shapes", shapes);
-
-  auto state = emscripten::val::object();
-  state.set("document", document);
-  state.set("presences", presences);
-  return state;
-}
-
-std::shared_ptr<Engine> createEngine(int width, int height) {
-  auto engine = std::make_shared<Engine>();
-  engine->resize(width, height);
-  return engine;
-}
-
-EMSCRIPTEN_BINDINGS(figma_engine_module) {
-  emscripten::class_<Engine>("Engine")
-      .smart_ptr<std::shared_ptr<Engine>>("Engine")
-      .function("resize", &Engine::resize)
-      .function("execute", &Engine::execute)
-      .function("pointerEvent", &Engine::pointerEvent)
-      .function("tick", &Engine::tick);
-
-  emscripten::function("createEngine", &createEngine);
+std::span<const std::uint8_t> Engine::tickVisible() {
+  queryRows_.clear();
+  spatial_.query(viewport_, queryRows_);
+  writeVisibleSnapshot(rowsInZOrder());
+  return visibleSnapshot_;
 }
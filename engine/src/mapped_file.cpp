@@ -0,0 +1,30 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+  const auto descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) {
+    return nullptr;
+  }
+  struct stat status {};
+  if (::fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+    ::close(descriptor);
+    return nullptr;
+  }
+  // The mapping holds its own reference to the file, so the descriptor is not needed past this point.
+  const auto size = static_cast<std::size_t>(status.st_size);
+  auto* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  ::close(descriptor);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  return std::shared_ptr<MappedFile>(new MappedFile(static_cast<const std::uint8_t*>(data), size));
+}
+
+MappedFile::~MappedFile() {
+  ::munmap(const_cast<std::uint8_t*>(data_), size_);
+}
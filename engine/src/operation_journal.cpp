@@ -0,0 +1,299 @@
+#include "operation_journal.hpp"
+
+#include "document_format.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace {
+constexpr std::uint32_t kJournalMagic = 0x4C4A444D;  // "MDJL"
+constexpr std::uint16_t kJournalVersion = 1;
+constexpr std::size_t kJournalHeaderBytes = 16;
+// Payload length and CRC-32.
+constexpr std::size_t kRecordHeaderBytes = 8;
+
+template <typename T>
+void appendValue(std::vector<std::uint8_t>& out, T value) {
+  const auto offset = out.size();
+  out.resize(offset + sizeof(T));
+  std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+void appendVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(value));
+}
+
+void appendString(std::vector<std::uint8_t>& out, std::string_view value) {
+  appendVarint(out, value.size());
+  out.insert(out.end(), value.begin(), value.end());
+}
+
+void appendPointBytes(std::vector<std::uint8_t>& out, std::span<const StrokePoint> points) {
+  const auto* bytes = reinterpret_cast<const std::uint8_t*>(points.data());
+  out.insert(out.end(), bytes, bytes + points.size_bytes());
+}
+
+// Bounds-checked reads over one payload; every method fails once the bytes run out.
+class PayloadReader {
+ public:
+  explicit PayloadReader(std::span<const std::uint8_t> bytes) : bytes_(bytes) {}
+
+  std::span<const std::uint8_t> rest() const { return bytes_.subspan(offset_); }
+
+  template <typename T>
+  bool value(T& out) {
+    if (bytes_.size() - offset_ < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&out, bytes_.data() + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+  bool varint(std::uint64_t& out) {
+    out = 0;
+    for (int shift = 0; shift < 64 && offset_ < bytes_.size(); shift += 7) {
+      const auto byte = bytes_[offset_++];
+      out |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if (byte < 0x80) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool string(std::string_view& out) {
+    std::uint64_t length = 0;
+    if (!varint(length) || length > bytes_.size() - offset_) {
+      return false;
+    }
+    out = std::string_view(reinterpret_cast<const char*>(bytes_.data() + offset_), static_cast<std::size_t>(length));
+    offset_ += static_cast<std::size_t>(length);
+    return true;
+  }
+
+ private:
+  std::span<const std::uint8_t> bytes_;
+  std::size_t offset_ = 0;
+};
+}  // namespace
+
+void OperationJournal::restart(JournalBase base) {
+  base_ = base;
+  taken_ = 0;
+  open_ = false;
+  handedOut_ = false;
+  recorded_ = false;
+  stale_ = false;
+  buffer_.clear();
+  appendValue(buffer_, kJournalMagic);
+  appendValue(buffer_, kJournalVersion);
+  appendValue(buffer_, static_cast<std::uint16_t>(kJournalHeaderBytes));
+  appendValue(buffer_, base.checksum);
+  appendValue(buffer_, base.shapes);
+}
+
+void OperationJournal::resume(JournalBase base, std::uint64_t bytes) {
+  base_ = base;
+  taken_ = bytes;
+  open_ = false;
+  handedOut_ = false;
+  recorded_ = false;
+  stale_ = false;
+  buffer_.clear();
+}
+
+void OperationJournal::setEnabled(bool enabled) {
+  if (enabled_ && !enabled) {
+    open_ = false;
+    stale_ = true;
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+  }
+  enabled_ = enabled;
+}
+
+bool OperationJournal::logging() {
+  stale_ = stale_ || !enabled_;
+  return enabled_;
+}
+
+void OperationJournal::beginRecord(JournalOp op, std::size_t row) {
+  sealRecord();
+  if (handedOut_) {
+    buffer_.clear();
+    handedOut_ = false;
+  }
+  open_ = true;
+  recorded_ = true;
+  openOffset_ = buffer_.size();
+  openOp_ = op;
+  openRow_ = row;
+  buffer_.resize(buffer_.size() + kRecordHeaderBytes);
+  buffer_.push_back(static_cast<std::uint8_t>(op));
+  appendVarint(buffer_, row);
+}
+
+void OperationJournal::sealRecord() {
+  if (!open_) {
+    return;
+  }
+  open_ = false;
+  const auto payload = std::span<const std::uint8_t>(buffer_).subspan(openOffset_ + kRecordHeaderBytes);
+  const auto length = static_cast<std::uint32_t>(payload.size());
+  const auto crc = crc32(payload);
+  std::memcpy(buffer_.data() + openOffset_, &length, sizeof(length));
+  std::memcpy(buffer_.data() + openOffset_ + sizeof(length), &crc, sizeof(crc));
+}
+
+void OperationJournal::insert(const ShapeStore& shapes, const StringTable& strings, std::size_t row) {
+  if (!logging()) {
+    return;
+  }
+  writeShape(JournalOp::Insert, shapes, strings, row);
+}
+
+void OperationJournal::restore(const ShapeStore& shapes, const StringTable& strings, std::size_t row) {
+  if (!logging()) {
+    return;
+  }
+  writeShape(JournalOp::Restore, shapes, strings, row);
+}
+
+void OperationJournal::writeShape(JournalOp op,
+                                  const ShapeStore& shapes,
+                                  const StringTable& strings,
+                                  std::size_t row) {
+  beginRecord(op, row);
+  const std::array<std::string_view, 3> labels = {strings.get(shapes.labels.ids[row]),
+                                                  strings.get(shapes.labels.names[row]),
+                                                  strings.get(shapes.labels.colors[row])};
+  const std::array<float, 5> geometry = {
+      shapes.size[row], shapes.x[row], shapes.y[row], shapes.width[row], shapes.height[row]};
+  buffer_.push_back(static_cast<std::uint8_t>(shapes.kind[row]));
+  appendValue(buffer_, shapes.rgba[row]);
+  const auto* geometry_bytes = reinterpret_cast<const std::uint8_t*>(geometry.data());
+  buffer_.insert(buffer_.end(), geometry_bytes, geometry_bytes + sizeof(geometry));
+  for (const auto label : labels) {
+    appendString(buffer_, label);
+  }
+  appendPointBytes(buffer_, shapes.points(row, points_));
+}
+
+void OperationJournal::appendPoints(std::size_t row, std::span<const StrokePoint> points) {
+  if (!logging()) {
+    return;
+  }
+  if (!open_ || openOp_ != JournalOp::AppendPoints || openRow_ != row) {
+    beginRecord(JournalOp::AppendPoints, row);
+  }
+  appendPointBytes(buffer_, points);
+}
+
+void OperationJournal::replacePoints(std::size_t row, std::span<const StrokePoint> points) {
+  if (!logging()) {
+    return;
+  }
+  beginRecord(JournalOp::ReplacePoints, row);
+  appendPointBytes(buffer_, points);
+}
+
+void OperationJournal::finish(std::size_t row) {
+  if (logging()) {
+    beginRecord(JournalOp::Finish, row);
+  }
+}
+
+void OperationJournal::reopen(std::size_t row) {
+  if (logging()) {
+    beginRecord(JournalOp::Reopen, row);
+  }
+}
+
+void OperationJournal::remove(std::size_t row) {
+  if (logging()) {
+    beginRecord(JournalOp::Remove, row);
+  }
+}
+
+std::span<const std::uint8_t> OperationJournal::take() {
+  sealRecord();
+  if (handedOut_ || !enabled_ || stale_) {
+    return {};
+  }
+  // Cleared when the next record begins rather than now, so the returned bytes stay valid until then.
+  taken_ += buffer_.size();
+  handedOut_ = true;
+  return buffer_;
+}
+
+std::optional<JournalReader> JournalReader::open(std::span<const std::uint8_t> bytes) {
+  PayloadReader header(bytes);
+  std::uint32_t magic = 0;
+  std::uint16_t version = 0;
+  std::uint16_t header_bytes = 0;
+  JournalReader reader;
+  if (!header.value(magic) || !header.value(version) || !header.value(header_bytes) ||
+      !header.value(reader.base_.checksum) || !header.value(reader.base_.shapes) || magic != kJournalMagic ||
+      version != kJournalVersion || header_bytes < kJournalHeaderBytes || header_bytes > bytes.size()) {
+    return std::nullopt;
+  }
+  reader.bytes_ = bytes;
+  reader.offset_ = header_bytes;
+  return reader;
+}
+
+std::optional<JournalRecord> JournalReader::next() {
+  PayloadReader framing(bytes_.subspan(offset_));
+  std::uint32_t length = 0;
+  std::uint32_t crc = 0;
+  if (!framing.value(length) || !framing.value(crc) || length > framing.rest().size()) {
+    return std::nullopt;
+  }
+  const auto payload = framing.rest().first(length);
+  if (crc32(payload) != crc) {
+    return std::nullopt;
+  }
+
+  PayloadReader reader(payload);
+  std::uint8_t op = 0;
+  std::uint64_t row = 0;
+  if (!reader.value(op) || !reader.varint(row) || op < static_cast<std::uint8_t>(JournalOp::Insert) ||
+      op > static_cast<std::uint8_t>(JournalOp::Restore)) {
+    return std::nullopt;
+  }
+  JournalRecord record{};
+  record.op = static_cast<JournalOp>(op);
+  record.row = static_cast<std::size_t>(row);
+  const auto has_shape = record.op == JournalOp::Insert || record.op == JournalOp::Restore;
+  if (has_shape) {
+    std::uint8_t kind = 0;
+    if (!reader.value(kind) || kind > static_cast<std::uint8_t>(ShapeKind::Stroke) || !reader.value(record.rgba) ||
+        !reader.value(record.size) || !reader.value(record.x) || !reader.value(record.y) ||
+        !reader.value(record.width) || !reader.value(record.height) || !reader.string(record.id) ||
+        !reader.string(record.name) || !reader.string(record.color)) {
+      return std::nullopt;
+    }
+    record.kind = static_cast<ShapeKind>(kind);
+  }
+  if (has_shape || record.op == JournalOp::AppendPoints || record.op == JournalOp::ReplacePoints) {
+    // Copied out: the journal gives no alignment guarantee.
+    const auto points = reader.rest();
+    if (points.size() % sizeof(StrokePoint) != 0) {
+      return std::nullopt;
+    }
+    points_.resize(points.size() / sizeof(StrokePoint));
+    if (!points.empty()) {
+      std::memcpy(points_.data(), points.data(), points.size());
+    }
+    record.points = points_;
+  } else if (!reader.rest().empty()) {
+    return std::nullopt;
+  }
+  offset_ += kRecordHeaderBytes + length;
+  return record;
+}
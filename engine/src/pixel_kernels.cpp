@@ -0,0 +1,215 @@
+#include "pixel_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(__wasm_simd128__) || defined(__ARM_NEON)
+#define FIGMA_ENGINE_SIMD_KERNELS 1
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+
+namespace {
+// Scales all four channels of a packed pixel by `factor` / 255, rounded, two channels per multiply.
+std::uint32_t scalePixel(std::uint32_t pixel, std::uint32_t factor) {
+  auto red_blue = (pixel & 0x00FF00FF) * factor + 0x00800080;
+  auto green_alpha = ((pixel >> 8) & 0x00FF00FF) * factor + 0x00800080;
+  red_blue = ((red_blue + ((red_blue >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+  green_alpha = (green_alpha + ((green_alpha >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+  return red_blue | green_alpha;
+}
+
+// Source-over at `coverage`. Channels cannot overflow: a premultiplied channel never exceeds its alpha, and the
+// destination is scaled by what the source alpha leaves.
+std::uint32_t blendPixel(std::uint32_t destination, std::uint32_t color, std::uint32_t coverage) {
+  const auto source = coverage == 255 ? color : scalePixel(color, coverage);
+  return source + scalePixel(destination, 255 - (source >> 24));
+}
+
+std::uint8_t capsuleCoverage(const CapsuleRow& row, int column) {
+  const auto px = static_cast<float>(column) + 0.5f - row.originX;
+  const auto t = std::clamp((px * row.dx + row.offsetY * row.dy) * row.inverseLength, 0.0f, 1.0f);
+  const auto ex = px - row.dx * t;
+  const auto ey = row.offsetY - row.dy * t;
+  return static_cast<std::uint8_t>(std::clamp(row.reach - std::sqrt(ex * ex + ey * ey), 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+void fillScalar(std::uint32_t* pixels, std::size_t count, std::uint32_t color) {
+  std::fill_n(pixels, count, color);
+}
+
+void blendScalar(std::uint32_t* pixels, std::size_t count, std::uint32_t color, std::uint32_t coverage) {
+  if (coverage == 0) {
+    return;
+  }
+  if (coverage == 255 && (color >> 24) == 255) {
+    fillScalar(pixels, count, color);
+    return;
+  }
+  for (std::size_t index = 0; index < count; ++index) {
+    pixels[index] = blendPixel(pixels[index], color, coverage);
+  }
+}
+
+void blendMaskScalar(std::uint32_t* pixels, const std::uint8_t* mask, std::size_t count, std::uint32_t color) {
+  const auto opaque = (color >> 24) == 255;
+  for (std::size_t index = 0; index < count; ++index) {
+    const auto coverage = mask[index];
+    if (coverage == 255 && opaque) {
+      pixels[index] = color;
+    } else if (coverage != 0) {
+      pixels[index] = blendPixel(pixels[index], color, coverage);
+    }
+  }
+}
+
+void accumulateCapsuleScalar(std::uint8_t* mask, std::size_t count, const CapsuleRow& row) {
+  for (std::size_t index = 0; index < count; ++index) {
+    mask[index] = std::max(mask[index], capsuleCoverage(row, row.firstColumn + static_cast<int>(index)));
+  }
+}
+
+constexpr PixelKernels kScalarKernels{"scalar", fillScalar, blendScalar, blendMaskScalar, accumulateCapsuleScalar};
+
+#if FIGMA_ENGINE_SIMD_KERNELS
+// GCC/Clang vector extensions: one source lowers to SSE2 natively, NEON on ARM and SIMD128 in Wasm builds.
+using U16x8 = std::uint16_t __attribute__((vector_size(16)));
+using U32x4 = std::uint32_t __attribute__((vector_size(16)));
+using I32x4 = std::int32_t __attribute__((vector_size(16)));
+using F32x4 = float __attribute__((vector_size(16)));
+
+U32x4 loadPixels(const std::uint32_t* pixels) {
+  U32x4 value;
+  std::memcpy(&value, pixels, sizeof(value));
+  return value;
+}
+
+void storePixels(std::uint32_t* pixels, U32x4 value) {
+  std::memcpy(pixels, &value, sizeof(value));
+}
+
+// scalePixel() on four pixels, each with its own factor. Every 16-bit lane holds one channel, so the rounding
+// matches the scalar code bit for bit.
+U32x4 scalePixels(U32x4 pixels, U32x4 factors) {
+  const auto lanes = (U16x8)(factors | (factors << 16));
+  auto red_blue = (U16x8)(pixels & 0x00FF00FF) * lanes + 128;
+  auto green_alpha = (U16x8)((pixels >> 8) & 0x00FF00FF) * lanes + 128;
+  red_blue = (red_blue + (red_blue >> 8)) >> 8;
+  green_alpha = (green_alpha + (green_alpha >> 8)) >> 8;
+  return (U32x4)red_blue | ((U32x4)green_alpha << 8);
+}
+
+F32x4 select(I32x4 mask, F32x4 whenSet, F32x4 otherwise) {
+  return (F32x4)(((I32x4)whenSet & mask) | ((I32x4)otherwise & ~mask));
+}
+
+// std::clamp(value, 0, 1) lane by lane.
+F32x4 clampUnit(F32x4 value) {
+  const F32x4 zero = {0, 0, 0, 0};
+  const F32x4 one = {1, 1, 1, 1};
+  value = select(value < zero, zero, value);
+  return select(one < value, one, value);
+}
+
+F32x4 squareRoot(F32x4 value) {
+#if defined(__wasm_simd128__)
+  return (F32x4)wasm_f32x4_sqrt((v128_t)value);
+#elif defined(__SSE2__)
+  return (F32x4)_mm_sqrt_ps((__m128)value);
+#else
+  return F32x4{std::sqrt(value[0]), std::sqrt(value[1]), std::sqrt(value[2]), std::sqrt(value[3])};
+#endif
+}
+
+void fillSimd(std::uint32_t* pixels, std::size_t count, std::uint32_t color) {
+  const U32x4 colors = {color, color, color, color};
+  std::size_t index = 0;
+  for (; index + 4 <= count; index += 4) {
+    storePixels(pixels + index, colors);
+  }
+  fillScalar(pixels + index, count - index, color);
+}
+
+void blendSimd(std::uint32_t* pixels, std::size_t count, std::uint32_t color, std::uint32_t coverage) {
+  if (coverage == 0) {
+    return;
+  }
+  if (coverage == 255 && (color >> 24) == 255) {
+    fillSimd(pixels, count, color);
+    return;
+  }
+  const auto source = coverage == 255 ? color : scalePixel(color, coverage);
+  const auto remainder = 255 - (source >> 24);
+  const U32x4 sources = {source, source, source, source};
+  const U32x4 remainders = {remainder, remainder, remainder, remainder};
+  std::size_t index = 0;
+  for (; index + 4 <= count; index += 4) {
+    storePixels(pixels + index, sources + scalePixels(loadPixels(pixels + index), remainders));
+  }
+  blendScalar(pixels + index, count - index, color, coverage);
+}
+
+void blendMaskSimd(std::uint32_t* pixels, const std::uint8_t* mask, std::size_t count, std::uint32_t color) {
+  const auto opaque = (color >> 24) == 255;
+  const U32x4 colors = {color, color, color, color};
+  std::size_t index = 0;
+  for (; index + 4 <= count; index += 4) {
+    std::uint32_t word;
+    std::memcpy(&word, mask + index, sizeof(word));
+    if (word == 0) {
+      continue;
+    }
+    if (word == 0xFFFFFFFF && opaque) {
+      storePixels(pixels + index, colors);
+    } else {
+      // Uncovered lanes scale the source to zero and keep the destination as is, so no per-lane branch is needed.
+      const U32x4 coverage = {mask[index], mask[index + 1], mask[index + 2], mask[index + 3]};
+      const auto sources = scalePixels(colors, coverage);
+      const auto destinations = scalePixels(loadPixels(pixels + index), 255 - (sources >> 24));
+      storePixels(pixels + index, sources + destinations);
+    }
+  }
+  blendMaskScalar(pixels + index, mask + index, count - index, color);
+}
+
+void accumulateCapsuleSimd(std::uint8_t* mask, std::size_t count, const CapsuleRow& row) {
+  const I32x4 lanes = {0, 1, 2, 3};
+  std::size_t index = 0;
+  for (; index + 4 <= count; index += 4) {
+    // Same operations in the same order as capsuleCoverage(), so each lane rounds like the scalar code.
+    const auto columns = lanes + (row.firstColumn + static_cast<int>(index));
+    const auto px = (__builtin_convertvector(columns, F32x4) + 0.5f) - row.originX;
+    const auto t = clampUnit((px * row.dx + row.offsetY * row.dy) * row.inverseLength);
+    const auto ex = px - row.dx * t;
+    const auto ey = row.offsetY - row.dy * t;
+    const auto coverage =
+        __builtin_convertvector(clampUnit(row.reach - squareRoot(ex * ex + ey * ey)) * 255.0f + 0.5f, I32x4);
+    for (int lane = 0; lane < 4; ++lane) {
+      auto& value = mask[index + lane];
+      value = std::max(value, static_cast<std::uint8_t>(coverage[lane]));
+    }
+  }
+  CapsuleRow tail = row;
+  tail.firstColumn += static_cast<int>(index);
+  accumulateCapsuleScalar(mask + index, count - index, tail);
+}
+
+constexpr PixelKernels kSimdKernels{"simd128", fillSimd, blendSimd, blendMaskSimd, accumulateCapsuleSimd};
+#endif
+}  // namespace
+
+const PixelKernels& scalarPixelKernels() {
+  return kScalarKernels;
+}
+
+const PixelKernels& pixelKernels() {
+#if FIGMA_ENGINE_SIMD_KERNELS
+  return kSimdKernels;
+#else
+  return kScalarKernels;
+#endif
+}
@@ -0,0 +1,244 @@
+#include "point_arena.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+
+namespace {
+// Grid coordinates stay within what a float holds exactly, so packing is lossless.
+constexpr float kMaxGridCoordinate = 1 << 24;
+// Grids a stroke may be packed on, finest last: the one strokes are snapped to, then the document format's.
+constexpr std::uint8_t kPackingScales[] = {PointArena::kGridScaleLog2, 6};
+constexpr std::size_t kMaxVarintBytes = 5;
+
+bool onGrid(float value, float scale) {
+  const auto scaled = value * scale;
+  return std::abs(scaled) <= kMaxGridCoordinate && std::trunc(scaled) == scaled;
+}
+
+// The coarsest packing grid every point lies on, if any.
+std::optional<std::uint8_t> packingScale(std::span<const StrokePoint> points) {
+  for (const auto scale_log2 : kPackingScales) {
+    const auto scale = static_cast<float>(1 << scale_log2);
+    if (std::all_of(points.begin(), points.end(), [scale](StrokePoint point) {
+          return onGrid(point.x, scale) && onGrid(point.y, scale);
+        })) {
+      return scale_log2;
+    }
+  }
+  return std::nullopt;
+}
+
+std::uint8_t* writeVarint(std::uint8_t* out, std::uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = static_cast<std::uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<std::uint8_t>(value);
+  return out;
+}
+
+// Packed bytes are the arena's own, so they are read without bounds checks. Deltas mostly take one byte.
+std::uint32_t readVarint(const std::uint8_t*& byte) {
+  std::uint32_t value = *byte++;
+  if (value < 0x80) {
+    return value;
+  }
+  value &= 0x7F;
+  for (int shift = 7;; shift += 7) {
+    const std::uint32_t next = *byte++;
+    value |= (next & 0x7F) << shift;
+    if (next < 0x80) {
+      return value;
+    }
+  }
+}
+
+std::uint32_t zigzag(std::int32_t value) {
+  return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+}
+
+std::int32_t unzigzag(std::uint32_t value) {
+  return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+}
+}  // namespace
+
+bool PointArena::snapToGrid(std::span<StrokePoint> points) {
+  constexpr auto scale = static_cast<float>(1 << kGridScaleLog2);
+  const auto in_range = [](float value) { return std::abs(value * scale) <= kMaxGridCoordinate; };
+  if (!std::all_of(points.begin(), points.end(), [&](StrokePoint point) {
+        return in_range(point.x) && in_range(point.y);
+      })) {
+    return false;
+  }
+  auto moved = false;
+  for (auto& point : points) {
+    for (auto* value : {&point.x, &point.y}) {
+      const auto scaled = *value * scale;
+      if (std::round(scaled) != scaled) {
+        *value = std::round(scaled) / scale;
+        moved = true;
+      }
+    }
+  }
+  return moved;
+}
+
+PointRange PointArena::open(StrokePoint first) {
+  std::uint32_t chunk = 0;
+  if (freeChunks_.empty()) {
+    chunk = static_cast<std::uint32_t>(chunks_.size());
+    chunks_.emplace_back();
+  } else {
+    chunk = freeChunks_.back();
+    freeChunks_.pop_back();
+  }
+  chunks_[chunk].push_back(first);
+  return PointRange{chunk, 1, true, false};
+}
+
+void PointArena::append(PointRange& range, StrokePoint point) {
+  if (!range.open) {
+    return;
+  }
+  chunks_[range.offset].push_back(point);
+  ++range.length;
+}
+
+void PointArena::assign(PointRange& range, std::span<const StrokePoint> points) {
+  if (!range.open) {
+    return;
+  }
+  chunks_[range.offset].assign(points.begin(), points.end());
+  range.length = static_cast<std::uint32_t>(points.size());
+}
+
+void PointArena::seal(PointRange& range) {
+  if (!range.open) {
+    return;
+  }
+  auto& chunk = chunks_[range.offset];
+  const auto sealed = seal(chunk);
+  chunk.clear();
+  freeChunks_.push_back(range.offset);
+  range = sealed;
+}
+
+PointRange PointArena::store(std::span<const StrokePoint> points) {
+  return seal(points);
+}
+
+PointRange PointArena::seal(std::span<const StrokePoint> points) {
+  const auto length = static_cast<std::uint32_t>(points.size());
+  const auto scale_log2 = packingScale(points);
+  if (!scale_log2.has_value()) {
+    const auto offset = static_cast<std::uint32_t>(mapped_.size() + slab_.size());
+    slab_.insert(slab_.end(), points.begin(), points.end());
+    return PointRange{offset, length, false, false};
+  }
+  const auto offset = static_cast<std::uint32_t>(packed_.size());
+  const auto scale = static_cast<float>(1 << *scale_log2);
+  packed_.push_back(*scale_log2);
+  // Encoded a batch of points at a time through a buffer that holds their longest encoding.
+  constexpr std::size_t kBatchPoints = 128;
+  std::array<std::uint8_t, kBatchPoints * 2 * kMaxVarintBytes> buffer;
+  std::int32_t previous_x = 0;
+  std::int32_t previous_y = 0;
+  for (std::size_t first = 0; first < points.size(); first += kBatchPoints) {
+    auto* out = buffer.data();
+    for (const auto& point : points.subspan(first, std::min(kBatchPoints, points.size() - first))) {
+      const auto x = static_cast<std::int32_t>(point.x * scale);
+      const auto y = static_cast<std::int32_t>(point.y * scale);
+      out = writeVarint(out, zigzag(x - previous_x));
+      out = writeVarint(out, zigzag(y - previous_y));
+      previous_x = x;
+      previous_y = y;
+    }
+    packed_.insert(packed_.end(), buffer.data(), out);
+  }
+  return PointRange{offset, length, false, true};
+}
+
+void PointArena::decode(const PointRange& range, std::vector<StrokePoint>& out) const {
+  out.resize(range.length);
+  const auto* byte = packed_.data() + range.offset;
+  const auto step = 1.0f / static_cast<float>(1 << *byte++);
+  std::int32_t x = 0;
+  std::int32_t y = 0;
+  for (auto& point : out) {
+    x += unzigzag(readVarint(byte));
+    y += unzigzag(readVarint(byte));
+    point = StrokePoint{static_cast<float>(x) * step, static_cast<float>(y) * step};
+  }
+}
+
+void PointArena::mapSealed(std::span<const StrokePoint> points) {
+  mapped_ = points;
+}
+
+void PointArena::release(PointRange& range) {
+  if (range.open) {
+    chunks_[range.offset].clear();
+    freeChunks_.push_back(range.offset);
+  }
+  range = PointRange{0, 0, false, false};
+}
+
+std::span<const StrokePoint> PointArena::points(const PointRange& range) const {
+  if (range.open) {
+    return chunks_[range.offset];
+  }
+  if (range.packed) {
+    auto cached = decoded_.find(range.offset);
+    if (cached == decoded_.end()) {
+      order_.push_back(range.offset);
+      cached = decoded_.emplace(range.offset, DecodedStroke{{}, frame_, std::prev(order_.end())}).first;
+      decode(range, cached->second.points);
+      decodedPoints_ += range.length;
+      trim(range.offset);
+    } else if (cached->second.lastUsed != frame_) {
+      // Strokes already used in the frame are left as they are, so that render workers only read the cache.
+      cached->second.lastUsed = frame_;
+      order_.splice(order_.end(), order_, cached->second.order);
+    }
+    return cached->second.points;
+  }
+  if (range.offset < mapped_.size()) {
+    return mapped_.subspan(range.offset, range.length);
+  }
+  return std::span<const StrokePoint>(slab_).subspan(range.offset - mapped_.size(), range.length);
+}
+
+std::span<const StrokePoint> PointArena::read(const PointRange& range, std::vector<StrokePoint>& scratch) const {
+  if (!range.packed) {
+    return points(range);
+  }
+  if (const auto cached = decoded_.find(range.offset); cached != decoded_.end()) {
+    return cached->second.points;
+  }
+  decode(range, scratch);
+  return scratch;
+}
+
+void PointArena::beginFrame() {
+  ++frame_;
+  inFrame_ = true;
+}
+
+void PointArena::endFrame() {
+  inFrame_ = false;
+  trim(order_.empty() ? 0 : order_.back());
+}
+
+void PointArena::trim(std::uint32_t keep) const {
+  while (decodedPoints_ > kMaxDecodedPoints && order_.front() != keep) {
+    const auto stroke = decoded_.find(order_.front());
+    if (inFrame_ && stroke->second.lastUsed == frame_) {
+      break;
+    }
+    decodedPoints_ -= stroke->second.points.size();
+    decoded_.erase(stroke);
+    order_.pop_front();
+  }
+}
@@ -0,0 +1,79 @@
+#include "polyline_simplify.hpp"
+
+#include <utility>
+
+namespace {
+float distanceSquared(StrokePoint from, StrokePoint to) {
+  const auto dx = to.x - from.x;
+  const auto dy = to.y - from.y;
+  return dx * dx + dy * dy;
+}
+
+// Distance to a segment rather than its line, so strokes that loop back onto their start are handled too. Built
+// once per segment, since RDP measures many points against the same one.
+class SegmentDistance {
+ public:
+  SegmentDistance(StrokePoint from, StrokePoint to)
+      : from_(from), dx_(to.x - from.x), dy_(to.y - from.y), inverseLength_(0) {
+    const auto length_squared = dx_ * dx_ + dy_ * dy_;
+    if (length_squared > 0) {
+      inverseLength_ = 1 / length_squared;
+    }
+  }
+
+  float squared(StrokePoint point) const {
+    auto t = ((point.x - from_.x) * dx_ + (point.y - from_.y) * dy_) * inverseLength_;
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    return distanceSquared(StrokePoint{from_.x + dx_ * t, from_.y + dy_ * t}, point);
+  }
+
+ private:
+  StrokePoint from_;
+  float dx_;
+  float dy_;
+  float inverseLength_;
+};
+}  // namespace
+
+bool withinTolerance(StrokePoint kept, StrokePoint sample, float tolerance) {
+  return distanceSquared(kept, sample) < tolerance * tolerance;
+}
+
+void simplifyPolyline(std::span<const StrokePoint> points, float tolerance, std::vector<StrokePoint>& kept) {
+  kept.clear();
+  if (points.size() < 3) {
+    kept.assign(points.begin(), points.end());
+    return;
+  }
+
+  const auto tolerance_squared = tolerance * tolerance;
+  std::vector<bool> keep(points.size(), false);
+  keep.front() = true;
+  keep.back() = true;
+  std::vector<std::pair<std::size_t, std::size_t>> ranges = {{0, points.size() - 1}};
+  while (!ranges.empty()) {
+    const auto [first, last] = ranges.back();
+    ranges.pop_back();
+    const SegmentDistance segment(points[first], points[last]);
+    auto farthest = first;
+    auto farthest_distance = tolerance_squared;
+    for (auto index = first + 1; index < last; ++index) {
+      const auto distance = segment.squared(points[index]);
+      if (distance > farthest_distance) {
+        farthest = index;
+        farthest_distance = distance;
+      }
+    }
+    if (farthest != first) {
+      keep[farthest] = true;
+      ranges.emplace_back(first, farthest);
+      ranges.emplace_back(farthest, last);
+    }
+  }
+
+  for (std::size_t index = 0; index < points.size(); ++index) {
+    if (keep[index]) {
+      kept.push_back(points[index]);
+    }
+  }
+}
@@ -0,0 +1,294 @@
+#include "rasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+// x * y / 255, rounded, for 8-bit operands.
+std::uint32_t mul255(std::uint32_t x, std::uint32_t y) {
+  const auto value = x * y + 128;
+  return (value + (value >> 8)) >> 8;
+}
+
+std::uint32_t premultiply(std::uint32_t rgba) {
+  const auto alpha = rgba >> 24;
+  return mul255(rgba & 0xFF, alpha) | (mul255((rgba >> 8) & 0xFF, alpha) << 8) |
+         (mul255((rgba >> 16) & 0xFF, alpha) << 16) | (alpha << 24);
+}
+
+std::uint8_t coverageByte(float coverage) {
+  return static_cast<std::uint8_t>(std::clamp(coverage, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Share of pixel [index, index + 1) inside [low, high).
+float overlap(int index, float low, float high) {
+  return std::clamp(std::min(static_cast<float>(index + 1), high) - std::max(static_cast<float>(index), low), 0.0f, 1.0f);
+}
+}  // namespace
+
+void Framebuffer::resize(int width, int height) {
+  width_ = std::max(width, 0);
+  height_ = std::max(height, 0);
+  pixels_.resize(static_cast<std::size_t>(width_) * height_);
+}
+
+void Framebuffer::clear(std::uint32_t rgba) {
+  pixelKernels().fill(pixels_.data(), pixels_.size(), premultiply(rgba));
+}
+
+std::span<const std::uint8_t> Framebuffer::bytes() const {
+  return {reinterpret_cast<const std::uint8_t*>(pixels_.data()), pixels_.size() * sizeof(std::uint32_t)};
+}
+
+void Rasterizer::setTransform(float origin_x, float origin_y, float scale) {
+  originX_ = origin_x;
+  originY_ = origin_y;
+  scale_ = scale;
+}
+
+void Rasterizer::fillRect(Framebuffer& target, float x, float y, float width, float height, std::uint32_t rgba) {
+  const auto color = premultiply(rgba);
+  if ((color >> 24) == 0) {
+    return;
+  }
+
+  // Clip in float first: the pixel-space box may lie far outside int range.
+  const auto x0 = (x - originX_) * scale_;
+  const auto y0 = (y - originY_) * scale_;
+  const auto x1 = (x + width - originX_) * scale_;
+  const auto y1 = (y + height - originY_) * scale_;
+  const auto left = std::max(std::min(x0, x1), 0.0f);
+  const auto top = std::max(std::min(y0, y1), 0.0f);
+  const auto right = std::min(std::max(x0, x1), static_cast<float>(target.width()));
+  const auto bottom = std::min(std::max(y0, y1), static_cast<float>(target.height()));
+  if (!(left < right && top < bottom)) {
+    return;
+  }
+
+  const auto first_column = static_cast<int>(left);
+  const auto last_column = static_cast<int>(std::ceil(right)) - 1;
+  const auto first_row = static_cast<int>(top);
+  const auto last_row = static_cast<int>(std::ceil(bottom)) - 1;
+  // Columns wholly inside [left, right) share their row's coverage; only the edge columns need their own.
+  const auto inner_first = static_cast<int>(std::ceil(left));
+  const auto inner_last = static_cast<int>(right) - 1;
+
+  for (int row_index = first_row; row_index <= last_row; ++row_index) {
+    const auto row_coverage = overlap(row_index, top, bottom);
+    auto* row = target.row(row_index);
+    const auto blend_edge = [&](int column) {
+      kernels_->blend(row + column, 1, color, coverageByte(row_coverage * overlap(column, left, right)));
+    };
+    if (inner_first > inner_last) {
+      for (int column = first_column; column <= last_column; ++column) {
+        blend_edge(column);
+      }
+      continue;
+    }
+    for (int column = first_column; column < inner_first; ++column) {
+      blend_edge(column);
+    }
+    kernels_->blend(row + inner_first, static_cast<std::size_t>(inner_last - inner_first + 1), color,
+                    coverageByte(row_coverage));
+    for (int column = inner_last + 1; column <= last_column; ++column) {
+      blend_edge(column);
+    }
+  }
+}
+
+void Rasterizer::strokePolyline(Framebuffer& target,
+                                std::span<const StrokePoint> points,
+                                float width,
+                                std::uint32_t rgba) {
+  if (points.empty() || (premultiply(rgba) >> 24) == 0 || target.width() == 0 || target.height() == 0) {
+    return;
+  }
+  // The scratch mask spans the whole target, so it never has to grow.
+  if (scratch_.width != target.width() || scratch_.height != target.height()) {
+    scratch_ = CoverageMask{};
+    growMask(scratch_, target, 0, 0, target.width() - 1, target.height() - 1);
+  }
+  accumulateStroke(scratch_, target, points, width);
+  compositeMask(target, scratch_, rgba);
+  clearMask(scratch_);
+}
+
+void Rasterizer::accumulateStroke(CoverageMask& mask,
+                                  const Framebuffer& target,
+                                  std::span<const StrokePoint> points,
+                                  float width) {
+  if (points.size() < mask.points) {
+    clearMask(mask);
+  }
+  if (points.empty() || points.size() == mask.points || target.width() == 0 || target.height() == 0) {
+    return;
+  }
+  // Segment i joins points i and i + 1; the last one already seen is redone because it may have been a lone dot.
+  const auto first_segment = mask.points == 0 ? 0 : mask.points - 1;
+  const auto segments = std::max<std::size_t>(points.size() - 1, 1);
+  mask.points = points.size();
+
+  // A pixel is covered by how far its center lies inside the brush, +/- half a pixel.
+  const auto radius = std::abs(width) * scale_ / 2;
+  const auto reach = radius + 0.5f;
+  const auto last_column = static_cast<float>(target.width() - 1);
+  const auto last_row = static_cast<float>(target.height() - 1);
+  struct Segment {
+    float ax;
+    float ay;
+    float dx;
+    float dy;
+  };
+  const auto segment_at = [&](std::size_t segment) {
+    const auto& from = points[segment];
+    const auto& to = points[std::min(segment + 1, points.size() - 1)];
+    const auto ax = (from.x - originX_) * scale_;
+    const auto ay = (from.y - originY_) * scale_;
+    return Segment{ax, ay, (to.x - originX_) * scale_ - ax, (to.y - originY_) * scale_ - ay};
+  };
+
+  // First pass: the pixels the new segments can reach, so the mask is grown once.
+  auto need_left = target.width();
+  auto need_top = target.height();
+  auto need_right = -1;
+  auto need_bottom = -1;
+  for (auto segment = first_segment; segment < segments; ++segment) {
+    const auto [ax, ay, dx, dy] = segment_at(segment);
+    const auto row_low = std::max(std::ceil(std::min(ay, ay + dy) - reach - 0.5f), 0.0f);
+    const auto row_high = std::min(std::floor(std::max(ay, ay + dy) + reach - 0.5f), last_row);
+    const auto column_low = std::max(std::ceil(std::min(ax, ax + dx) - reach - 0.5f), 0.0f);
+    const auto column_high = std::min(std::floor(std::max(ax, ax + dx) + reach - 0.5f), last_column);
+    if (row_low <= row_high && column_low <= column_high) {
+      need_left = std::min(need_left, static_cast<int>(column_low));
+      need_top = std::min(need_top, static_cast<int>(row_low));
+      need_right = std::max(need_right, static_cast<int>(column_high));
+      need_bottom = std::max(need_bottom, static_cast<int>(row_high));
+    }
+  }
+  if (need_right < 0) {
+    return;
+  }
+  growMask(mask, target, need_left, need_top, need_right, need_bottom);
+
+  for (auto segment = first_segment; segment < segments; ++segment) {
+    const auto [ax, ay, dx, dy] = segment_at(segment);
+    const auto length_squared = dx * dx + dy * dy;
+    const auto inverse_length = length_squared > 0 ? 1 / length_squared : 0.0f;
+
+    const auto row_low = std::max(std::ceil(std::min(ay, ay + dy) - reach - 0.5f), 0.0f);
+    const auto row_high = std::min(std::floor(std::max(ay, ay + dy) + reach - 0.5f), last_row);
+    if (!(row_low <= row_high)) {
+      continue;
+    }
+
+    for (auto row = static_cast<int>(row_low); row <= static_cast<int>(row_high); ++row) {
+      const auto center_y = static_cast<float>(row) + 0.5f;
+      // Part of the segment within `reach` of this row, widened by `reach`, bounds the columns to test.
+      auto t0 = 0.0f;
+      auto t1 = 1.0f;
+      if (dy != 0) {
+        t0 = (center_y - reach - ay) / dy;
+        t1 = (center_y + reach - ay) / dy;
+        if (t0 > t1) {
+          std::swap(t0, t1);
+        }
+        if (t1 < 0 || t0 > 1) {
+          continue;
+        }
+        t0 = std::max(t0, 0.0f);
+        t1 = std::min(t1, 1.0f);
+      }
+      const auto span_low = std::min(ax + dx * t0, ax + dx * t1) - reach;
+      const auto span_high = std::max(ax + dx * t0, ax + dx * t1) + reach;
+      const auto column_low = std::max(std::ceil(span_low - 0.5f), 0.0f);
+      const auto column_high = std::min(std::floor(span_high - 0.5f), last_column);
+      if (!(column_low <= column_high)) {
+        continue;
+      }
+
+      const auto first = static_cast<int>(column_low);
+      const auto last = static_cast<int>(column_high);
+      const auto mask_row = row - mask.top;
+      const CapsuleRow capsule{first, ax, center_y - ay, dx, dy, inverse_length, reach};
+      kernels_->accumulateCapsule(
+          mask.coverage.data() + static_cast<std::size_t>(mask_row) * mask.width + (first - mask.left),
+          static_cast<std::size_t>(last - first + 1),
+          capsule);
+      mask.spanStart[mask_row] = std::min(mask.spanStart[mask_row], first);
+      mask.spanEnd[mask_row] = std::max(mask.spanEnd[mask_row], last);
+    }
+  }
+}
+
+void Rasterizer::compositeMask(Framebuffer& target, const CoverageMask& mask, std::uint32_t rgba) {
+  const auto color = premultiply(rgba);
+  if ((color >> 24) == 0) {
+    return;
+  }
+  for (int mask_row = 0; mask_row < mask.height; ++mask_row) {
+    const auto first = mask.spanStart[mask_row];
+    const auto last = mask.spanEnd[mask_row];
+    if (first <= last) {
+      kernels_->blendMask(target.row(mask.top + mask_row) + first,
+                          mask.coverage.data() + static_cast<std::size_t>(mask_row) * mask.width + (first - mask.left),
+                          static_cast<std::size_t>(last - first + 1),
+                          color);
+    }
+  }
+}
+
+void Rasterizer::clearMask(CoverageMask& mask) {
+  for (int mask_row = 0; mask_row < mask.height; ++mask_row) {
+    const auto first = mask.spanStart[mask_row];
+    const auto last = mask.spanEnd[mask_row];
+    if (first <= last) {
+      std::memset(mask.coverage.data() + static_cast<std::size_t>(mask_row) * mask.width + (first - mask.left),
+                  0,
+                  static_cast<std::size_t>(last - first + 1));
+    }
+    mask.spanStart[mask_row] = std::numeric_limits<std::int32_t>::max();
+    mask.spanEnd[mask_row] = -1;
+  }
+  mask.points = 0;
+}
+
+void Rasterizer::growMask(CoverageMask& mask, const Framebuffer& target, int left, int top, int right, int bottom) {
+  if (mask.width > 0 && left >= mask.left && top >= mask.top && right < mask.left + mask.width &&
+      bottom < mask.top + mask.height) {
+    return;
+  }
+  if (mask.width > 0) {
+    left = std::min(left, mask.left);
+    top = std::min(top, mask.top);
+    right = std::max(right, mask.left + mask.width - 1);
+    bottom = std::max(bottom, mask.top + mask.height - 1);
+  }
+  // Slack around the new area, so a stroke being drawn does not reallocate its mask on every point.
+  constexpr int kSlack = 32;
+  left = std::max(left - kSlack, 0);
+  top = std::max(top - kSlack, 0);
+  right = std::min(right + kSlack, target.width() - 1);
+  bottom = std::min(bottom + kSlack, target.height() - 1);
+
+  CoverageMask grown;
+  grown.left = left;
+  grown.top = top;
+  grown.width = right - left + 1;
+  grown.height = bottom - top + 1;
+  grown.coverage.assign(static_cast<std::size_t>(grown.width) * grown.height, 0);
+  grown.spanStart.assign(grown.height, std::numeric_limits<std::int32_t>::max());
+  grown.spanEnd.assign(grown.height, -1);
+  grown.points = mask.points;
+  for (int mask_row = 0; mask_row < mask.height; ++mask_row) {
+    const auto grown_row = mask_row + mask.top - grown.top;
+    std::memcpy(grown.coverage.data() + static_cast<std::size_t>(grown_row) * grown.width + (mask.left - grown.left),
+                mask.coverage.data() + static_cast<std::size_t>(mask_row) * mask.width,
+                static_cast<std::size_t>(mask.width));
+    grown.spanStart[grown_row] = mask.spanStart[mask_row];
+    grown.spanEnd[grown_row] = mask.spanEnd[mask_row];
+  }
+  mask = std::move(grown);
+}
@@ -0,0 +1,252 @@
+#include "shape_store.hpp"
+
+#include <algorithm>
+
+namespace {
+template <typename T>
+void insertAt(std::vector<T>& column, std::size_t index, T value) {
+  column.insert(column.begin() + static_cast<std::ptrdiff_t>(index), value);
+}
+
+// Inserts a row at `index` (count() to append) under a fresh handle; the rows after it move down by one.
+std::size_t insertRow(ShapeStore& store,
+                      std::size_t index,
+                      ShapeKind shape_kind,
+                      std::uint32_t shape_key,
+                      std::uint32_t shape_revision,
+                      float left,
+                      float top,
+                      float shape_width,
+                      float shape_height,
+                      float brush_size,
+                      std::uint32_t color) {
+  insertAt(store.kind, index, shape_kind);
+  insertAt(store.key, index, shape_key);
+  insertAt(store.createdRevision, index, shape_revision);
+  insertAt(store.revision, index, shape_revision);
+  insertAt(store.x, index, left);
+  insertAt(store.y, index, top);
+  insertAt(store.width, index, shape_width);
+  insertAt(store.height, index, shape_height);
+  insertAt(store.size, index, brush_size);
+  insertAt(store.rgba, index, color);
+  insertAt(store.pointRange, index, PointRange{0, 0, false, false});
+  insertAt(store.labels.ids, index, StringId{});
+  insertAt(store.labels.names, index, StringId{});
+  insertAt(store.labels.colors, index, StringId{});
+
+  std::uint32_t shape_slot = 0;
+  if (store.freeSlots.empty()) {
+    shape_slot = static_cast<std::uint32_t>(store.slotRow.size());
+    store.slotRow.push_back(0);
+    store.slotGeneration.push_back(0);
+  } else {
+    shape_slot = store.freeSlots.back();
+    store.freeSlots.pop_back();
+  }
+  insertAt(store.slot, index, shape_slot);
+  for (auto row = index; row < store.slot.size(); ++row) {
+    store.slotRow[store.slot[row]] = static_cast<std::uint32_t>(row);
+  }
+  return index;
+}
+
+std::size_t pushRow(ShapeStore& store,
+                    ShapeKind shape_kind,
+                    std::uint32_t shape_key,
+                    std::uint32_t shape_revision,
+                    float left,
+                    float top,
+                    float shape_width,
+                    float shape_height,
+                    float brush_size,
+                    std::uint32_t color) {
+  return insertRow(store,
+                   store.count(),
+                   shape_kind,
+                   shape_key,
+                   shape_revision,
+                   left,
+                   top,
+                   shape_width,
+                   shape_height,
+                   brush_size,
+                   color);
+}
+
+// Sets a stroke's box to the bounds of `points`.
+void fitPoints(ShapeStore& store, std::size_t index, std::span<const StrokePoint> points) {
+  auto left = points.front().x;
+  auto top = points.front().y;
+  auto right = left;
+  auto bottom = top;
+  for (const auto& point : points) {
+    left = std::min(left, point.x);
+    top = std::min(top, point.y);
+    right = std::max(right, point.x);
+    bottom = std::max(bottom, point.y);
+  }
+  store.x[index] = left;
+  store.y[index] = top;
+  store.width[index] = right - left;
+  store.height[index] = bottom - top;
+}
+
+template <typename T>
+void eraseAt(std::vector<T>& column, std::size_t index) {
+  column.erase(column.begin() + static_cast<std::ptrdiff_t>(index));
+}
+}  // namespace
+
+std::optional<std::size_t> ShapeStore::find(ShapeHandle handle) const {
+  if (handle.slot >= slotRow.size() || slotGeneration[handle.slot] != handle.generation) {
+    return std::nullopt;
+  }
+  return slotRow[handle.slot];
+}
+
+Bounds ShapeStore::paintBounds(std::size_t index) const {
+  const auto pad = size[index] / 2;
+  const auto right = x[index] + width[index];
+  const auto bottom = y[index] + height[index];
+  return Bounds{std::min(x[index], right) - pad,
+                std::min(y[index], bottom) - pad,
+                std::max(x[index], right) + pad,
+                std::max(y[index], bottom) + pad};
+}
+
+std::size_t ShapeStore::addRectangle(std::uint32_t shape_key,
+                                     std::uint32_t shape_revision,
+                                     float left,
+                                     float top,
+                                     float rect_width,
+                                     float rect_height,
+                                     std::uint32_t color) {
+  return pushRow(*this, ShapeKind::Rectangle, shape_key, shape_revision, left, top, rect_width, rect_height, 0, color);
+}
+
+std::size_t ShapeStore::addStroke(std::uint32_t shape_key,
+                                  std::uint32_t shape_revision,
+                                  StrokePoint first,
+                                  float brush_size,
+                                  std::uint32_t color) {
+  const auto index = pushRow(*this, ShapeKind::Stroke, shape_key, shape_revision, first.x, first.y, 0, 0, brush_size, color);
+  pointRange[index] = pointArena.open(first);
+  return index;
+}
+
+std::size_t ShapeStore::addSealedStroke(std::uint32_t shape_key,
+                                        std::uint32_t shape_revision,
+                                        std::span<const StrokePoint> points,
+                                        float brush_size,
+                                        std::uint32_t color) {
+  const auto index = pushRow(*this, ShapeKind::Stroke, shape_key, shape_revision, 0, 0, 0, 0, brush_size, color);
+  pointRange[index] = pointArena.store(points);
+  fitPoints(*this, index, points);
+  return index;
+}
+
+std::size_t ShapeStore::addSealedStroke(std::uint32_t shape_key,
+                                        std::uint32_t shape_revision,
+                                        PointRange sealed,
+                                        float left,
+                                        float top,
+                                        float box_width,
+                                        float box_height,
+                                        float brush_size,
+                                        std::uint32_t color) {
+  const auto index =
+      pushRow(*this, ShapeKind::Stroke, shape_key, shape_revision, left, top, box_width, box_height, brush_size, color);
+  pointRange[index] = sealed;
+  return index;
+}
+
+void ShapeStore::appendPoint(std::size_t index, StrokePoint point) {
+  pointArena.append(pointRange[index], point);
+  const auto right = std::max(x[index] + width[index], point.x);
+  const auto bottom = std::max(y[index] + height[index], point.y);
+  x[index] = std::min(x[index], point.x);
+  y[index] = std::min(y[index], point.y);
+  width[index] = right - x[index];
+  height[index] = bottom - y[index];
+}
+
+void ShapeStore::replacePoints(std::size_t index, std::span<const StrokePoint> points) {
+  pointArena.assign(pointRange[index], points);
+  fitPoints(*this, index, points);
+}
+
+void ShapeStore::sealPoints(std::size_t index) {
+  pointArena.seal(pointRange[index]);
+}
+
+void ShapeStore::reopenPoints(std::size_t index) {
+  auto& range = pointRange[index];
+  if (range.open || range.length == 0) {
+    return;
+  }
+  const auto sealed = pointArena.points(range);
+  auto reopened = pointArena.open(sealed.front());
+  pointArena.assign(reopened, sealed);
+  range = reopened;
+}
+
+ShapeRecord ShapeStore::record(std::size_t index) const {
+  return ShapeRecord{kind[index],
+                     key[index],
+                     x[index],
+                     y[index],
+                     width[index],
+                     height[index],
+                     size[index],
+                     rgba[index],
+                     pointRange[index],
+                     labels.ids[index],
+                     labels.names[index],
+                     labels.colors[index]};
+}
+
+std::size_t ShapeStore::insert(std::size_t index, const ShapeRecord& shape, std::uint32_t shape_revision) {
+  insertRow(*this,
+            index,
+            shape.kind,
+            shape.key,
+            shape_revision,
+            shape.x,
+            shape.y,
+            shape.width,
+            shape.height,
+            shape.size,
+            shape.rgba);
+  pointRange[index] = shape.points;
+  labels.ids[index] = shape.id;
+  labels.names[index] = shape.name;
+  labels.colors[index] = shape.color;
+  return index;
+}
+
+void ShapeStore::remove(std::size_t index) {
+  pointArena.release(pointRange[index]);
+  const auto freed = slot[index];
+  ++slotGeneration[freed];
+  freeSlots.push_back(freed);
+
+  eraseAt(kind, index);
+  eraseAt(key, index);
+  eraseAt(createdRevision, index);
+  eraseAt(revision, index);
+  eraseAt(x, index);
+  eraseAt(y, index);
+  eraseAt(width, index);
+  eraseAt(height, index);
+  eraseAt(size, index);
+  eraseAt(rgba, index);
+  eraseAt(pointRange, index);
+  eraseAt(labels.ids, index);
+  eraseAt(labels.names, index);
+  eraseAt(labels.colors, index);
+  eraseAt(slot, index);
+  for (auto row = index; row < slot.size(); ++row) {
+    slotRow[slot[row]] = static_cast<std::uint32_t>(row);
+  }
+}
@@ -0,0 +1,202 @@
+#include "spatial_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Keeps cell coordinates inside int32 at the finest level; NaN lands on the lower limit.
+constexpr float kCoordinateLimit = 1e9f;
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+float clampCoordinate(float value) {
+  if (!(value > -kCoordinateLimit)) {
+    return -kCoordinateLimit;
+  }
+  return std::min(value, kCoordinateLimit);
+}
+
+std::int32_t cellOf(float value, float cell_size) {
+  return static_cast<std::int32_t>(std::floor(clampCoordinate(value) / cell_size));
+}
+
+std::uint64_t cellKey(std::int32_t cell_x, std::int32_t cell_y) {
+  return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cell_x)) << 32) | static_cast<std::uint32_t>(cell_y);
+}
+
+float cellSize(std::size_t level) {
+  return SpatialIndex::kBaseCellSize * static_cast<float>(1u << level);
+}
+
+std::uint8_t levelFor(const Bounds& bounds) {
+  const auto extent = std::max(bounds.maxX - bounds.minX, bounds.maxY - bounds.minY);
+  for (std::size_t level = 0; level < SpatialIndex::kLevels; ++level) {
+    if (extent <= cellSize(level)) {
+      return static_cast<std::uint8_t>(level);
+    }
+  }
+  return static_cast<std::uint8_t>(SpatialIndex::kLevels);
+}
+
+bool intersects(const Bounds& first, const Bounds& second) {
+  return first.minX <= second.maxX && second.minX <= first.maxX && first.minY <= second.maxY &&
+         second.minY <= first.maxY;
+}
+
+void eraseSlot(std::vector<std::uint32_t>& slots, std::uint32_t slot) {
+  const auto iterator = std::find(slots.begin(), slots.end(), slot);
+  if (iterator != slots.end()) {
+    *iterator = slots.back();
+    slots.pop_back();
+  }
+}
+}  // namespace
+
+void SpatialIndex::insert(std::uint32_t slot, Bounds bounds) {
+  if (slot >= entries_.size()) {
+    entries_.resize(static_cast<std::size_t>(slot) + 1, Entry{});
+    stamps_.resize(entries_.size(), 0);
+  }
+  if (entries_[slot].present) {
+    unlink(slot);
+  }
+  entries_[slot].bounds = bounds;
+  link(slot);
+}
+
+void SpatialIndex::update(std::uint32_t slot, const Bounds& bounds) {
+  if (slot >= entries_.size() || !entries_[slot].present) {
+    insert(slot, bounds);
+    return;
+  }
+
+  // Same level and still inside the cells it is linked into: only the box changes.
+  auto& entry = entries_[slot];
+  const auto extent = std::max(bounds.maxX - bounds.minX, bounds.maxY - bounds.minY);
+  if (extent > entry.minExtent && extent <= entry.maxExtent && bounds.minX >= entry.cells.minX &&
+      bounds.minY >= entry.cells.minY && bounds.maxX < entry.cells.maxX && bounds.maxY < entry.cells.maxY) {
+    entry.bounds = bounds;
+    return;
+  }
+  unlink(slot);
+  entry.bounds = bounds;
+  link(slot);
+}
+
+void SpatialIndex::remove(std::uint32_t slot) {
+  if (slot < entries_.size() && entries_[slot].present) {
+    unlink(slot);
+  }
+}
+
+void SpatialIndex::link(std::uint32_t slot) {
+  auto& entry = entries_[slot];
+  entry.present = true;
+  entry.level = levelFor(entry.bounds);
+  if (entry.level == kLevels) {
+    entry.cells = Bounds{-kInfinity, -kInfinity, kInfinity, kInfinity};
+    entry.minExtent = cellSize(kLevels - 1);
+    entry.maxExtent = kInfinity;
+    oversized_.push_back(slot);
+    return;
+  }
+
+  const auto size = cellSize(entry.level);
+  entry.cellMinX = cellOf(entry.bounds.minX, size);
+  entry.cellMinY = cellOf(entry.bounds.minY, size);
+  entry.cellMaxX = cellOf(entry.bounds.maxX, size);
+  entry.cellMaxY = cellOf(entry.bounds.maxY, size);
+  entry.cells = Bounds{static_cast<float>(entry.cellMinX) * size,
+                       static_cast<float>(entry.cellMinY) * size,
+                       static_cast<float>(entry.cellMaxX + 1) * size,
+                       static_cast<float>(entry.cellMaxY + 1) * size};
+  entry.minExtent = entry.level == 0 ? -1 : size / 2;
+  entry.maxExtent = size;
+  auto& cells = levels_[entry.level];
+  for (auto cell_y = entry.cellMinY; cell_y <= entry.cellMaxY; ++cell_y) {
+    for (auto cell_x = entry.cellMinX; cell_x <= entry.cellMaxX; ++cell_x) {
+      cells[cellKey(cell_x, cell_y)].push_back(slot);
+    }
+  }
+}
+
+void SpatialIndex::unlink(std::uint32_t slot) {
+  auto& entry = entries_[slot];
+  entry.present = false;
+  if (entry.level == kLevels) {
+    eraseSlot(oversized_, slot);
+    return;
+  }
+
+  auto& cells = levels_[entry.level];
+  for (auto cell_y = entry.cellMinY; cell_y <= entry.cellMaxY; ++cell_y) {
+    for (auto cell_x = entry.cellMinX; cell_x <= entry.cellMaxX; ++cell_x) {
+      const auto iterator = cells.find(cellKey(cell_x, cell_y));
+      if (iterator == cells.end()) {
+        continue;
+      }
+      eraseSlot(iterator->second, slot);
+      if (iterator->second.empty()) {
+        cells.erase(iterator);
+      }
+    }
+  }
+}
+
+void SpatialIndex::query(Bounds area, std::vector<std::uint32_t>& slots) {
+  if (++stamp_ == 0) {
+    std::fill(stamps_.begin(), stamps_.end(), 0);
+    stamp_ = 1;
+  }
+
+  const auto visit = [&](const std::vector<std::uint32_t>& cell) {
+    for (const auto slot : cell) {
+      if (stamps_[slot] != stamp_) {
+        stamps_[slot] = stamp_;
+        if (intersects(entries_[slot].bounds, area)) {
+          slots.push_back(slot);
+        }
+      }
+    }
+  };
+
+  for (std::size_t level = 0; level < kLevels; ++level) {
+    const auto& cells = levels_[level];
+    if (cells.empty()) {
+      continue;
+    }
+
+    const auto size = cellSize(level);
+    const auto min_x = cellOf(area.minX, size);
+    const auto min_y = cellOf(area.minY, size);
+    const auto max_x = cellOf(area.maxX, size);
+    const auto max_y = cellOf(area.maxY, size);
+    const auto span = (static_cast<std::uint64_t>(max_x - min_x) + 1) * (static_cast<std::uint64_t>(max_y - min_y) + 1);
+
+    // Large areas over a sparse level: walking the occupied cells is cheaper than probing every covered one.
+    if (span > cells.size()) {
+      for (const auto& [key, cell] : cells) {
+        const auto cell_x = static_cast<std::int32_t>(static_cast<std::uint32_t>(key >> 32));
+        const auto cell_y = static_cast<std::int32_t>(static_cast<std::uint32_t>(key));
+        if (cell_x >= min_x && cell_x <= max_x && cell_y >= min_y && cell_y <= max_y) {
+          visit(cell);
+        }
+      }
+      continue;
+    }
+
+    for (auto cell_y = min_y; cell_y <= max_y; ++cell_y) {
+      for (auto cell_x = min_x; cell_x <= max_x; ++cell_x) {
+        if (const auto iterator = cells.find(cellKey(cell_x, cell_y)); iterator != cells.end()) {
+          visit(iterator->second);
+        }
+      }
+    }
+  }
+
+  for (const auto slot : oversized_) {
+    if (intersects(entries_[slot].bounds, area)) {
+      slots.push_back(slot);
+    }
+  }
+}
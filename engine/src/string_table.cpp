@@ -0,0 +1,60 @@
+#include "string_table.hpp"
+
+#include <array>
+
+namespace {
+int hexDigit(char character) {
+  if (character >= '0' && character <= '9') {
+    return character - '0';
+  }
+  if (character >= 'a' && character <= 'f') {
+    return character - 'a' + 10;
+  }
+  if (character >= 'A' && character <= 'F') {
+    return character - 'A' + 10;
+  }
+  return 0;
+}
+}  // namespace
+
+std::uint32_t parseColor(std::string_view color) {
+  std::array<std::uint32_t, 4> channels = {0, 0, 0, 255};
+  const auto digits = !color.empty() && color[0] == '#' ? color.substr(1) : color;
+  if (digits.size() == 3) {
+    for (std::size_t index = 0; index < 3; ++index) {
+      channels[index] = static_cast<std::uint32_t>(hexDigit(digits[index]) * 17);
+    }
+  } else if (digits.size() == 6 || digits.size() == 8) {
+    for (std::size_t index = 0; index < digits.size() / 2; ++index) {
+      channels[index] =
+          static_cast<std::uint32_t>(hexDigit(digits[index * 2]) * 16 + hexDigit(digits[index * 2 + 1]));
+    }
+  }
+  return channels[0] | (channels[1] << 8) | (channels[2] << 16) | (channels[3] << 24);
+}
+
+StringId StringTable::intern(std::string_view value) {
+  if (const auto iterator = index_.find(value); iterator != index_.end()) {
+    return iterator->second;
+  }
+  const auto id = static_cast<StringId>(values_.size());
+  const auto& stored = values_.emplace_back(value);
+  index_.emplace(stored, id);
+  rgba_.emplace_back();
+  return id;
+}
+
+std::optional<StringId> StringTable::find(std::string_view value) const {
+  if (const auto iterator = index_.find(value); iterator != index_.end()) {
+    return iterator->second;
+  }
+  return std::nullopt;
+}
+
+std::uint32_t StringTable::rgba(StringId color) {
+  auto& cached = rgba_[static_cast<std::size_t>(color)];
+  if (!cached.has_value()) {
+    cached = parseColor(get(color));
+  }
+  return *cached;
+}
@@ -0,0 +1,91 @@
+#include "tile_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace {
+// Tile indices stay inside int32 for any coordinate the engine can render.
+constexpr float kMaxTileIndex = 1e8f;
+
+std::uint64_t tileKey(std::int32_t column, std::int32_t row) {
+  return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(column)) << 32) | static_cast<std::uint32_t>(row);
+}
+
+std::int32_t tileIndex(float pixel) {
+  return static_cast<std::int32_t>(
+      std::clamp(std::floor(pixel / static_cast<float>(TileCache::kTileSize)), -kMaxTileIndex, kMaxTileIndex));
+}
+}  // namespace
+
+void TileCache::setScale(float scale) {
+  if (scale != scale_) {
+    tiles_.clear();
+    scale_ = scale;
+  }
+}
+
+void TileCache::invalidate(const Bounds& area) {
+  if (tiles_.empty() || !(area.minX <= area.maxX && area.minY <= area.maxY)) {
+    return;
+  }
+  // One device pixel of margin covers the anti-aliased edge the rasterizer adds around the painted area.
+  const auto first_column = tileIndex(area.minX * scale_ - 1);
+  const auto first_row = tileIndex(area.minY * scale_ - 1);
+  const auto last_column = tileIndex(area.maxX * scale_ + 1);
+  const auto last_row = tileIndex(area.maxY * scale_ + 1);
+
+  const auto span = (static_cast<std::uint64_t>(last_column - first_column) + 1) *
+                    (static_cast<std::uint64_t>(last_row - first_row) + 1);
+  if (span > tiles_.size()) {
+    for (auto& [key, tile] : tiles_) {
+      const auto column = static_cast<std::int32_t>(static_cast<std::uint32_t>(key >> 32));
+      const auto row = static_cast<std::int32_t>(static_cast<std::uint32_t>(key));
+      if (column >= first_column && column <= last_column && row >= first_row && row <= last_row) {
+        tile.dirty = true;
+      }
+    }
+    return;
+  }
+
+  for (auto row = first_row; row <= last_row; ++row) {
+    for (auto column = first_column; column <= last_column; ++column) {
+      if (const auto iterator = tiles_.find(tileKey(column, row)); iterator != tiles_.end()) {
+        iterator->second.dirty = true;
+      }
+    }
+  }
+}
+
+void TileCache::dropStroke(std::uint64_t handle) {
+  for (auto& [key, tile] : tiles_) {
+    if (const auto stroke = tile.strokes.find(handle); stroke != tile.strokes.end()) {
+      tile.strokeBytes -= stroke->second.mask.bytes();
+      tile.strokes.erase(stroke);
+    }
+  }
+}
+
+TileCache::Tile& TileCache::tile(std::int32_t column, std::int32_t row) {
+  auto& tile = tiles_[tileKey(column, row)];
+  tile.lastUsed = frame_;
+  return tile;
+}
+
+void TileCache::evict() {
+  if (tiles_.size() <= kMaxTiles) {
+    return;
+  }
+  std::vector<std::pair<std::uint32_t, std::uint64_t>> candidates;
+  for (const auto& [key, tile] : tiles_) {
+    if (tile.lastUsed != frame_) {
+      candidates.emplace_back(tile.lastUsed, key);
+    }
+  }
+  const auto surplus = std::min(tiles_.size() - kMaxTiles, candidates.size());
+  std::nth_element(candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(surplus), candidates.end());
+  for (std::size_t index = 0; index < surplus; ++index) {
+    tiles_.erase(candidates[index].second);
+  }
+}
@@ -0,0 +1,100 @@
+#include "undo_history.hpp"
+
+#include <utility>
+
+std::size_t UndoHistory::entryBytes(const UndoEntry& entry) {
+  return sizeof(UndoEntry) + entry.steps.capacity() * sizeof(UndoStep);
+}
+
+void UndoHistory::beginGroup() {
+  if (groupDepth_++ == 0) {
+    groupStarted_ = false;
+  }
+}
+
+void UndoHistory::endGroup() {
+  if (groupDepth_ == 0) {
+    return;
+  }
+  if (--groupDepth_ == 0) {
+    trim();
+  }
+}
+
+void UndoHistory::record(const UndoStep& step) {
+  for (const auto& entry : redo_) {
+    bytes_ -= entryBytes(entry);
+  }
+  redo_.clear();
+  if (groupDepth_ > 0 && groupStarted_) {
+    auto& entry = undo_.back();
+    bytes_ -= entryBytes(entry);
+    entry.steps.push_back(step);
+    bytes_ += entryBytes(entry);
+    return;
+  }
+  undo_.push_back(UndoEntry{{step}});
+  bytes_ += entryBytes(undo_.back());
+  groupStarted_ = groupDepth_ > 0;
+  if (groupDepth_ == 0) {
+    trim();
+  }
+}
+
+std::optional<UndoEntry> UndoHistory::popUndo() {
+  groupDepth_ = 0;
+  if (undo_.empty()) {
+    return std::nullopt;
+  }
+  auto entry = std::move(undo_.back());
+  undo_.pop_back();
+  bytes_ -= entryBytes(entry);
+  return entry;
+}
+
+std::optional<UndoEntry> UndoHistory::popRedo() {
+  groupDepth_ = 0;
+  if (redo_.empty()) {
+    return std::nullopt;
+  }
+  auto entry = std::move(redo_.back());
+  redo_.pop_back();
+  bytes_ -= entryBytes(entry);
+  return entry;
+}
+
+void UndoHistory::pushUndo(UndoEntry entry) {
+  bytes_ += entryBytes(entry);
+  undo_.push_back(std::move(entry));
+  trim();
+}
+
+void UndoHistory::pushRedo(UndoEntry entry) {
+  bytes_ += entryBytes(entry);
+  redo_.push_back(std::move(entry));
+  trim();
+}
+
+void UndoHistory::setLimit(std::size_t bytes) {
+  limit_ = bytes;
+  trim();
+}
+
+void UndoHistory::clear() {
+  undo_.clear();
+  redo_.clear();
+  bytes_ = 0;
+  groupDepth_ = 0;
+}
+
+// Oldest first: undo entries back to the newest, then the redo entries farthest from the present.
+void UndoHistory::trim() {
+  while (bytes_ > limit_ && undo_.size() > 1) {
+    bytes_ -= entryBytes(undo_.front());
+    undo_.pop_front();
+  }
+  while (bytes_ > limit_ && !redo_.empty()) {
+    bytes_ -= entryBytes(redo_.front());
+    redo_.erase(redo_.begin());
+  }
+}
@@ -0,0 +1,106 @@
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(std::size_t participants) {
+#if FIGMA_ENGINE_THREADS
+  if (participants == 0) {
+    participants = std::max(1u, std::thread::hardware_concurrency());
+  }
+#else
+  participants = 1;
+#endif
+  for (std::size_t index = 0; index < participants; ++index) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (std::size_t participant = 1; participant < participants; ++participant) {
+    threads_.emplace_back([this, participant] { workerLoop(participant); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::run(std::size_t count, const std::function<void(std::size_t, std::size_t)>& task) {
+  if (threads_.empty() || count <= 1) {
+    for (std::size_t index = 0; index < count; ++index) {
+      task(index, 0);
+    }
+    return;
+  }
+
+  // Published before any index is queued: a worker only reads it after taking an index under a queue lock.
+  task_ = &task;
+  remaining_.store(count);
+  for (std::size_t index = 0; index < count; ++index) {
+    auto& queue = *queues_[index % queues_.size()];
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(index);
+  }
+  {
+    std::lock_guard lock(mutex_);
+    ++generation_;
+  }
+  wake_.notify_all();
+
+  drain(0);
+  std::unique_lock lock(mutex_);
+  done_.wait(lock, [this] { return remaining_.load() == 0; });
+  task_ = nullptr;
+}
+
+bool WorkStealingPool::take(std::size_t participant, std::size_t& task) {
+  {
+    auto& own = *queues_[participant];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+    auto& victim = *queues_[(participant + offset) % queues_.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::drain(std::size_t participant) {
+  std::size_t task = 0;
+  while (take(participant, task)) {
+    (*task_)(task, participant);
+    if (remaining_.fetch_sub(1) == 1) {
+      std::lock_guard lock(mutex_);
+      done_.notify_all();
+    }
+  }
+}
+
+void WorkStealingPool::workerLoop(std::size_t participant) {
+  std::uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock lock(mutex_);
+      wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_) {
+        return;
+      }
+      seen = generation_;
+    }
+    drain(participant);
+  }
+}
@@ -0,0 +1,1563 @@
+#include "engine.hpp"
+#include "mapped_file.hpp"
+#include "polyline_simplify.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// Minimal self-contained test runner so the native build has no third-party dependency.
+namespace {
+int failures = 0;
+
+#define EXPECT(condition)                                                          \
+  do {                                                                             \
+    if (!(condition)) {                                                            \
+      std::fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                                  \
+    }                                                                              \
+  } while (false)
+
+template <typename T>
+T read(std::span<const std::uint8_t> bytes, std::size_t offset) {
+  T value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(T));
+  return value;
+}
+
+void appendWord(std::vector<std::uint32_t>& words, float value) {
+  std::uint32_t word;
+  std::memcpy(&word, &value, sizeof(word));
+  words.push_back(word);
+}
+
+void runBatch(Engine& engine, const std::vector<std::uint32_t>& words) {
+  const auto byte_length = static_cast<std::uint32_t>(words.size() * 4);
+  auto buffer = engine.commandBuffer(byte_length);
+  std::memcpy(buffer.data(), words.data(), byte_length);
+  engine.executeBatch(byte_length);
+}
+
+void testCommandsUpdateScene() {
+  Engine engine;
+  engine.createRectangle(10, 20, 30, 40, "#ff0000");
+  engine.startStroke("stroke-1", 1, 2, 4, "#00ff00");
+  engine.updateStroke("stroke-1", 3, 4);
+  engine.finishStroke("stroke-1");
+  engine.updateStroke("stroke-1", 5, 6);
+
+  const auto& shapes = engine.shapes();
+  EXPECT(shapes.count() == 2);
+  EXPECT(shapes.kind[0] == ShapeKind::Rectangle);
+  EXPECT(engine.strings().get(shapes.labels.ids[0]) == "rect-1");
+  EXPECT(shapes.rgba[0] == 0xFF0000FFu);
+  EXPECT(shapes.kind[1] == ShapeKind::Stroke);
+  EXPECT(shapes.points(1).size() == 2);
+  EXPECT(shapes.x[1] == 1.0f && shapes.width[1] == 2.0f);
+  // The move after the finish changed nothing, so it did not count as a revision; nor do repeated presences.
+  EXPECT(engine.revision() == 4);
+  engine.finishStroke("stroke-1");
+  engine.pointerMove(1, 7, 8);
+  engine.pointerMove(1, 7, 8);
+  EXPECT(engine.revision() == 5);
+}
+
+void testSnapshotLayout() {
+  Engine engine;
+  engine.createRectangle(10, 20, 30, 40, "#ff0000");
+  engine.startStroke("stroke-1", 1, 2, 4, "#00ff00");
+  engine.updateStroke("stroke-1", 3, 4);
+  engine.pointerMove(7, 50, 60);
+
+  const auto bytes = engine.tickBinary();
+  EXPECT(read<std::uint32_t>(bytes, 0) == 0x4E53444D);
+  EXPECT(read<std::uint32_t>(bytes, 8) == engine.revision());
+  EXPECT(read<std::uint32_t>(bytes, 12) == 2);
+  EXPECT(read<std::uint32_t>(bytes, 16) == 1);
+  EXPECT(read<std::uint32_t>(bytes, 20) == 2);
+  EXPECT(read<float>(bytes, 32 + 16) == 10.0f);
+  EXPECT(read<std::uint32_t>(bytes, 64) == static_cast<std::uint32_t>(ShapeKind::Stroke));
+  EXPECT(read<std::uint32_t>(bytes, 64 + 24) == 2);
+}
+
+void testDeltaCarriesOnlyAppendedPoints() {
+  Engine engine;
+  engine.startStroke("stroke-1", 1, 2, 4, "#00ff00");
+  const auto base = engine.revision();
+  engine.tickSince(0);
+  engine.updateStroke("stroke-1", 3, 4);
+  engine.updateStroke("stroke-1", 5, 6);
+
+  const auto bytes = engine.tickSince(base);
+  EXPECT(read<std::uint32_t>(bytes, 0) == 0x4C44444D);
+  EXPECT(read<std::uint32_t>(bytes, 8) == 0);
+  EXPECT(read<std::uint32_t>(bytes, 20) == 1);
+  EXPECT(read<std::uint32_t>(bytes, 28) == 2);
+  EXPECT(read<std::uint32_t>(bytes, 40) == static_cast<std::uint32_t>(ChangeOp::AppendPoints));
+  EXPECT(read<std::uint32_t>(bytes, 48 + 28) == 1);
+
+  const auto stale = engine.tickSince(engine.revision() + 10);
+  EXPECT(read<std::uint32_t>(stale, 8) == 1);
+}
+
+void testExecuteBatch() {
+  Engine engine;
+  const auto color = engine.internString("#112233");
+  const auto id = engine.internString("stroke-1");
+  EXPECT(engine.internString("#112233") == color);
+
+  std::vector<std::uint32_t> words;
+  words.push_back(static_cast<std::uint32_t>(CommandOp::StartStroke) | (6u << 16));
+  words.push_back(id);
+  appendWord(words, 1);
+  appendWord(words, 2);
+  appendWord(words, 3);
+  words.push_back(color);
+  words.push_back(static_cast<std::uint32_t>(CommandOp::UpdateStroke) | (4u << 16));
+  words.push_back(id);
+  appendWord(words, 4);
+  appendWord(words, 5);
+  words.push_back(99u | (2u << 16));
+  words.push_back(0);
+  words.push_back(static_cast<std::uint32_t>(CommandOp::PointerMove) | (4u << 16));
+  words.push_back(static_cast<std::uint32_t>(-3));
+  appendWord(words, 6);
+  appendWord(words, 7);
+  runBatch(engine, words);
+
+  EXPECT(engine.shapes().count() == 1);
+  EXPECT(engine.strings().get(engine.shapes().labels.colors[0]) == "#112233");
+  EXPECT(engine.shapes().points(0).size() == 2);
+  EXPECT(engine.presences().count(-3) == 1);
+}
+
+void testDefineStringRecords() {
+  Engine engine;
+  const std::string color = "#abcdef";
+  std::vector<std::uint32_t> words;
+  words.push_back(static_cast<std::uint32_t>(CommandOp::DefineString) | ((3u + 2u) << 16));
+  words.push_back(4);
+  words.push_back(static_cast<std::uint32_t>(color.size()));
+  words.resize(words.size() + 2, 0);
+  std::memcpy(words.data() + 3, color.data(), color.size());
+  words.push_back(static_cast<std::uint32_t>(CommandOp::CreateRectangle) | (6u << 16));
+  appendWord(words, 1);
+  appendWord(words, 2);
+  appendWord(words, 3);
+  appendWord(words, 4);
+  words.push_back(4);
+  words.push_back(static_cast<std::uint32_t>(CommandOp::CreateRectangle) | (6u << 16));
+  words.resize(words.size() + 4, 0);
+  words.push_back(5);
+  runBatch(engine, words);
+
+  EXPECT(engine.shapes().count() == 1);
+  EXPECT(engine.strings().get(engine.shapes().labels.colors[0]) == color);
+  EXPECT(engine.internString(color) == 4);
+}
+void testParseCommandOp() {
+  EXPECT(parseCommandOp("createRectangle") == CommandOp::CreateRectangle);
+  EXPECT(parseCommandOp("finishStroke") == CommandOp::FinishStroke);
+  EXPECT(!parseCommandOp("deleteEverything").has_value());
+}
+
+void testTruncatedRecordIsSkipped() {
+  Engine engine;
+  const auto id = engine.internString("stroke-1");
+  engine.startStroke("stroke-1", 0, 0, 1, "#000");
+  const auto revision = engine.revision();
+  std::vector<std::uint32_t> words;
+  words.push_back(static_cast<std::uint32_t>(CommandOp::UpdateStroke) | (2u << 16));
+  words.push_back(id);
+  runBatch(engine, words);
+
+  EXPECT(engine.revision() == revision);
+  EXPECT(engine.shapes().points(0).size() == 1);
+}
+
+void testSnapshotKeepsZOrder() {
+  Engine engine;
+  engine.startStroke("stroke-1", 0, 0, 2, "#000000");
+  engine.createRectangle(1, 1, 2, 2, "#ffffff");
+  engine.startStroke("stroke-2", 5, 5, 2, "#000000");
+  engine.updateStroke("stroke-2", 6, 6);
+
+  const auto bytes = engine.tickBinary();
+  EXPECT(read<std::uint32_t>(bytes, 12) == 3);
+  EXPECT(read<std::uint32_t>(bytes, 32) == static_cast<std::uint32_t>(ShapeKind::Stroke));
+  EXPECT(read<std::uint32_t>(bytes, 64) == static_cast<std::uint32_t>(ShapeKind::Rectangle));
+  EXPECT(read<std::uint32_t>(bytes, 96) == static_cast<std::uint32_t>(ShapeKind::Stroke));
+  EXPECT(read<std::uint32_t>(bytes, 96 + 20) == 1);
+  EXPECT(read<std::uint32_t>(bytes, 96 + 24) == 2);
+}
+
+void testFinishedStrokesArePacked() {
+  Engine engine;
+  // Collinear samples would otherwise be simplified away on finish.
+  engine.setSimplifyTolerance(0);
+  engine.startStroke("stroke-1", 0, 0, 2, "#000000");
+  engine.startStroke("stroke-2", 10, 10, 2, "#000000");
+  engine.updateStroke("stroke-2", 11, 11);
+  engine.updateStroke("stroke-1", 1, 1);
+  engine.updateStroke("stroke-1", 2.03f, 2);
+  engine.finishStroke("stroke-2");
+  engine.startStroke("stroke-3", 20, 20, 2, "#000000");
+  engine.finishStroke("stroke-1");
+
+  // Both finished strokes went to the packed stream, one after the other; the slab stays empty.
+  const auto& arena = engine.shapes().pointArena;
+  const auto& shapes = engine.shapes();
+  EXPECT(arena.slab().empty());
+  EXPECT(!shapes.pointRange[1].open && shapes.pointRange[1].packed && shapes.pointRange[1].offset == 0);
+  EXPECT(!shapes.pointRange[0].open && shapes.pointRange[0].packed && shapes.pointRange[0].offset > 0);
+  EXPECT(shapes.pointRange[2].open && !shapes.pointRange[2].packed);
+  EXPECT(arena.packed().size() < 5 * sizeof(StrokePoint) / 2);
+  // Finishing snaps points to the 1/16 grid.
+  EXPECT(shapes.points(0)[2].x == 2.0f && shapes.points(1)[1].y == 11.0f);
+  EXPECT(arena.decodedPoints() == 5);
+
+  // The snapshot lays points out stroke by stroke in z order, whichever store they live in.
+  const auto bytes = engine.tickBinary();
+  const auto points_offset = 32 + 3 * 32;
+  EXPECT(read<std::uint32_t>(bytes, 20) == 6);
+  EXPECT(read<std::uint32_t>(bytes, 32 + 20) == 0);
+  EXPECT(read<std::uint32_t>(bytes, 64 + 20) == 3);
+  EXPECT(read<std::uint32_t>(bytes, 96 + 20) == 5);
+  EXPECT(read<float>(bytes, points_offset + 5 * 8) == 20.0f);
+  EXPECT(read<float>(bytes, points_offset + 3 * 8 + 8) == 11.0f);
+}
+
+void testPackedStrokesDecodeThroughACache() {
+  PointArena arena;
+  std::vector<StrokePoint> points;
+  for (int index = 0; index < 1000; ++index) {
+    points.push_back(StrokePoint{static_cast<float>(index) * 0.5f, 100.0f - static_cast<float>(index) / 16});
+  }
+  const auto range = arena.store(points);
+  EXPECT(range.packed && range.length == points.size());
+  // A byte per coordinate for neighbouring samples; the grid byte and the first y's second byte on top.
+  EXPECT(arena.packed().size() == 2 + 2 * points.size());
+  std::vector<StrokePoint> scratch;
+  const auto read = arena.read(range, scratch);
+  EXPECT(read.data() == scratch.data() && arena.decodedPoints() == 0);
+  EXPECT(read[999].x == 499.5f && read[999].y == 100.0f - 999.0f / 16);
+  EXPECT(arena.points(range).data() != scratch.data() && arena.decodedPoints() == points.size());
+  EXPECT(arena.read(range, scratch).data() == arena.points(range).data());
+
+  // Points off every packing grid are kept raw, as are snapped points beyond the grid's range.
+  std::vector<StrokePoint> off_grid = {{0.1f, 0}, {1, 1}};
+  EXPECT(!arena.store(off_grid).packed);
+  std::vector<StrokePoint> far = {{3e7f, 0}, {1, 0.3f}};
+  EXPECT(!PointArena::snapToGrid(far) && far[1].y == 0.3f);
+  EXPECT(PointArena::snapToGrid(off_grid) && off_grid[0].x == 0.125f);
+  EXPECT(arena.slab().size() == 2);
+
+  // Decoding past the budget evicts the least recently used strokes.
+  std::vector<StrokePoint> long_stroke(PointArena::kMaxDecodedPoints, StrokePoint{1, 1});
+  const auto big = arena.store(long_stroke);
+  EXPECT(arena.points(big).size() == long_stroke.size());
+  EXPECT(arena.decodedPoints() == long_stroke.size());
+
+  // Within a frame, the strokes it used stay past the budget until it ends.
+  arena.beginFrame();
+  EXPECT(arena.points(range)[999].x == 499.5f);
+  EXPECT(arena.decodedPoints() == points.size());
+  const auto kept = arena.points(range);
+  EXPECT(arena.points(big).size() == long_stroke.size());
+  EXPECT(arena.decodedPoints() == points.size() + long_stroke.size());
+  EXPECT(kept[999].x == 499.5f);
+  arena.endFrame();
+  EXPECT(arena.decodedPoints() == long_stroke.size());
+}
+
+void testStrokesAreSimplifiedAtIngest() {
+  Engine engine;
+  engine.setSimplifyTolerance(0.5f);
+  const auto stroke = engine.startStroke("stroke-1", 0, 0, 2, "#000000");
+  const auto base = engine.revision();
+  // Jitter around the start is held back while drawing.
+  engine.updateStroke(stroke, 0.2f, 0.1f);
+  engine.updateStroke(stroke, 0.1f, 0.3f);
+  EXPECT(engine.shapes().points(0).size() == 1);
+  // A nearly straight run, then a corner that must survive.
+  for (int step = 1; step <= 20; ++step) {
+    engine.updateStroke(stroke, static_cast<float>(step), step % 2 == 0 ? 0.1f : -0.1f);
+  }
+  engine.updateStroke(stroke, 20, 10);
+  engine.updateStroke(stroke, 20.2f, 10.1f);
+  EXPECT(engine.shapes().points(0).size() == 22);
+  const auto drawn = engine.revision();
+  engine.finishStroke(stroke);
+
+  // The wobble and (20, 10), within tolerance of the final segment, are gone; the corner stays.
+  const auto points = engine.shapes().points(0);
+  EXPECT(points.size() == 3);
+  EXPECT(points[0].x == 0 && points[0].y == 0);
+  EXPECT(points[1].x == 20 && points[1].y == 0.125f);
+  // The held-back release position ends the stroke, snapped to the 1/16 grid like the rest.
+  EXPECT(points[2].x == 20.1875f && points[2].y == 10.125f);
+  EXPECT(engine.shapes().width[0] == 20.1875f && engine.shapes().height[0] == 10.125f);
+
+  // Mirrors get the simplified stroke as one record: Insert since the stroke is new to them.
+  const auto delta = engine.tickSince(base - 1);
+  EXPECT(read<std::uint32_t>(delta, 20) == 1);
+  EXPECT(read<std::uint32_t>(delta, 28) == 3);
+  // A mirror that already has the raw points gets them replaced.
+  const auto update = engine.tickSince(drawn);
+  EXPECT(read<std::uint32_t>(update, 20) == 1 && read<std::uint32_t>(update, 40) == 1);
+  EXPECT(read<std::uint32_t>(update, 28) == 3);
+
+  std::vector<StrokePoint> kept;
+  const std::vector<StrokePoint> loop = {{0, 0}, {10, 0}, {10, 10}, {0, 0.1f}};
+  simplifyPolyline(loop, 0.5f, kept);
+  EXPECT(kept.size() == 4);
+}
+
+void testStringsAreInternedOnce() {
+  Engine engine;
+  engine.createRectangle(0, 0, 1, 1, "#ff8000");
+  engine.createRectangle(2, 2, 1, 1, "#ff8000");
+  engine.startStroke("stroke-1", 0, 0, 1, "#ff8000");
+  engine.pointerMove(1, 0, 0);
+  engine.pointerMove(7, 0, 0);
+
+  const auto& shapes = engine.shapes();
+  EXPECT(shapes.labels.colors[0] == shapes.labels.colors[1]);
+  EXPECT(shapes.labels.colors[0] == shapes.labels.colors[2]);
+  EXPECT(shapes.rgba[2] == 0xFF0080FFu);
+  EXPECT(engine.strings().get(shapes.labels.names[1]) == "Rectangle 2");
+  EXPECT(engine.strings().get(shapes.labels.names[2]) == "Trace 1");
+  EXPECT(engine.presences().at(1).color == engine.presences().at(7).color);
+
+  const auto before = engine.strings().size();
+  engine.updateStroke("unknown", 1, 1);
+  EXPECT(engine.strings().size() == before);
+  EXPECT(engine.internString("#ff8000") == engine.internString("#ff8000"));
+}
+
+void testHandlesSurviveRemoval() {
+  Engine engine;
+  const auto first = engine.createRectangle(0, 0, 1, 1, "#000000");
+  const auto stroke = engine.startStroke("stroke-1", 0, 0, 2, "#000000");
+  const auto last = engine.createRectangle(5, 5, 1, 1, "#000000");
+
+  EXPECT(engine.removeShape(first));
+  EXPECT(!engine.removeShape(first));
+  EXPECT(engine.shapes().count() == 2);
+  EXPECT(engine.shapes().find(stroke) == std::optional<std::size_t>{0});
+  EXPECT(engine.shapes().find(last) == std::optional<std::size_t>{1});
+
+  engine.updateStroke(stroke, 3, 4);
+  EXPECT(engine.shapes().points(0).size() == 2);
+
+  const auto reused = engine.createRectangle(9, 9, 1, 1, "#000000");
+  EXPECT(reused.slot == first.slot && reused.generation != first.generation);
+  EXPECT(!engine.shapes().find(first).has_value());
+
+  EXPECT(engine.removeShape(stroke));
+  engine.updateStroke("stroke-1", 5, 6);
+  EXPECT(engine.shapes().count() == 2);
+  EXPECT(engine.shapes().kind[0] == ShapeKind::Rectangle && engine.shapes().kind[1] == ShapeKind::Rectangle);
+}
+
+void testDeltaReportsRemovals() {
+  Engine engine;
+  const auto kept = engine.createRectangle(0, 0, 1, 1, "#000000");
+  const auto removed = engine.createRectangle(1, 1, 1, 1, "#000000");
+  const auto base = engine.revision();
+  engine.tickSince(0);
+  const auto removed_key = engine.shapes().key[1];
+  engine.removeShape(removed);
+  engine.createRectangle(2, 2, 1, 1, "#000000");
+
+  const auto bytes = engine.tickSince(base);
+  EXPECT(read<std::uint32_t>(bytes, 20) == 2);
+  EXPECT(read<std::uint32_t>(bytes, 40) == static_cast<std::uint32_t>(ChangeOp::Remove));
+  EXPECT(read<std::uint32_t>(bytes, 44) == removed_key);
+  EXPECT(read<std::uint32_t>(bytes, 80) == static_cast<std::uint32_t>(ChangeOp::Insert));
+  EXPECT(read<float>(bytes, 80 + 8 + 16) == 2.0f);
+  EXPECT(engine.shapes().find(kept).has_value());
+}
+
+void testBatchAddressesStrokesByHandle() {
+  Engine engine;
+  const auto id = engine.internString("stroke-1");
+  const auto color = engine.internString("#000000");
+  std::vector<std::uint32_t> words;
+  words.push_back(static_cast<std::uint32_t>(CommandOp::StartStroke) | (6u << 16));
+  words.push_back(id);
+  appendWord(words, 1);
+  appendWord(words, 2);
+  appendWord(words, 3);
+  words.push_back(color);
+  runBatch(engine, words);
+
+  const auto started = engine.startedStrokes();
+  EXPECT(started.size() == 3);
+  EXPECT(started[0] == id);
+  const ShapeHandle handle{started[1], started[2]};
+  EXPECT(engine.shapes().find(handle) == std::optional<std::size_t>{0});
+
+  words.clear();
+  words.push_back(static_cast<std::uint32_t>(CommandOp::UpdateStrokeHandle) | (5u << 16));
+  words.push_back(handle.slot);
+  words.push_back(handle.generation);
+  appendWord(words, 4);
+  appendWord(words, 5);
+  words.push_back(static_cast<std::uint32_t>(CommandOp::FinishStrokeHandle) | (3u << 16));
+  words.push_back(handle.slot);
+  words.push_back(handle.generation);
+  words.push_back(static_cast<std::uint32_t>(CommandOp::UpdateStrokeHandle) | (5u << 16));
+  words.push_back(handle.slot);
+  words.push_back(handle.generation);
+  appendWord(words, 6);
+  appendWord(words, 7);
+  runBatch(engine, words);
+
+  EXPECT(engine.startedStrokes().empty());
+  EXPECT(engine.shapes().points(0).size() == 2);
+  EXPECT(!engine.shapes().pointRange[0].open);
+
+  words.clear();
+  words.push_back(static_cast<std::uint32_t>(CommandOp::RemoveShape) | (3u << 16));
+  words.push_back(handle.slot);
+  words.push_back(handle.generation);
+  runBatch(engine, words);
+  EXPECT(engine.shapes().count() == 0);
+}
+
+std::vector<std::uint32_t> rows(std::span<const std::uint32_t> result) {
+  return std::vector<std::uint32_t>(result.begin(), result.end());
+}
+
+void testSpatialQueries() {
+  Engine engine;
+  engine.createRectangle(0, 0, 10, 10, "#000000");
+  engine.createRectangle(1000, 1000, 10, 10, "#000000");
+  engine.startStroke("stroke-1", 5, 5, 4, "#000000");
+  engine.createRectangle(-1e6f, -1e6f, 2e6f, 2e6f, "#000000");
+
+  EXPECT(rows(engine.queryPoint(1, 1)) == (std::vector<std::uint32_t>{0, 3}));
+  EXPECT(rows(engine.queryPoint(1005, 1005)) == (std::vector<std::uint32_t>{1, 3}));
+  EXPECT(rows(engine.queryRect(-20, -20, 3, 3)) == (std::vector<std::uint32_t>{0, 2, 3}));
+
+  // The stroke grows across many cells; its brush half-width counts.
+  for (int step = 1; step <= 50; ++step) {
+    engine.updateStroke("stroke-1", 5 + static_cast<float>(step) * 10, 5);
+  }
+  EXPECT(rows(engine.queryPoint(506, 5)) == (std::vector<std::uint32_t>{2, 3}));
+  EXPECT(rows(engine.queryPoint(508, 5)) == (std::vector<std::uint32_t>{3}));
+
+  // Corner of the first rectangle is ~14.1 away from (20, 20).
+  EXPECT(rows(engine.queryRadius(20, 20, 14)) == (std::vector<std::uint32_t>{2, 3}));
+  EXPECT(rows(engine.queryRadius(20, 20, 15)) == (std::vector<std::uint32_t>{0, 2, 3}));
+
+  engine.removeShape(engine.shapes().handle(0));
+  EXPECT(rows(engine.queryPoint(1, 1)) == (std::vector<std::uint32_t>{2}));
+  EXPECT(rows(engine.queryPoint(1005, 1005)) == (std::vector<std::uint32_t>{0, 2}));
+}
+void testViewportCullsSnapshot() {
+  Engine engine;
+  engine.resize(100, 100);
+  engine.startStroke("stroke-1", 10, 10, 2, "#000000");
+  engine.updateStroke("stroke-1", 20, 20);
+  engine.finishStroke("stroke-1");
+  engine.createRectangle(5000, 5000, 10, 10, "#ff0000");
+  engine.createRectangle(50, 50, 10, 10, "#00ff00");
+
+  auto bytes = engine.tickVisible();
+  EXPECT(read<std::uint32_t>(bytes, 0) == 0x4E53444D);
+  EXPECT(read<std::uint32_t>(bytes, 12) == 2);
+  EXPECT(read<std::uint32_t>(bytes, 20) == 2);
+  EXPECT(read<std::uint32_t>(bytes, 32) == static_cast<std::uint32_t>(ShapeKind::Stroke));
+  EXPECT(read<std::uint32_t>(bytes, 64 + 4) == 0xFF00FF00u);
+
+  engine.setViewport(4990, 4990, 100, 100);
+  bytes = engine.tickVisible();
+  EXPECT(read<std::uint32_t>(bytes, 12) == 1);
+  EXPECT(read<std::uint32_t>(bytes, 20) == 0);
+  EXPECT(read<float>(bytes, 32 + 16) == 5000.0f);
+  EXPECT(read<std::uint32_t>(engine.tickBinary(), 12) == 3);
+
+  engine.resize(100, 100);
+  EXPECT(read<std::uint32_t>(engine.tickVisible(), 12) == 2);
+}
+// One hex digit per pixel: the top four bits of its alpha.
+std::vector<std::string> alphaRows(const Framebuffer& frame) {
+  std::vector<std::string> rows;
+  for (int y = 0; y < frame.height(); ++y) {
+    std::string row;
+    for (int x = 0; x < frame.width(); ++x) {
+      row += "0123456789abcdef"[frame.pixel(x, y) >> 28];
+    }
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+void testRasterizerGolden() {
+  Framebuffer frame;
+  Rasterizer rasterizer;
+
+  frame.resize(8, 4);
+  frame.clear(0);
+  rasterizer.fillRect(frame, 1.5f, 0.5f, 3, 2, 0xFF000000);
+  EXPECT(alphaRows(frame) == (std::vector<std::string>{"04884000", "08ff8000", "04884000", "00000000"}));
+
+  frame.resize(10, 5);
+  frame.clear(0);
+  const std::vector<StrokePoint> line = {{2, 2.5f}, {7, 2.5f}};
+  rasterizer.strokePolyline(frame, line, 3, 0xFF000000);
+  EXPECT(alphaRows(frame) ==
+         (std::vector<std::string>{"0000000000", "3efffffe30", "8fffffff80", "3efffffe30", "0000000000"}));
+
+  frame.clear(0);
+  const std::vector<StrokePoint> dot = {{4.5f, 2.5f}};
+  rasterizer.strokePolyline(frame, dot, 4, 0xFF000000);
+  EXPECT(alphaRows(frame) ==
+         (std::vector<std::string>{"0004840000", "004fff4000", "008fff8000", "004fff4000", "0004840000"}));
+}
+
+void testTranslucentStrokeCoversOnce() {
+  Framebuffer frame;
+  Rasterizer rasterizer;
+  frame.resize(10, 5);
+  frame.clear(0);
+  // Doubles back over itself: overlapping segments must not stack alpha.
+  const std::vector<StrokePoint> points = {{2, 2}, {8, 2}, {2, 2.5f}, {8, 3}};
+  rasterizer.strokePolyline(frame, points, 3, 0x80000000);
+  std::uint32_t max_alpha = 0;
+  for (int y = 0; y < frame.height(); ++y) {
+    for (int x = 0; x < frame.width(); ++x) {
+      max_alpha = std::max(max_alpha, frame.pixel(x, y) >> 24);
+    }
+  }
+  EXPECT(max_alpha == 128);
+
+  // Half-transparent red over opaque white.
+  frame.clear(0xFFFFFFFF);
+  rasterizer.fillRect(frame, 0, 0, 10, 5, 0x800000FF);
+  EXPECT(frame.pixel(3, 3) == 0xFF7F7FFFu);
+}
+
+// Random premultiplied pixels: no channel above alpha.
+std::vector<std::uint32_t> randomPixels(std::mt19937& random, std::size_t count) {
+  std::vector<std::uint32_t> pixels(count);
+  for (auto& pixel : pixels) {
+    const auto alpha = random() % 256;
+    const auto channel = [&] { return static_cast<std::uint32_t>(random() % (alpha + 1)); };
+    pixel = (alpha << 24) | (channel() << 16) | (channel() << 8) | channel();
+  }
+  return pixels;
+}
+
+void testSimdKernelsMatchScalar() {
+  const auto& scalar = scalarPixelKernels();
+  const auto& fast = pixelKernels();
+  std::mt19937 random(7);
+  // Odd lengths exercise the scalar tails of the vector loops.
+  for (const std::size_t count : {1u, 3u, 4u, 37u}) {
+    for (const std::uint32_t color : {0xFF2050C0u, 0x80402010u, 0x01010101u}) {
+      for (const std::uint32_t coverage : {0u, 1u, 77u, 128u, 254u, 255u}) {
+        auto expected = randomPixels(random, count);
+        auto actual = expected;
+        scalar.blend(expected.data(), count, color, coverage);
+        fast.blend(actual.data(), count, color, coverage);
+        EXPECT(expected == actual);
+      }
+
+      std::vector<std::uint8_t> mask(count);
+      for (std::size_t index = 0; index < count; ++index) {
+        const auto pick = random() % 4;
+        mask[index] = pick == 0 ? 0 : pick == 1 ? 255 : static_cast<std::uint8_t>(random() % 256);
+      }
+      auto expected = randomPixels(random, count);
+      auto actual = expected;
+      scalar.blendMask(expected.data(), mask.data(), count, color);
+      fast.blendMask(actual.data(), mask.data(), count, color);
+      EXPECT(expected == actual);
+    }
+  }
+
+  std::uniform_real_distribution<float> coordinate(-40, 40);
+  for (int trial = 0; trial < 200; ++trial) {
+    const auto dx = coordinate(random);
+    const auto dy = trial % 5 == 0 ? 0.0f : coordinate(random);
+    const auto length_squared = dx * dx + dy * dy;
+    const CapsuleRow row{static_cast<int>(random() % 50), coordinate(random) + 50, coordinate(random), dx, dy,
+                         length_squared > 0 ? 1 / length_squared : 0.0f, static_cast<float>(random() % 80) / 8 + 0.5f};
+    std::vector<std::uint8_t> expected(61);
+    for (auto& value : expected) {
+      value = static_cast<std::uint8_t>(random() % 3 == 0 ? random() % 256 : 0);
+    }
+    auto actual = expected;
+    scalar.accumulateCapsule(expected.data(), expected.size(), row);
+    fast.accumulateCapsule(actual.data(), actual.size(), row);
+    EXPECT(expected == actual);
+  }
+
+  // Whole primitives, edges included.
+  Framebuffer expected;
+  Framebuffer actual;
+  Rasterizer scalar_rasterizer;
+  scalar_rasterizer.setKernels(scalar);
+  Rasterizer rasterizer;
+  for (auto* frame : {&expected, &actual}) {
+    frame->resize(67, 41);
+    frame->clear(0xFFF0E0D0);
+  }
+  const std::vector<StrokePoint> points = {{3.3f, 4.1f}, {60.2f, 12.7f}, {20.5f, 38.9f}, {21, 39}};
+  for (auto* raster : {&scalar_rasterizer, &rasterizer}) {
+    auto& frame = raster == &rasterizer ? actual : expected;
+    raster->setTransform(-0.3f, 0.2f, 1.1f);
+    raster->fillRect(frame, 2.6f, 3.2f, 40.7f, 20.3f, 0xC03060F0);
+    raster->fillRect(frame, 10.1f, 30.4f, 0.4f, 5, 0xFF000000);
+    raster->strokePolyline(frame, points, 5.5f, 0x9000A0FF);
+    raster->strokePolyline(frame, points, 2, 0xFF102030);
+  }
+  EXPECT(std::memcmp(expected.bytes().data(), actual.bytes().data(), expected.bytes().size()) == 0);
+}
+
+void testRenderViewport() {
+  Engine engine;
+  engine.resize(16, 8);
+  engine.setViewport(4, 0, 8, 8);
+  engine.createRectangle(0, 0, 6, 4, "#ff0000");
+  engine.startStroke("stroke-1", 100, 100, 4, "#000000");
+
+  const auto frame = engine.render(2);
+  EXPECT(frame.left == 8 && frame.top == 0 && frame.width == 16 && frame.height == 16);
+  EXPECT(frame.pixels.size() == 16 * 16 * 4);
+  const auto pixel = [&](int x, int y) { return read<std::uint32_t>(frame.pixels, (y * frame.width + x) * 4); };
+  EXPECT(pixel(0, 0) == 0xFF0000FFu);
+  EXPECT(pixel(3, 7) == 0xFF0000FFu);
+  EXPECT(pixel(4, 0) == 0xFFFFFFFFu);
+  EXPECT(pixel(0, 8) == 0xFFFFFFFFu);
+}
+void testTilesRedrawOnlyWhatChanged() {
+  Engine engine;
+  engine.resize(512, 256);
+  const auto rectangle = engine.createRectangle(10, 10, 20, 20, "#ff0000");
+  engine.startStroke("stroke-1", 300, 100, 4, "#000000");
+
+  auto frame = engine.render(1);
+  EXPECT(frame.tilesRendered == 2);
+  EXPECT(frame.dirtyLeft == 0 && frame.dirtyWidth == 512 && frame.dirtyHeight == 256);
+
+  frame = engine.render(1);
+  EXPECT(frame.tilesRendered == 0 && frame.dirtyWidth == 0 && frame.dirtyHeight == 0);
+
+  engine.updateStroke("stroke-1", 310, 100);
+  frame = engine.render(1);
+  EXPECT(frame.tilesRendered == 1);
+  EXPECT(frame.dirtyLeft == 256 && frame.dirtyWidth == 256);
+
+  // Scrolling reuses the cached tiles and only rasterizes the one that came into view.
+  engine.setViewport(100, 0, 512, 256);
+  frame = engine.render(1);
+  EXPECT(frame.left == 100 && frame.tilesRendered == 1);
+  EXPECT(frame.dirtyLeft == 0 && frame.dirtyWidth == 512);
+
+  engine.removeShape(rectangle);
+  frame = engine.render(1);
+  EXPECT(frame.tilesRendered == 1 && frame.dirtyLeft == 0 && frame.dirtyWidth == 156);
+  EXPECT(read<std::uint32_t>(frame.pixels, 0) == 0xFFFFFFFFu);
+
+  // A new scale drops the cache: device pixels 200..1224 x 0..512 span 5 x 2 tiles.
+  frame = engine.render(2);
+  EXPECT(frame.tilesRendered == 10);
+}
+
+// Every shape of `engine` drawn straight into one frame at scale 1, bypassing tiles and caches.
+bool matchesDirectRasterization(const Engine& engine, const RenderedFrame& frame) {
+  Framebuffer expected;
+  Rasterizer rasterizer;
+  expected.resize(frame.width, frame.height);
+  expected.clear(0xFFFFFFFF);
+  rasterizer.setTransform(static_cast<float>(frame.left), static_cast<float>(frame.top), 1);
+  const auto& shapes = engine.shapes();
+  for (std::size_t index = 0; index < shapes.count(); ++index) {
+    if (shapes.kind[index] == ShapeKind::Rectangle) {
+      rasterizer.fillRect(
+          expected, shapes.x[index], shapes.y[index], shapes.width[index], shapes.height[index], shapes.rgba[index]);
+    } else {
+      rasterizer.strokePolyline(expected, shapes.points(index), shapes.size[index], shapes.rgba[index]);
+    }
+  }
+  return frame.pixels.size() == expected.bytes().size() &&
+         std::memcmp(frame.pixels.data(), expected.bytes().data(), frame.pixels.size()) == 0;
+}
+
+void testTilesMatchDirectRasterization() {
+  Engine engine;
+  engine.resize(512, 512);
+  engine.createRectangle(200, 240, 100, 40, "#3366ff80");
+  engine.startStroke("stroke-1", 240, 200, 9, "#000000c0");
+  engine.updateStroke("stroke-1", 270, 300);
+  engine.updateStroke("stroke-1", 250, 258.5f);
+  engine.createRectangle(255.5f, 255.5f, 1, 1, "#00ff00");
+  EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+}
+
+void testStrokeMaskGrowsIncrementally() {
+  std::vector<StrokePoint> points;
+  for (int index = 0; index < 120; ++index) {
+    const auto angle = static_cast<float>(index) * 0.21f;
+    points.push_back({40 + angle * 9 * std::cos(angle), 35 + angle * 7 * std::sin(angle)});
+  }
+  Framebuffer expected;
+  Framebuffer actual;
+  for (auto* frame : {&expected, &actual}) {
+    frame->resize(96, 80);
+    frame->clear(0xFFFFFFFF);
+  }
+  Rasterizer rasterizer;
+  rasterizer.setTransform(-3.5f, 2.25f, 0.75f);
+  rasterizer.strokePolyline(expected, points, 5, 0xA0336699);
+
+  // Appended a few points at a time, the mask grows well past its first extent.
+  CoverageMask mask;
+  for (std::size_t count = 1; count <= points.size(); count += count % 7 + 1) {
+    rasterizer.accumulateStroke(mask, actual, std::span(points).first(count), 5);
+  }
+  rasterizer.accumulateStroke(mask, actual, points, 5);
+  EXPECT(mask.points == points.size());
+  rasterizer.compositeMask(actual, mask, 0xA0336699);
+  EXPECT(std::memcmp(expected.bytes().data(), actual.bytes().data(), expected.bytes().size()) == 0);
+}
+
+void testCachedStrokesMatchDirectRasterization() {
+  Engine engine;
+  engine.resize(700, 600);
+  const auto stroke = engine.startStroke("long", 20, 20, 7, "#aa2200c0");
+  for (int index = 1; index <= 400; ++index) {
+    const auto angle = static_cast<float>(index) * 0.05f;
+    engine.updateStroke("long", 350 + angle * 14 * std::cos(angle), 300 + angle * 12 * std::sin(angle));
+    if (index % 25 == 0) {
+      // Redraws the tiles under the new points with the stroke's coverage cached from the previous frames.
+      EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+    }
+  }
+  engine.finishStroke("long");
+  engine.createRectangle(300, 250, 120, 90, "#0044ff60");
+  EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+
+  // A removed stroke must not linger in the tiles' caches.
+  engine.removeShape(stroke);
+  EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+}
+
+void testSimplifiedStrokeRedrawsItsTiles() {
+  Engine engine;
+  engine.resize(600, 300);
+  const auto stroke = engine.startStroke("stroke-1", 10, 150, 6, "#223344");
+  for (int step = 1; step <= 400; ++step) {
+    const auto x = 10 + static_cast<float>(step) * 1.4f;
+    engine.updateStroke(stroke, x, 150 + 40 * std::sin(x / 60) + (step % 3 == 0 ? 0.2f : 0.0f));
+    if (step % 50 == 0) {
+      engine.render(1);
+    }
+  }
+  engine.render(1);
+  const auto drawn = engine.shapes().points(0).size();
+  engine.finishStroke(stroke);
+  EXPECT(engine.shapes().points(0).size() < drawn / 2);
+  // Coverage cached from the raw points must not survive the simplification.
+  EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+}
+
+void testWorkStealingPoolRunsEveryTaskOnce() {
+  WorkStealingPool pool(4);
+  std::vector<std::atomic<int>> calls(1000);
+  std::atomic<bool> bad_participant = false;
+  for (int round = 0; round < 20; ++round) {
+    pool.run(calls.size(), [&](std::size_t index, std::size_t participant) {
+      calls[index].fetch_add(1);
+      if (participant >= pool.size()) {
+        bad_participant = true;
+      }
+    });
+  }
+  EXPECT(std::all_of(calls.begin(), calls.end(), [](const std::atomic<int>& count) { return count.load() == 20; }));
+  EXPECT(!bad_participant);
+}
+
+void testParallelTilesMatchSerial() {
+  const auto draw = [](Engine& engine) {
+    engine.resize(2000, 1200);
+    for (int index = 0; index < 200; ++index) {
+      const auto x = static_cast<float>((index * 97) % 1900);
+      const auto y = static_cast<float>((index * 53) % 1100);
+      if (index % 3 == 0) {
+        engine.createRectangle(x, y, 120, 80, "#ff000080");
+        continue;
+      }
+      const auto id = "stroke-" + std::to_string(index);
+      engine.startStroke(id, x, y, 6, "#0000ffc0");
+      for (int step = 1; step < 40; ++step) {
+        engine.updateStroke(id, x + static_cast<float>(step * 7), y + static_cast<float>((step * step) % 90));
+      }
+      engine.finishStroke(id);
+    }
+  };
+  Engine serial;
+  serial.setRenderThreads(1);
+  draw(serial);
+  Engine parallel;
+  parallel.setRenderThreads(4);
+  draw(parallel);
+
+  const auto expected = serial.render(1.5f);
+  const auto frame = parallel.render(1.5f);
+  EXPECT(frame.tilesRendered == expected.tilesRendered && frame.tilesRendered > 16);
+  EXPECT(frame.pixels.size() == expected.pixels.size());
+  EXPECT(std::memcmp(frame.pixels.data(), expected.pixels.data(), frame.pixels.size()) == 0);
+}
+
+std::vector<std::uint8_t> saveDocument(Engine& engine, std::size_t* chunks = nullptr) {
+  std::vector<std::uint8_t> bytes;
+  engine.beginSave();
+  for (auto chunk = engine.saveChunk(); !chunk.empty(); chunk = engine.saveChunk()) {
+    bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+    if (chunks != nullptr) {
+      ++*chunks;
+    }
+  }
+  return bytes;
+}
+
+// Feeds the document in `piece`-byte slices, as a stream reader would.
+bool loadDocument(Engine& engine, std::span<const std::uint8_t> bytes, std::size_t piece) {
+  engine.beginLoad();
+  for (std::size_t offset = 0; offset < bytes.size(); offset += piece) {
+    engine.loadChunk(bytes.subspan(offset, std::min(piece, bytes.size() - offset)));
+  }
+  return engine.finishLoad();
+}
+
+// A board big enough to be saved in several chunks: random-walk strokes and rectangles.
+void drawBoard(Engine& engine) {
+  engine.setSimplifyTolerance(0);
+  std::mt19937 random(21);
+  std::uniform_real_distribution<float> step(-3, 3);
+  for (int index = 0; index < 120; ++index) {
+    const auto color = index % 2 == 0 ? "#ff0000" : "#00ff0080";
+    engine.createRectangle(static_cast<float>(index * 13 % 900), 7.25f, 30, 20, color);
+    const auto id = "walk-" + std::to_string(index);
+    auto x = static_cast<float>(index * 37 % 1200);
+    auto y = static_cast<float>(index * 17 % 700);
+    const auto stroke = engine.startStroke(id, x, y, 3, "#2563eb");
+    for (int point = 1; point < 1000; ++point) {
+      x += step(random);
+      y += step(random);
+      engine.updateStroke(stroke, x, y);
+    }
+    engine.finishStroke(stroke);
+  }
+}
+
+void testDocumentRoundTrip() {
+  Engine original;
+  original.resize(640, 480);
+  drawBoard(original);
+  const auto removed = original.createRectangle(1, 1, 1, 1, "#123456");
+  original.removeShape(removed);
+  // Beyond what quantized coordinates can hold: stored as raw floats.
+  original.startStroke("far", 3e7f, -3e7f, 2, "#000000");
+  original.updateStroke("far", 3e7f + 0.1f, 12.3456f);
+  original.finishStroke("far");
+  // Saved with the points it has so far.
+  original.startStroke("open", 5, 5, 4, "#abcdef");
+  original.updateStroke("open", 50.3f, 60.7f);
+
+  std::size_t chunks = 0;
+  const auto bytes = saveDocument(original, &chunks);
+  std::size_t point_count = 0;
+  const auto& source = original.shapes();
+  for (std::size_t index = 0; index < source.count(); ++index) {
+    point_count += source.pointRange[index].length;
+  }
+  EXPECT(chunks > 1);
+  // Delta+varint points take well under the 8 bytes of a raw f32 pair.
+  EXPECT(bytes.size() < point_count * 4);
+
+  Engine loaded;
+  loaded.resize(640, 480);
+  const auto stale = loaded.createRectangle(0, 0, 10, 10, "#ffffff");
+  const auto before = loaded.revision();
+  EXPECT(loadDocument(loaded, bytes, 7));
+  EXPECT(!loaded.shapes().find(stale).has_value());
+
+  const auto& shapes = loaded.shapes();
+  EXPECT(shapes.count() == source.count());
+  bool same = shapes.count() == source.count();
+  for (std::size_t index = 0; same && index < shapes.count(); ++index) {
+    same = shapes.kind[index] == source.kind[index] && shapes.rgba[index] == source.rgba[index] &&
+           shapes.size[index] == source.size[index] && !shapes.pointRange[index].open &&
+           loaded.strings().get(shapes.labels.ids[index]) == original.strings().get(source.labels.ids[index]) &&
+           loaded.strings().get(shapes.labels.names[index]) == original.strings().get(source.labels.names[index]) &&
+           loaded.strings().get(shapes.labels.colors[index]) == original.strings().get(source.labels.colors[index]);
+    if (shapes.kind[index] == ShapeKind::Rectangle) {
+      same = same && shapes.x[index] == source.x[index] && shapes.y[index] == source.y[index] &&
+             shapes.width[index] == source.width[index] && shapes.height[index] == source.height[index];
+      continue;
+    }
+    const auto points = shapes.points(index);
+    const auto expected = source.points(index);
+    same = same && points.size() == expected.size();
+    for (std::size_t point = 0; same && point < points.size(); ++point) {
+      same = std::abs(points[point].x - expected[point].x) <= 1.0f / 128 &&
+             std::abs(points[point].y - expected[point].y) <= 1.0f / 128;
+    }
+  }
+  EXPECT(same);
+  const auto far = shapes.points(shapes.count() - 2);
+  EXPECT(far[0].x == 3e7f && far[1].y == 12.3456f);
+
+  // Generated names carry on after the loaded ones, mirrors are resynced and tiles follow the new shapes.
+  EXPECT(loaded.revision() > before);
+  EXPECT((read<std::uint32_t>(loaded.tickSince(before), 8) & 1) == 1);
+  EXPECT(read<std::uint32_t>(loaded.tickSince(before), 20) == shapes.count());
+  EXPECT(matchesDirectRasterization(loaded, loaded.render(1)));
+  loaded.createRectangle(0, 0, 1, 1, "#000000");
+  EXPECT(loaded.strings().get(shapes.labels.ids[shapes.count() - 1]) == "rect-122");
+  EXPECT(loaded.shapes().key[shapes.count() - 1] == shapes.count());
+}
+
+void testLoadRetiresOldHandles() {
+  Engine small;
+  small.createRectangle(0, 0, 1, 1, "#000000");
+  small.createRectangle(2, 2, 1, 1, "#000000");
+  const auto bytes = saveDocument(small);
+
+  // Slots beyond the loaded document's two are reused by later shapes without resolving old handles.
+  Engine engine;
+  for (int index = 0; index < 10; ++index) {
+    engine.createRectangle(static_cast<float>(index), 0, 1, 1, "#ff0000");
+  }
+  const auto drawing = engine.startStroke("drawing", 0, 0, 2, "#000000");
+  const auto first = engine.shapes().handle(0);
+  EXPECT(loadDocument(engine, bytes, 4096));
+  EXPECT(!engine.shapes().find(first).has_value());
+  for (int index = 0; index < 12; ++index) {
+    engine.startStroke("stroke-" + std::to_string(index), 0, 0, 2, "#000000");
+  }
+  EXPECT(engine.shapes().slotGeneration.size() == 14);
+  EXPECT(!engine.shapes().find(drawing).has_value());
+  engine.updateStroke(drawing, 50, 50);
+  for (std::size_t row = 2; row < engine.shapes().count(); ++row) {
+    EXPECT(engine.shapes().pointRange[row].length == 1);
+  }
+}
+
+void testDocumentLoadRejectsDamage() {
+  const std::string check = "123456789";
+  EXPECT(crc32(std::span(reinterpret_cast<const std::uint8_t*>(check.data()), check.size())) == 0xCBF43926u);
+
+  Engine original;
+  drawBoard(original);
+  const auto bytes = saveDocument(original);
+
+  Engine target;
+  target.createRectangle(1, 2, 3, 4, "#ff0000");
+  // Nor are the strings of a rejected document left in its table.
+  const auto strings = target.strings().size();
+  const auto keeps_its_shape = [&target, strings] {
+    return target.shapes().count() == 1 && target.shapes().x[0] == 1 && target.strings().size() == strings;
+  };
+
+  auto damaged = bytes;
+  damaged[damaged.size() / 2] ^= 0x40;
+  EXPECT(!loadDocument(target, damaged, 4096));
+  EXPECT(keeps_its_shape());
+
+  EXPECT(!loadDocument(target, std::span<const std::uint8_t>(bytes).first(bytes.size() - 1), 4096));
+  EXPECT(keeps_its_shape());
+
+  auto extended = bytes;
+  extended.push_back(0);
+  EXPECT(!loadDocument(target, extended, bytes.size()));
+  EXPECT(keeps_its_shape());
+
+  auto foreign = bytes;
+  foreign[0] = 'X';
+  target.beginLoad();
+  EXPECT(!target.loadChunk(foreign));
+  EXPECT(!target.finishLoad());
+  EXPECT(keeps_its_shape());
+
+  // An edit during a save cuts it short; what was written does not load.
+  original.beginSave();
+  const auto first = original.saveChunk();
+  std::vector<std::uint8_t> partial(first.begin(), first.end());
+  original.createRectangle(0, 0, 1, 1, "#000000");
+  EXPECT(original.saveChunk().empty());
+  EXPECT(!loadDocument(target, partial, partial.size()));
+  EXPECT(keeps_its_shape());
+  EXPECT(loadDocument(target, bytes, bytes.size()));
+  EXPECT(target.shapes().count() == 240);
+}
+
+std::vector<std::uint8_t> saveArchive(Engine& engine) {
+  std::vector<std::uint8_t> bytes;
+  engine.beginArchiveSave();
+  for (auto chunk = engine.saveChunk(); !chunk.empty(); chunk = engine.saveChunk()) {
+    bytes.insert(bytes.end(), chunk.begin(), chunk.end());
+  }
+  return bytes;
+}
+
+// Archive bytes in a heap block the engine can hold on to, as Embind's archiveBuffer() does.
+std::shared_ptr<const std::vector<std::uint8_t>> archiveOwner(const std::vector<std::uint8_t>& bytes) {
+  return std::make_shared<const std::vector<std::uint8_t>>(bytes);
+}
+
+// Shapes match in order; stroke points and boxes within `tolerance` (0 for exact), everything else exactly.
+bool sameShapes(const Engine& engine, const Engine& expected, float tolerance = 0) {
+  const auto& shapes = engine.shapes();
+  const auto& source = expected.shapes();
+  if (shapes.count() != source.count()) {
+    return false;
+  }
+  const auto close = [tolerance](float value, float expected_value) {
+    return std::abs(value - expected_value) <= tolerance;
+  };
+  for (std::size_t index = 0; index < shapes.count(); ++index) {
+    const auto points = shapes.points(index);
+    const auto expected_points = source.points(index);
+    if (shapes.kind[index] != source.kind[index] || shapes.rgba[index] != source.rgba[index] ||
+        shapes.size[index] != source.size[index] || !close(shapes.x[index], source.x[index]) ||
+        !close(shapes.y[index], source.y[index]) || !close(shapes.width[index], source.width[index]) ||
+        !close(shapes.height[index], source.height[index]) || points.size() != expected_points.size() ||
+        engine.strings().get(shapes.labels.ids[index]) != expected.strings().get(source.labels.ids[index]) ||
+        engine.strings().get(shapes.labels.names[index]) != expected.strings().get(source.labels.names[index]) ||
+        engine.strings().get(shapes.labels.colors[index]) != expected.strings().get(source.labels.colors[index])) {
+      return false;
+    }
+    for (std::size_t point = 0; point < points.size(); ++point) {
+      if (!close(points[point].x, expected_points[point].x) || !close(points[point].y, expected_points[point].y)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void testArchiveOpensInPlace() {
+  Engine original;
+  original.resize(640, 480);
+  drawBoard(original);
+  original.startStroke("far", 3e7f, -3e7f, 2, "#000000");
+  original.updateStroke("far", 3e7f + 0.1f, 12.3456f);
+  original.finishStroke("far");
+  const auto bytes = saveArchive(original);
+  EXPECT(read<std::uint32_t>(bytes, 0) == 0x5241444D);
+
+  // Points are used where they lie in the archive, not copied.
+  Engine opened;
+  opened.resize(640, 480);
+  const auto stale = opened.createRectangle(0, 0, 10, 10, "#ffffff");
+  const auto owner = archiveOwner(bytes);
+  EXPECT(opened.openArchive(*owner, owner));
+  EXPECT(!opened.shapes().find(stale).has_value());
+  EXPECT(sameShapes(opened, original));
+  const auto mapped = opened.shapes().pointArena.mapped();
+  std::size_t point_count = 0;
+  for (std::size_t index = 0; index < original.shapes().count(); ++index) {
+    point_count += original.shapes().pointRange[index].length;
+  }
+  EXPECT(mapped.size() == point_count);
+  EXPECT(reinterpret_cast<const std::uint8_t*>(mapped.data()) >= owner->data() &&
+         reinterpret_cast<const std::uint8_t*>(mapped.data() + mapped.size()) <= owner->data() + owner->size());
+  EXPECT(opened.shapes().pointArena.slab().empty());
+  EXPECT(matchesDirectRasterization(opened, opened.render(1)));
+
+  // Edits carry on after the archived points; the snapshot lays both out in one points section.
+  opened.setSimplifyTolerance(0);
+  opened.startStroke("after", 1, 2, 2, "#000000");
+  opened.updateStroke("after", 3, 4);
+  opened.finishStroke("after");
+  const auto& shapes = opened.shapes();
+  const auto last = shapes.count() - 1;
+  EXPECT(shapes.pointRange[last].packed);
+  EXPECT(shapes.points(last)[1].x == 3.0f);
+  const auto snapshot = opened.tickBinary();
+  const auto points_offset = 32 + shapes.count() * 32;
+  EXPECT(read<std::uint32_t>(snapshot, 32 + last * 32 + 20) == mapped.size());
+  EXPECT(read<float>(snapshot, points_offset + mapped.size() * 8 + 8) == 3.0f);
+  EXPECT(read<float>(snapshot, points_offset + 8) == original.shapes().points(1)[1].x);
+
+  // Saving from an opened archive, in either layout, reads the mapped points back out.
+  Engine reloaded;
+  EXPECT(loadDocument(reloaded, saveDocument(opened), 4096));
+  EXPECT(reloaded.shapes().count() == shapes.count());
+  Engine reopened;
+  const auto resaved = archiveOwner(saveArchive(opened));
+  EXPECT(reopened.openArchive(*resaved, resaved));
+  EXPECT(sameShapes(reopened, opened));
+
+  // Through a file mapping, as a native host opens large archives.
+  const auto path = (std::filesystem::temp_directory_path() / "figma_engine_archive_test.mdar").string();
+  std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()),
+                                              static_cast<std::streamsize>(bytes.size()));
+  const auto file = MappedFile::open(path);
+  std::filesystem::remove(path);
+  EXPECT(file != nullptr);
+  if (file != nullptr) {
+    Engine from_file;
+    EXPECT(from_file.openArchive(file->bytes(), file));
+    EXPECT(sameShapes(from_file, original));
+  }
+  EXPECT(MappedFile::open(path) == nullptr);
+}
+
+void testArchiveOpenRejectsDamage() {
+  Engine original;
+  drawBoard(original);
+  const auto bytes = saveArchive(original);
+
+  Engine target;
+  target.createRectangle(1, 2, 3, 4, "#ff0000");
+  const auto strings = target.strings().size();
+  const auto rejects = [&target, strings](std::vector<std::uint8_t> damaged) {
+    const auto owner = archiveOwner(damaged);
+    return !target.openArchive(*owner, owner) && target.shapes().count() == 1 && target.shapes().x[0] == 1 &&
+           target.strings().size() == strings;
+  };
+  const auto shapes_section = read<std::uint64_t>(bytes, 16 + 24 + 8);
+  const auto patched = [&bytes](std::size_t offset, auto value) {
+    auto damaged = bytes;
+    std::memcpy(damaged.data() + offset, &value, sizeof(value));
+    return damaged;
+  };
+
+  EXPECT(rejects(std::vector<std::uint8_t>(bytes.begin(), bytes.begin() + 8)));
+  EXPECT(rejects(patched(0, std::uint32_t{0})));
+  // A section running past the end, truncation, and a count that disagrees with its section.
+  EXPECT(rejects(patched(16 + 2 * 24 + 16, std::uint64_t{1} << 62)));
+  EXPECT(rejects(std::vector<std::uint8_t>(bytes.begin(), bytes.end() - 1)));
+  EXPECT(rejects(patched(read<std::uint64_t>(bytes, 16 + 8), std::uint64_t{7})));
+  // Shape records pointing outside the points or strings, or of an unknown kind.
+  EXPECT(rejects(patched(shapes_section + 56 + 40, std::uint64_t{1} << 40)));
+  EXPECT(rejects(patched(shapes_section + 56 + 48, std::uint32_t{0xFFFFFFFF})));
+  EXPECT(rejects(patched(shapes_section + 8, std::uint32_t{1000})));
+  EXPECT(rejects(patched(shapes_section, std::uint32_t{9})));
+
+  // An edit during an archive save cuts it short as well.
+  original.beginArchiveSave();
+  EXPECT(!original.saveChunk().empty());
+  original.createRectangle(0, 0, 1, 1, "#000000");
+  EXPECT(original.saveChunk().empty());
+
+  const auto owner = archiveOwner(bytes);
+  EXPECT(target.openArchive(*owner, owner));
+  EXPECT(target.shapes().count() == 240);
+  // Replacing the document releases the archive.
+  EXPECT(loadDocument(target, saveDocument(target), 4096));
+  EXPECT(owner.use_count() == 1);
+}
+
+void appendJournal(Engine& engine, std::vector<std::uint8_t>& stored) {
+  const auto chunk = engine.journalChunk();
+  stored.insert(stored.end(), chunk.begin(), chunk.end());
+}
+
+void testJournalReplaysEdits() {
+  Engine original;
+  original.setJournaling(true);
+  std::vector<std::uint8_t> stored;
+  appendJournal(original, stored);
+  original.createRectangle(10, 20, 30, 40, "#ff0000");
+  const auto doomed = original.createRectangle(0, 0, 5, 5, "#00ff00");
+  // Simplified on finish: the journal carries the points as kept, not the samples.
+  const auto stroke = original.startStroke("stroke-1", 0, 0, 4, "#0000ff");
+  for (int step = 1; step <= 40; ++step) {
+    original.updateStroke(stroke, static_cast<float>(step), step % 2 == 0 ? 0.1f : -0.1f);
+    if (step % 10 == 0) {
+      appendJournal(original, stored);
+    }
+  }
+  original.finishStroke(stroke);
+  original.removeShape(doomed);
+  original.startStroke("stroke-2", 5, 5, 2, "#000000");
+  original.updateStroke("stroke-2", 50, 60);
+  appendJournal(original, stored);
+  // Each edit logs about its own size, whatever the document holds.
+  original.createRectangle(1, 1, 1, 1, "#123456");
+  const auto one_edit = original.journalChunk();
+  EXPECT(one_edit.size() < 80);
+  stored.insert(stored.end(), one_edit.begin(), one_edit.end());
+  EXPECT(original.journalBytes() == stored.size());
+  EXPECT(original.journalChunk().empty());
+
+  // The stroke open at the crash is recovered finished, with the points it had.
+  Engine recovered;
+  recovered.resize(640, 480);
+  EXPECT(recovered.replayJournal(stored) == stored.size());
+  EXPECT(sameShapes(recovered, original));
+  EXPECT(!recovered.shapes().pointRange[2].open);
+  recovered.createRectangle(0, 0, 1, 1, "#000000");
+  EXPECT(recovered.strings().get(recovered.shapes().labels.ids[4]) == "rect-4");
+  EXPECT(matchesDirectRasterization(recovered, recovered.render(1)));
+
+  // A torn last record and a damaged one end the replay at the last intact record before them.
+  Engine torn;
+  EXPECT(torn.replayJournal(std::span<const std::uint8_t>(stored).first(stored.size() - 3)) ==
+         stored.size() - one_edit.size());
+  EXPECT(torn.shapes().count() == 3);
+  auto damaged = stored;
+  damaged[stored.size() - one_edit.size() - 5] ^= 0x10;
+  Engine cut;
+  cut.setJournaling(true);
+  const auto valid = cut.replayJournal(damaged);
+  EXPECT(valid > 16 && valid < stored.size() - one_edit.size());
+
+  // Recovery carries on the same journal: its next chunk continues the kept prefix.
+  std::vector<std::uint8_t> continued(stored.begin(), stored.begin() + static_cast<std::ptrdiff_t>(valid));
+  appendJournal(cut, continued);
+  cut.createRectangle(7, 7, 7, 7, "#777777");
+  appendJournal(cut, continued);
+  Engine again;
+  EXPECT(again.replayJournal(continued) == continued.size());
+  EXPECT(sameShapes(again, cut));
+
+  // Only over the document it continues, and before any edit.
+  Engine edited;
+  edited.createRectangle(0, 0, 1, 1, "#000000");
+  EXPECT(edited.replayJournal(stored) == 0);
+  Engine loaded;
+  EXPECT(loadDocument(loaded, saveDocument(original), 4096));
+  EXPECT(loaded.replayJournal(stored) == 0);
+  EXPECT(loaded.shapes().count() == original.shapes().count());
+}
+
+void testJournalCompaction() {
+  Engine original;
+  original.setJournaling(true);
+  original.setJournalLimit(64 * 1024);
+  std::vector<std::uint8_t> journal;
+  drawBoard(original);
+  appendJournal(original, journal);
+  EXPECT(original.journalNeedsCompaction());
+  // Drawn across the compaction: saved with its points so far, then reopened by the new journal.
+  original.startStroke("across", 100, 100, 3, "#336699");
+  original.updateStroke("across", 120, 110);
+  const auto before_compaction = journal;
+
+  original.beginCompaction();
+  std::vector<std::uint8_t> snapshot;
+  for (auto chunk = original.saveChunk(); !chunk.empty(); chunk = original.saveChunk()) {
+    snapshot.insert(snapshot.end(), chunk.begin(), chunk.end());
+  }
+  EXPECT(original.compactionComplete());
+  journal.clear();
+  appendJournal(original, journal);
+  EXPECT(!original.journalNeedsCompaction());
+  EXPECT(journal.size() < 64);
+  original.updateStroke("across", 140, 90);
+  original.finishStroke("across");
+  original.removeShape(original.shapes().handle(3));
+  original.createRectangle(5, 6, 7, 8, "#abcdef");
+  appendJournal(original, journal);
+
+  Engine recovered;
+  recovered.resize(640, 480);
+  EXPECT(loadDocument(recovered, snapshot, 65536));
+  EXPECT(recovered.replayJournal(journal) == journal.size());
+  // Snapshot points are quantized to 1/64, so boxes (a difference of two coordinates) can move by as much.
+  EXPECT(sameShapes(recovered, original, 1.0f / 64));
+  EXPECT(matchesDirectRasterization(recovered, recovered.render(1)));
+  // A journal from before the compaction does not apply to the new snapshot (it is already in it).
+  Engine stale;
+  EXPECT(loadDocument(stale, snapshot, 65536));
+  EXPECT(stale.replayJournal(before_compaction) == 0);
+
+  // An edit during compaction aborts it and the journal carries on over the old base.
+  original.beginCompaction();
+  EXPECT(!original.saveChunk().empty());
+  original.createRectangle(0, 0, 1, 1, "#000000");
+  EXPECT(original.saveChunk().empty());
+  EXPECT(!original.compactionComplete());
+  // So does another save begun in between, even though it completes.
+  original.beginCompaction();
+  EXPECT(!original.saveChunk().empty());
+  original.beginSave();
+  while (!original.saveChunk().empty()) {
+  }
+  EXPECT(!original.compactionComplete());
+  appendJournal(original, journal);
+  Engine resumed;
+  EXPECT(loadDocument(resumed, snapshot, 65536));
+  EXPECT(resumed.replayJournal(journal) == journal.size());
+  EXPECT(resumed.shapes().count() == original.shapes().count());
+}
+
+void testJournalingIsOptIn() {
+  // Nobody takes the chunks of an engine that was not asked to journal, so nothing is kept.
+  Engine engine;
+  drawBoard(engine);
+  EXPECT(engine.journalChunk().empty());
+  EXPECT(engine.journalBytes() <= 16);
+  EXPECT(!engine.journalNeedsCompaction());
+
+  // Turned on afterwards, the journal misses the board so far: it asks for a compaction to restart over it.
+  engine.setJournaling(true);
+  EXPECT(engine.journalNeedsCompaction());
+  EXPECT(engine.journalChunk().empty());
+  engine.beginCompaction();
+  std::vector<std::uint8_t> snapshot;
+  for (auto chunk = engine.saveChunk(); !chunk.empty(); chunk = engine.saveChunk()) {
+    snapshot.insert(snapshot.end(), chunk.begin(), chunk.end());
+  }
+  EXPECT(!engine.journalNeedsCompaction());
+  std::vector<std::uint8_t> journal;
+  engine.createRectangle(1, 2, 3, 4, "#000000");
+  appendJournal(engine, journal);
+  Engine recovered;
+  EXPECT(loadDocument(recovered, snapshot, 65536));
+  EXPECT(recovered.replayJournal(journal) == journal.size());
+  EXPECT(recovered.shapes().count() == engine.shapes().count());
+
+  // Turned off again, what was not taken is dropped.
+  engine.createRectangle(5, 6, 7, 8, "#000000");
+  engine.setJournaling(false);
+  EXPECT(engine.journalChunk().empty());
+  EXPECT(!engine.journalNeedsCompaction());
+}
+
+// The first `actions` of a short session: three rectangles and a stroke, then the second rectangle removed.
+void performActions(Engine& engine, int actions) {
+  if (actions >= 1) {
+    engine.createRectangle(10, 10, 20, 20, "#ff0000");
+  }
+  if (actions >= 2) {
+    engine.createRectangle(40, 10, 20, 20, "#00ff00");
+  }
+  if (actions >= 3) {
+    const auto stroke = engine.startStroke("stroke-1", 0, 50, 4, "#0000ff");
+    for (int step = 1; step <= 20; ++step) {
+      engine.updateStroke(stroke, static_cast<float>(step * 5), 50 + static_cast<float>(step % 3));
+    }
+    engine.finishStroke(stroke);
+  }
+  if (actions >= 4) {
+    engine.createRectangle(70, 10, 20, 20, "#0000ff");
+  }
+  if (actions >= 5) {
+    engine.removeShape(engine.shapes().handle(1));
+  }
+}
+
+bool keysInZOrder(const Engine& engine) {
+  const auto& keys = engine.shapes().key;
+  return std::adjacent_find(keys.begin(), keys.end(), std::greater_equal<>()) == keys.end();
+}
+
+void testUndoRedoRestoresShapes() {
+  constexpr int kActions = 5;
+  std::vector<std::unique_ptr<Engine>> expected;
+  for (int actions = 0; actions <= kActions; ++actions) {
+    expected.push_back(std::make_unique<Engine>());
+    performActions(*expected.back(), actions);
+  }
+  Engine engine;
+  engine.resize(640, 480);
+  performActions(engine, kActions);
+  const auto removed_key = expected[4]->shapes().key[1];
+
+  for (int actions = kActions; actions > 0; --actions) {
+    EXPECT(sameShapes(engine, *expected[actions]));
+    EXPECT(engine.undo());
+  }
+  EXPECT(engine.shapes().count() == 0);
+  EXPECT(!engine.undo());
+  for (int actions = 1; actions <= kActions; ++actions) {
+    EXPECT(engine.redo());
+    EXPECT(sameShapes(engine, *expected[actions]));
+  }
+  EXPECT(!engine.redo());
+
+  // A removed shape comes back at its row with its key, and mirrors see it inserted again.
+  const auto revision = engine.revision();
+  EXPECT(engine.undo());
+  EXPECT(engine.shapes().key[1] == removed_key);
+  EXPECT(keysInZOrder(engine));
+  const auto delta = engine.tickSince(revision);
+  EXPECT(read<std::uint32_t>(delta, 20) == 1);
+  EXPECT(read<std::uint32_t>(delta, 40) == static_cast<std::uint32_t>(ChangeOp::Insert));
+  EXPECT(read<std::uint32_t>(delta, 44) == removed_key);
+  EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+
+  // A new action drops what could be redone.
+  EXPECT(engine.canRedo());
+  engine.createRectangle(0, 0, 5, 5, "#000000");
+  EXPECT(!engine.canRedo());
+  EXPECT(engine.undo());
+
+  // Undoing a stroke being drawn ends it; redoing brings it back finished.
+  const auto drawn = engine.startStroke("stroke-2", 100, 100, 2, "#000000");
+  engine.updateStroke(drawn, 120, 130);
+  EXPECT(engine.undo());
+  EXPECT(sameShapes(engine, *expected[4]));
+  engine.updateStroke("stroke-2", 140, 150);
+  EXPECT(engine.shapes().count() == expected[4]->shapes().count());
+  EXPECT(engine.redo());
+  EXPECT(!engine.shapes().pointRange.back().open && engine.shapes().points(4).size() == 2);
+
+  // A group is undone as one action.
+  engine.beginUndoGroup();
+  engine.removeShape(engine.shapes().handle(0));
+  engine.removeShape(engine.shapes().handle(0));
+  engine.endUndoGroup();
+  EXPECT(engine.undo());
+  EXPECT(engine.shapes().count() == 5);
+  EXPECT(engine.undo());
+  EXPECT(sameShapes(engine, *expected[4]));
+  EXPECT(matchesDirectRasterization(engine, engine.render(1)));
+}
+
+void testUndoPastChangeLimitResyncs() {
+  Engine engine;
+  constexpr std::uint32_t kShapes = 70000;
+  for (std::uint32_t index = 0; index < kShapes; ++index) {
+    engine.createRectangle(static_cast<float>(index % 300), static_cast<float>(index / 300), 1, 1, "#000000");
+  }
+  engine.beginUndoGroup();
+  while (engine.shapes().count() > 0) {
+    engine.removeShape(engine.shapes().handle(engine.shapes().count() - 1));
+  }
+  engine.endUndoGroup();
+  const auto revision = engine.revision();
+  engine.tickSince(revision);
+
+  // Undo brings every shape back in one revision, more changes than are kept: the mirror is sent them all again.
+  EXPECT(engine.undo());
+  const auto delta = engine.tickSince(revision);
+  EXPECT((read<std::uint32_t>(delta, 8) & 1) == 1);
+  EXPECT(read<std::uint32_t>(delta, 20) == kShapes);
+  EXPECT(engine.shapes().count() == kShapes);
+}
+
+void testUndoHistoryCostsWhatChanged() {
+  Engine engine;
+  for (int index = 0; index < 100; ++index) {
+    engine.createRectangle(static_cast<float>(index), 0, 1, 1, "#000000");
+  }
+  // An entry costs the shapes it changed: the same on a board of 100 or 10 100 shapes, and a removed stroke's
+  // points are referenced, not copied.
+  const auto per_action = [&engine] {
+    const auto before = engine.historyBytes();
+    engine.createRectangle(0, 0, 1, 1, "#000000");
+    return engine.historyBytes() - before;
+  };
+  const auto small_board = per_action();
+  for (int index = 0; index < 10000; ++index) {
+    engine.createRectangle(static_cast<float>(index), 0, 1, 1, "#000000");
+  }
+  EXPECT(per_action() == small_board);
+  const auto stroke = engine.startStroke("long", 0, 0, 2, "#000000");
+  for (int step = 1; step <= 1000; ++step) {
+    engine.updateStroke(stroke, static_cast<float>(step), static_cast<float>(step % 7));
+  }
+  engine.finishStroke(stroke);
+  const auto before_removal = engine.historyBytes();
+  engine.removeShape(stroke);
+  EXPECT(engine.historyBytes() - before_removal == small_board);
+
+  // Past the limit the oldest actions go first; the newest are still undone in order.
+  const auto count = engine.shapes().count();
+  engine.setHistoryLimit(small_board * 10);
+  EXPECT(engine.historyBytes() <= small_board * 10);
+  int undone = 0;
+  while (engine.undo()) {
+    ++undone;
+  }
+  EXPECT(undone == 10);
+  // The removal and the stroke cancel out, then eight rectangles are gone.
+  EXPECT(engine.shapes().count() == count - 8);
+}
+
+void testUndoIsJournaled() {
+  Engine original;
+  original.setJournaling(true);
+  std::vector<std::uint8_t> stored;
+  appendJournal(original, stored);
+  performActions(original, 5);
+  EXPECT(original.undo());
+  EXPECT(original.undo());
+  EXPECT(original.undo());
+  EXPECT(original.redo());
+  appendJournal(original, stored);
+
+  Engine recovered;
+  recovered.resize(640, 480);
+  EXPECT(recovered.replayJournal(stored) == stored.size());
+  EXPECT(sameShapes(recovered, original));
+  EXPECT(keysInZOrder(recovered));
+  EXPECT(!recovered.canUndo());
+  EXPECT(matchesDirectRasterization(recovered, recovered.render(1)));
+}
+}  // namespace
+
+int main() {
+  const std::vector<std::pair<const char*, std::function<void()>>> tests = {
+      {"commands update scene", testCommandsUpdateScene},
+      {"snapshot layout", testSnapshotLayout},
+      {"delta carries only appended points", testDeltaCarriesOnlyAppendedPoints},
+      {"execute batch", testExecuteBatch},
+      {"define string records", testDefineStringRecords},
+      {"parse command op", testParseCommandOp},
+      {"truncated record is skipped", testTruncatedRecordIsSkipped},
+      {"snapshot keeps z order", testSnapshotKeepsZOrder},
+      {"finished strokes are packed", testFinishedStrokesArePacked},
+      {"packed strokes decode through a cache", testPackedStrokesDecodeThroughACache},
+      {"strokes are simplified at ingest", testStrokesAreSimplifiedAtIngest},
+      {"strings are interned once", testStringsAreInternedOnce},
+      {"handles survive removal", testHandlesSurviveRemoval},
+      {"delta reports removals", testDeltaReportsRemovals},
+      {"batch addresses strokes by handle", testBatchAddressesStrokesByHandle},
+      {"spatial queries", testSpatialQueries},
+      {"viewport culls snapshot", testViewportCullsSnapshot},
+      {"rasterizer golden", testRasterizerGolden},
+      {"translucent stroke covers once", testTranslucentStrokeCoversOnce},
+      {"simd kernels match scalar", testSimdKernelsMatchScalar},
+      {"render viewport", testRenderViewport},
+      {"tiles redraw only what changed", testTilesRedrawOnlyWhatChanged},
+      {"tiles match direct rasterization", testTilesMatchDirectRasterization},
+      {"stroke mask grows incrementally", testStrokeMaskGrowsIncrementally},
+      {"cached strokes match direct rasterization", testCachedStrokesMatchDirectRasterization},
+      {"simplified stroke redraws its tiles", testSimplifiedStrokeRedrawsItsTiles},
+      {"work-stealing pool runs every task once", testWorkStealingPoolRunsEveryTaskOnce},
+      {"parallel tiles match serial", testParallelTilesMatchSerial},
+      {"document round trip", testDocumentRoundTrip},
+      {"document load rejects damage", testDocumentLoadRejectsDamage},
+      {"load retires old handles", testLoadRetiresOldHandles},
+      {"archive opens in place", testArchiveOpensInPlace},
+      {"archive open rejects damage", testArchiveOpenRejectsDamage},
+      {"journal replays edits", testJournalReplaysEdits},
+      {"journal compaction", testJournalCompaction},
+      {"journaling is opt in", testJournalingIsOptIn},
+      {"undo redo restores shapes", testUndoRedoRestoresShapes},
+      {"undo past the change limit resyncs", testUndoPastChangeLimitResyncs},
+      {"undo history costs what changed", testUndoHistoryCostsWhatChanged},
+      {"undo is journaled", testUndoIsJournaled},
+  };
+
+  for (const auto& [name, test] : tests) {
+    const auto before = failures;
+    test();
+    std::printf("%s %s\n", failures == before ? "ok  " : "FAIL", name);
+  }
+  return failures == 0 ? 0 : 1;
+}
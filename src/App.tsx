@@ -13,7 +13,6 @@ import { StageCanvas } from './components/canvas/StageCanvas';
 import { TopBar } from './components/layout/TopBar';
 import { RightPanel } from './components/panel/RightPanel';
 import { BottomToolbar } from './components/toolbar/BottomToolbar';
-import type { EngineShape } from './engine/types';
 import { useEngine } from './hooks/useEngine';
 import type { Tool } from './types/tools';
 import { computeCanvasMetrics } from './utils/dimensions';
@@ -49,7 +48,20 @@ const App = () => {
     height: typeof window !== 'undefined' ? window.innerHeight : INITIAL_WORKSPACE_HEIGHT
   }));
   const [zoom, setZoom] = useState(1);
-  const { state, isReady, sendCommand, forwardPointerEvent } = useEngine(canvasRef, workspaceSize, zoom);
+  const {
+    state,
+    isReady,
+    sendCommand,
+    forwardPointerEvent,
+    setViewport,
+    startRecording,
+    stopRecording,
+    saveDocument,
+    undo,
+    redo,
+    loadDocument
+  } = useEngine(canvasRef, workspaceSize, zoom);
+  const isRecordingRef = useRef(false);
 
   const [activeTool, setActiveTool] = useState<Tool>('brush');
   const [activeColor, setActiveColor] = useState<string>(colorPalette[1]);
@@ -195,11 +207,6 @@ const App = () => {
     [activeColor, rectangleSettings, sendCommand]
   );
 
-  const shapes = useMemo<EngineShape[]>(() => {
-    const document = state.document;
-    return document ? document.shapes : [];
-  }, [state.document]);
-
   const canvasMetrics = useMemo(
     () => computeCanvasMetrics(workspaceSize, viewportSize, zoom),
     [workspaceSize.height, workspaceSize.width, viewportSize.height, viewportSize.width, zoom]
@@ -279,6 +286,67 @@ const App = () => {
     [activeColor, activeTool, brushSettings.size, canvasMetrics, createRectangleAt, forwardPointerEvent, isReady, sendCommand, workspaceSize.height, workspaceSize.width]
   );
 
+  // Alt+Shift+R toggles a session recording that is downloaded for offline replay.
+  useEffect(() => {
+    const handleKeyDown = (event: KeyboardEvent) => {
+      if (!event.altKey || !event.shiftKey || event.code !== 'KeyR') {
+        return;
+      }
+      event.preventDefault();
+      if (isRecordingRef.current) {
+        stopRecording();
+      } else {
+        startRecording();
+      }
+      isRecordingRef.current = !isRecordingRef.current;
+    };
+    window.addEventListener('keydown', handleKeyDown);
+    return () => window.removeEventListener('keydown', handleKeyDown);
+  }, [startRecording, stopRecording]);
+
+  // Ctrl/Cmd+S downloads the document, Ctrl/Cmd+O opens one.
+  useEffect(() => {
+    const handleKeyDown = (event: KeyboardEvent) => {
+      if (!(event.ctrlKey || event.metaKey) || (event.code !== 'KeyS' && event.code !== 'KeyO')) {
+        return;
+      }
+      event.preventDefault();
+      if (event.code === 'KeyS') {
+        saveDocument();
+        return;
+      }
+      const input = document.createElement('input');
+      input.type = 'file';
+      input.accept = '.mddc,.mdar';
+      input.addEventListener('change', () => {
+        const file = input.files?.[0];
+        if (file) {
+          loadDocument(file);
+        }
+      });
+      input.click();
+    };
+    window.addEventListener('keydown', handleKeyDown);
+    return () => window.removeEventListener('keydown', handleKeyDown);
+  }, [loadDocument, saveDocument]);
+
+  // Ctrl/Cmd+Z undoes the last shape created or removed; Ctrl/Cmd+Shift+Z and Ctrl+Y redo it.
+  useEffect(() => {
+    const handleKeyDown = (event: KeyboardEvent) => {
+      if (!(event.ctrlKey || event.metaKey) || (event.code !== 'KeyZ' && event.code !== 'KeyY')) {
+        return;
+      }
+      event.preventDefault();
+      if (event.code === 'KeyZ' && !event.shiftKey) {
+        undo();
+      } else {
+        redo();
+      }
+    };
+    window.addEventListener('keydown', handleKeyDown);
+    return () => window.removeEventListener('keydown', handleKeyDown);
+  }, [undo, redo]);
+
   useEffect(() => {
     const handleResize = () => {
       setViewportSize({ width: window.innerWidth, height: window.innerHeight });
@@ -287,25 +355,14 @@ const App = () => {
     return () => window.removeEventListener('resize', handleResize);
   }, []);
 
+  // The summary keeps the shapes' far edges and counts up to date with each change, so nothing here walks the shapes.
+  const { maxX, maxY, rectangles: totalRectangles, strokes: totalStrokes } = state.summary;
+  const isEmpty = totalRectangles + totalStrokes === 0;
+
   const updateWorkspaceFromShapes = useCallback(
     (currentSize: { width: number; height: number }) => {
-      let maxX = 0;
-      let maxY = 0;
-
-      for (const shape of shapes) {
-        if (shape.kind === 'rectangle') {
-          maxX = Math.max(maxX, shape.x + shape.width);
-          maxY = Math.max(maxY, shape.y + shape.height);
-        } else if (shape.kind === 'stroke') {
-          for (const point of shape.points) {
-            maxX = Math.max(maxX, point.x);
-            maxY = Math.max(maxY, point.y);
-          }
-        }
-      }
-
-      const desiredWidthBase = shapes.length === 0 ? INITIAL_WORKSPACE_WIDTH : maxX + EDGE_THRESHOLD;
-      const desiredHeightBase = shapes.length === 0 ? INITIAL_WORKSPACE_HEIGHT : maxY + EDGE_THRESHOLD;
+      const desiredWidthBase = isEmpty ? INITIAL_WORKSPACE_WIDTH : maxX + EDGE_THRESHOLD;
+      const desiredHeightBase = isEmpty ? INITIAL_WORKSPACE_HEIGHT : maxY + EDGE_THRESHOLD;
 
       const desiredWidth = Math.max(desiredWidthBase, viewportSize.width / zoom, INITIAL_WORKSPACE_WIDTH);
       const desiredHeight = Math.max(desiredHeightBase, viewportSize.height / zoom, INITIAL_WORKSPACE_HEIGHT);
@@ -328,7 +385,7 @@ const App = () => {
         height: nextHeight
       };
     },
-    [shapes, viewportSize.height, viewportSize.width, zoom]
+    [isEmpty, maxX, maxY, viewportSize.height, viewportSize.width, zoom]
   );
 
   useEffect(() => {
@@ -396,8 +453,28 @@ const App = () => {
     };
   }, [handleWheel]);
 
-  const totalStrokes = shapes.filter((shape) => shape.kind === 'stroke').length;
-  const totalRectangles = shapes.filter((shape) => shape.kind === 'rectangle').length;
+  // The engine only paints shapes inside the scrolled area, so it follows scrolling, zoom and window size.
+  useEffect(() => {
+    const scroll = scrollRef.current;
+    if (!scroll || !isReady) {
+      return;
+    }
+
+    const sendViewport = () => {
+      setViewport({
+        x: scroll.scrollLeft / zoom,
+        y: scroll.scrollTop / zoom,
+        width: scroll.clientWidth / zoom,
+        height: scroll.clientHeight / zoom
+      });
+    };
+
+    sendViewport();
+    scroll.addEventListener('scroll', sendViewport, { passive: true });
+    return () => {
+      scroll.removeEventListener('scroll', sendViewport);
+    };
+  }, [isReady, setViewport, viewportSize.height, viewportSize.width, workspaceSize.height, workspaceSize.width, zoom]);
 
   return (
     <div className="stage">
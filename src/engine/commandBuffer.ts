@@ -0,0 +1,175 @@
+import { EngineCommand } from './types';
+
+// Mirrors CommandOp and the record layout decoded by Engine::executeBatch() in engine/src/engine.cpp.
+// Each record starts with a u32 header (opcode in the low 16 bits, record length in words in the high 16 bits)
+// followed by fixed-width little-endian fields; strings are passed as indices, either returned by
+// Engine::internString() or bound by an earlier define-string record in the same stream.
+export const COMMAND_CREATE_RECTANGLE = 1;
+export const COMMAND_START_STROKE = 2;
+export const COMMAND_UPDATE_STROKE = 3;
+export const COMMAND_FINISH_STROKE = 4;
+export const COMMAND_POINTER_MOVE = 5;
+export const COMMAND_DEFINE_STRING = 6;
+export const COMMAND_UPDATE_STROKE_HANDLE = 7;
+export const COMMAND_FINISH_STROKE_HANDLE = 8;
+export const COMMAND_REMOVE_SHAPE = 9;
+
+const COMMAND_WORDS = [0, 6, 6, 4, 2, 4, 3, 5, 3, 3];
+const INITIAL_WORDS = 1024;
+
+export interface CommandEncoder {
+  readonly byteLength: number;
+  push(command: EngineCommand): void;
+  pushPointerMove(pointerId: number, x: number, y: number): void;
+  bindStrokeHandles(started: Uint32Array): void;
+  // The engine adopted another document: handles bound so far may resolve to its shapes.
+  forgetStrokeHandles(): void;
+  bytes(): Uint8Array;
+  words(): Uint32Array;
+  reset(): void;
+}
+
+const textEncoder = new TextEncoder();
+
+// Without `intern`, the encoder numbers strings itself and emits a define-string record ahead of their first use,
+// so the stream is self-describing and can be produced where the engine is not reachable (e.g. the UI thread).
+export const createCommandEncoder = (intern?: (value: string) => number): CommandEncoder => {
+  const strings = new Map<string, number>();
+  // Stroke id index -> [slot, generation] from Engine::startedStrokes(); bound strokes are addressed by handle.
+  const handles = new Map<number, [number, number]>();
+  // Strokes finished by id since the last bind: already closed, so their handles are not worth keeping.
+  const finishedUnbound = new Set<number>();
+  let words = new Uint32Array(INITIAL_WORDS);
+  let floats = new Float32Array(words.buffer);
+  let length = 0;
+
+  const reserveWords = (opcode: number, count: number) => {
+    if (length + count > words.length) {
+      const grown = new Uint32Array(Math.max(words.length * 2, length + count));
+      grown.set(words.subarray(0, length));
+      words = grown;
+      floats = new Float32Array(words.buffer);
+    }
+    const base = length;
+    words[base] = opcode | (count << 16);
+    length += count;
+    return base;
+  };
+
+  const reserve = (opcode: number) => reserveWords(opcode, COMMAND_WORDS[opcode]);
+
+  const defineString = (index: number, value: string) => {
+    const maxBytes = value.length * 3;
+    const base = reserveWords(COMMAND_DEFINE_STRING, COMMAND_WORDS[COMMAND_DEFINE_STRING] + Math.ceil(maxBytes / 4));
+    const { written } = textEncoder.encodeInto(value, new Uint8Array(words.buffer, (base + 3) * 4, maxBytes));
+    const count = COMMAND_WORDS[COMMAND_DEFINE_STRING] + Math.ceil(written / 4);
+    words[base] = COMMAND_DEFINE_STRING | (count << 16);
+    words[base + 1] = index;
+    words[base + 2] = written;
+    length = base + count;
+  };
+
+  // Must run before the command's own record is reserved so definitions precede their use.
+  const stringIndex = (value: string) => {
+    let index = strings.get(value);
+    if (index === undefined) {
+      if (intern) {
+        index = intern(value);
+      } else {
+        index = strings.size;
+        defineString(index, value);
+      }
+      strings.set(value, index);
+    }
+    return index;
+  };
+
+  return {
+    get byteLength() {
+      return length * 4;
+    },
+    push: (command) => {
+      switch (command.type) {
+        case 'createRectangle': {
+          const color = stringIndex(command.color);
+          const base = reserve(COMMAND_CREATE_RECTANGLE);
+          floats[base + 1] = command.x;
+          floats[base + 2] = command.y;
+          floats[base + 3] = command.width;
+          floats[base + 4] = command.height;
+          words[base + 5] = color;
+          break;
+        }
+        case 'startStroke': {
+          const id = stringIndex(command.id);
+          const color = stringIndex(command.color);
+          const base = reserve(COMMAND_START_STROKE);
+          words[base + 1] = id;
+          floats[base + 2] = command.x;
+          floats[base + 3] = command.y;
+          floats[base + 4] = command.size;
+          words[base + 5] = color;
+          break;
+        }
+        case 'updateStroke': {
+          const id = stringIndex(command.id);
+          const handle = handles.get(id);
+          if (handle) {
+            const base = reserve(COMMAND_UPDATE_STROKE_HANDLE);
+            words[base + 1] = handle[0];
+            words[base + 2] = handle[1];
+            floats[base + 3] = command.x;
+            floats[base + 4] = command.y;
+            break;
+          }
+          const base = reserve(COMMAND_UPDATE_STROKE);
+          words[base + 1] = id;
+          floats[base + 2] = command.x;
+          floats[base + 3] = command.y;
+          break;
+        }
+        case 'finishStroke': {
+          const id = stringIndex(command.id);
+          const handle = handles.get(id);
+          if (handle) {
+            handles.delete(id);
+            const base = reserve(COMMAND_FINISH_STROKE_HANDLE);
+            words[base + 1] = handle[0];
+            words[base + 2] = handle[1];
+            break;
+          }
+          finishedUnbound.add(id);
+          const base = reserve(COMMAND_FINISH_STROKE);
+          words[base + 1] = id;
+          break;
+        }
+        default:
+          break;
+      }
+    },
+    pushPointerMove: (pointerId, x, y) => {
+      const base = reserve(COMMAND_POINTER_MOVE);
+      words[base + 1] = pointerId;
+      floats[base + 2] = x;
+      floats[base + 3] = y;
+    },
+    bindStrokeHandles: (started) => {
+      for (let index = 0; index + 2 < started.length; index += 3) {
+        if (!finishedUnbound.has(started[index])) {
+          handles.set(started[index], [started[index + 1], started[index + 2]]);
+        }
+      }
+      finishedUnbound.clear();
+    },
+    forgetStrokeHandles: () => {
+      handles.clear();
+      finishedUnbound.clear();
+    },
+    bytes: () => new Uint8Array(words.buffer, 0, length * 4),
+    // Backing storage, valid up to byteLength; lets hot paths copy records out without allocating a view.
+    words: () => words,
+    reset: () => {
+      length = 0;
+    }
+  };
+};
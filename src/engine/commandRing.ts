@@ -0,0 +1,123 @@
+import { CommandEncoder, createCommandEncoder } from './commandBuffer';
+import { EngineCommand } from './types';
+
+// Single-producer/single-consumer byte ring in a SharedArrayBuffer carrying executeBatch() records from the UI
+// thread to the engine worker. The control block holds two free-running u32 byte counters: `head` is only
+// written by the producer, `tail` only by the consumer, so Atomics loads/stores are enough to publish records.
+const RING_HEAD = 0;
+const RING_TAIL = 1;
+const RING_CONTROL_BYTES = 16;
+const RING_RETRY_MS = 4;
+export const COMMAND_RING_BYTES = 1 << 18;
+
+export const isCommandRingSupported = () =>
+  typeof SharedArrayBuffer !== 'undefined' && typeof Atomics !== 'undefined' && globalThis.crossOriginIsolated === true;
+
+// `byteLength` must be a power of two so counters can be masked into ring offsets.
+export const createCommandRing = (byteLength: number = COMMAND_RING_BYTES) =>
+  new SharedArrayBuffer(RING_CONTROL_BYTES + byteLength);
+
+const openRing = (buffer: SharedArrayBuffer) => {
+  const capacity = buffer.byteLength - RING_CONTROL_BYTES;
+  return {
+    control: new Int32Array(buffer, 0, RING_CONTROL_BYTES / 4),
+    capacity,
+    mask: capacity - 1
+  };
+};
+
+export interface CommandRingProducer {
+  push(command: EngineCommand): void;
+  pushPointerMove(pointerId: number, x: number, y: number): void;
+}
+
+// Encodes each event straight into the ring. Records that do not fit while the worker is stalled are kept in a
+// local backlog, in order, and retried; that is the only path that allocates.
+export const createCommandRingProducer = (buffer: SharedArrayBuffer): CommandRingProducer => {
+  const { control, capacity, mask } = openRing(buffer);
+  const data = new Uint32Array(buffer, RING_CONTROL_BYTES, capacity / 4);
+  const encoder: CommandEncoder = createCommandEncoder();
+  const backlog: Uint32Array[] = [];
+  let retryHandle: ReturnType<typeof setTimeout> | null = null;
+
+  const write = (words: Uint32Array, wordCount: number) => {
+    const head = Atomics.load(control, RING_HEAD) >>> 0;
+    const tail = Atomics.load(control, RING_TAIL) >>> 0;
+    const byteLength = wordCount * 4;
+    if (byteLength > capacity - ((head - tail) >>> 0)) {
+      return false;
+    }
+
+    const start = (head & mask) / 4;
+    const wordMask = mask >>> 2;
+    for (let index = 0; index < wordCount; index += 1) {
+      data[(start + index) & wordMask] = words[index];
+    }
+    Atomics.store(control, RING_HEAD, (head + byteLength) | 0);
+    return true;
+  };
+
+  const drainBacklog = () => {
+    while (backlog.length > 0 && write(backlog[0], backlog[0].length)) {
+      backlog.shift();
+    }
+    return backlog.length === 0;
+  };
+
+  const scheduleRetry = () => {
+    if (retryHandle !== null) {
+      return;
+    }
+    retryHandle = setTimeout(() => {
+      retryHandle = null;
+      if (!drainBacklog()) {
+        scheduleRetry();
+      }
+    }, RING_RETRY_MS);
+  };
+
+  const commit = () => {
+    const wordCount = encoder.byteLength / 4;
+    if (!drainBacklog() || !write(encoder.words(), wordCount)) {
+      backlog.push(encoder.words().slice(0, wordCount));
+      scheduleRetry();
+    }
+    encoder.reset();
+  };
+
+  return {
+    push: (command) => {
+      encoder.push(command);
+      commit();
+    },
+    pushPointerMove: (pointerId, x, y) => {
+      encoder.pushPointerMove(pointerId, x, y);
+      commit();
+    }
+  };
+};
+
+export interface CommandRingConsumer {
+  available(): number;
+  readInto(target: Uint8Array, byteLength: number): void;
+}
+
+export const createCommandRingConsumer = (buffer: SharedArrayBuffer): CommandRingConsumer => {
+  const { control, capacity, mask } = openRing(buffer);
+  const data = new Uint8Array(buffer, RING_CONTROL_BYTES, capacity);
+
+  return {
+    available: () => (Atomics.load(control, RING_HEAD) - Atomics.load(control, RING_TAIL)) >>> 0,
+    // Copies `byteLength` published bytes (as returned by available()) into `target` and releases them.
+    readInto: (target, byteLength) => {
+      const tail = Atomics.load(control, RING_TAIL) >>> 0;
+      const start = tail & mask;
+      const first = Math.min(byteLength, capacity - start);
+      target.set(data.subarray(start, start + first), 0);
+      if (first < byteLength) {
+        target.set(data.subarray(0, byteLength - first), first);
+      }
+      Atomics.store(control, RING_TAIL, (tail + byteLength) | 0);
+    }
+  };
+};
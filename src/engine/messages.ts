@@ -1,14 +1,24 @@
 import { EngineCommand, EngineStatePayload, PointerEventPayload } from './types';
 
 export type UIToWorkerMessage =
-  | { type: 'init'; canvas: OffscreenCanvas; devicePixelRatio: number }
+  | { type: 'init'; canvas: OffscreenCanvas; devicePixelRatio: number; commandRing?: SharedArrayBuffer }
   | { type: 'resize'; width: number; height: number; zoom: number }
+  | { type: 'viewport'; x: number; y: number; width: number; height: number }
   | { type: 'command'; command: EngineCommand }
-  | { type: 'pointer'; event: PointerEventPayload };
+  | { type: 'pointer'; event: PointerEventPayload }
+  | { type: 'recordStart' }
+  | { type: 'recordStop' }
+  | { type: 'save' }
+  | { type: 'undo' }
+  | { type: 'redo' }
+  | { type: 'load'; file: Blob };
 
 export type WorkerToUIMessage =
-  | { type: 'ready' }
+  | { type: 'ready'; commandRing: boolean }
   | { type: 'state'; payload: EngineStatePayload }
+  | { type: 'delta'; buffer: ArrayBuffer }
+  | { type: 'recording'; buffer: ArrayBuffer }
+  | { type: 'document'; chunks: ArrayBuffer[] }
   | { type: 'log'; message: string };
 
 export type EngineWorker = Worker & {
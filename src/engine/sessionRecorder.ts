@@ -0,0 +1,98 @@
+import { createCommandEncoder } from './commandBuffer';
+import { EngineCommand, PointerEventPayload } from './types';
+
+// Session trace replayed by engine/bench/session_replay.cpp. After a 16-byte header, every entry is a u32
+// time delta in microseconds followed by one executeBatch() record (strings defined inline), so the trace is the
+// exact stream the engine consumed. A frame-marker record closes the commands the worker applied in one frame.
+export const TRACE_MAGIC = 0x5254444d; // "MDTR"
+export const TRACE_VERSION = 1;
+export const TRACE_HEADER_BYTES = 16;
+export const TRACE_FRAME_MARKER = 0xffff;
+
+export interface SessionRecorder {
+  command(command: EngineCommand): void;
+  pointer(event: PointerEventPayload): void;
+  records(bytes: Uint8Array): void;
+  frame(): void;
+  finish(): ArrayBuffer;
+}
+
+export const createSessionRecorder = (now: () => number = () => performance.now()): SessionRecorder => {
+  const encoder = createCommandEncoder();
+  let words = new Uint32Array(1 << 16);
+  let length = TRACE_HEADER_BYTES / 4;
+  let lastTime = now();
+  let recordsSinceFrame = 0;
+
+  const ensure = (count: number) => {
+    if (length + count > words.length) {
+      const grown = new Uint32Array(Math.max(words.length * 2, length + count));
+      grown.set(words.subarray(0, length));
+      words = grown;
+    }
+  };
+
+  const elapsedMicros = () => {
+    const time = now();
+    const delta = Math.max(0, Math.round((time - lastTime) * 1000));
+    lastTime = time;
+    return Math.min(delta, 0xffffffff);
+  };
+
+  // Appends each record of a packed stream; only the first carries the elapsed time.
+  const append = (source: Uint32Array, sourceLength: number) => {
+    let delta = elapsedMicros();
+    let offset = 0;
+    while (offset < sourceLength) {
+      const count = source[offset] >>> 16;
+      if (count === 0 || offset + count > sourceLength) {
+        break;
+      }
+      ensure(count + 1);
+      words[length] = delta;
+      words.set(source.subarray(offset, offset + count), length + 1);
+      length += count + 1;
+      offset += count;
+      delta = 0;
+      recordsSinceFrame += 1;
+    }
+  };
+
+  const appendEncoded = () => {
+    append(encoder.words(), encoder.byteLength / 4);
+    encoder.reset();
+  };
+
+  return {
+    command: (command) => {
+      encoder.push(command);
+      appendEncoded();
+    },
+    pointer: (event) => {
+      if (event.type === 'pointerMove') {
+        encoder.pushPointerMove(event.pointerId, event.x, event.y);
+        appendEncoded();
+      }
+    },
+    records: (bytes) => {
+      append(new Uint32Array(bytes.buffer, bytes.byteOffset, bytes.byteLength / 4), bytes.byteLength / 4);
+    },
+    frame: () => {
+      if (recordsSinceFrame === 0) {
+        return;
+      }
+      ensure(2);
+      words[length] = elapsedMicros();
+      words[length + 1] = TRACE_FRAME_MARKER | (1 << 16);
+      length += 2;
+      recordsSinceFrame = 0;
+    },
+    finish: () => {
+      words[0] = TRACE_MAGIC;
+      words[1] = TRACE_VERSION | (TRACE_HEADER_BYTES << 16);
+      words[2] = 0;
+      words[3] = 0;
+      return words.buffer.slice(0, length * 4);
+    }
+  };
+};
@@ -0,0 +1,385 @@
+import {
+  EngineDocumentSummary,
+  EnginePresence,
+  EngineShape,
+  EngineStrokePoint,
+  EngineViewState
+} from './types';
+
+// Mirrors the layout written by Engine::writeSnapshot() in engine/src/engine.cpp.
+export const SNAPSHOT_MAGIC = 0x4e53444d;
+export const SNAPSHOT_VERSION = 1;
+export const SNAPSHOT_HEADER_BYTES = 32;
+export const SNAPSHOT_SHAPE_BYTES = 32;
+export const SNAPSHOT_PRESENCE_BYTES = 16;
+export const SNAPSHOT_POINT_BYTES = 8;
+export const SHAPE_KIND_RECTANGLE = 0;
+export const SHAPE_KIND_STROKE = 1;
+
+export interface SnapshotView {
+  revision: number;
+  shapeCount: number;
+  presenceCount: number;
+  pointCount: number;
+  shapeWords: Uint32Array;
+  shapeFloats: Float32Array;
+  presenceWords: Int32Array;
+  presenceFloats: Float32Array;
+  points: Float32Array;
+  strings: Uint8Array;
+}
+
+export const openSnapshot = (bytes: Uint8Array): SnapshotView | null => {
+  if (bytes.byteLength < SNAPSHOT_HEADER_BYTES || bytes.byteOffset % 4 !== 0) {
+    return null;
+  }
+
+  const header = new Uint32Array(bytes.buffer, bytes.byteOffset, SNAPSHOT_HEADER_BYTES / 4);
+  if (header[0] !== SNAPSHOT_MAGIC || (header[1] & 0xffff) !== SNAPSHOT_VERSION) {
+    return null;
+  }
+
+  const headerBytes = header[1] >>> 16;
+  const revision = header[2];
+  const shapeCount = header[3];
+  const presenceCount = header[4];
+  const pointCount = header[5];
+  const stringBytes = header[6];
+
+  const shapesOffset = bytes.byteOffset + headerBytes;
+  const presencesOffset = shapesOffset + shapeCount * SNAPSHOT_SHAPE_BYTES;
+  const pointsOffset = presencesOffset + presenceCount * SNAPSHOT_PRESENCE_BYTES;
+  const stringsOffset = pointsOffset + pointCount * SNAPSHOT_POINT_BYTES;
+  if (stringsOffset + stringBytes > bytes.byteOffset + bytes.byteLength) {
+    return null;
+  }
+
+  return {
+    revision,
+    shapeCount,
+    presenceCount,
+    pointCount,
+    shapeWords: new Uint32Array(bytes.buffer, shapesOffset, (shapeCount * SNAPSHOT_SHAPE_BYTES) / 4),
+    shapeFloats: new Float32Array(bytes.buffer, shapesOffset, (shapeCount * SNAPSHOT_SHAPE_BYTES) / 4),
+    presenceWords: new Int32Array(bytes.buffer, presencesOffset, (presenceCount * SNAPSHOT_PRESENCE_BYTES) / 4),
+    presenceFloats: new Float32Array(bytes.buffer, presencesOffset, (presenceCount * SNAPSHOT_PRESENCE_BYTES) / 4),
+    points: new Float32Array(bytes.buffer, pointsOffset, pointCount * 2),
+    strings: new Uint8Array(bytes.buffer, stringsOffset, stringBytes)
+  };
+};
+
+const cssColors = new Map<number, string>();
+
+// Colors are packed so that the bytes read R, G, B, A; cached because boards reuse a handful of colors.
+export const rgbaToCss = (rgba: number): string => {
+  let css = cssColors.get(rgba);
+  if (css === undefined) {
+    const hex = (value: number) => value.toString(16).padStart(2, '0');
+    const alpha = rgba >>> 24;
+    css = `#${hex(rgba & 0xff)}${hex((rgba >>> 8) & 0xff)}${hex((rgba >>> 16) & 0xff)}${
+      alpha === 0xff ? '' : hex(alpha)
+    }`;
+    cssColors.set(rgba, css);
+  }
+  return css;
+};
+
+const textDecoder = new TextDecoder();
+
+const readString = (strings: Uint8Array, offset: number) => {
+  const length =
+    strings[offset] | (strings[offset + 1] << 8) | (strings[offset + 2] << 16) | (strings[offset + 3] << 24);
+  return textDecoder.decode(strings.subarray(offset + 4, offset + 4 + length));
+};
+
+const readPresences = (words: Int32Array, floats: Float32Array, count: number): EnginePresence[] => {
+  const presences: EnginePresence[] = [];
+  for (let index = 0; index < count; index += 1) {
+    const base = (index * SNAPSHOT_PRESENCE_BYTES) / 4;
+    presences.push({
+      id: String(words[base]),
+      color: rgbaToCss(words[base + 1] >>> 0),
+      x: floats[base + 2],
+      y: floats[base + 3]
+    });
+  }
+  return presences;
+};
+
+const readPoints = (points: Float32Array, offset: number, count: number): EngineStrokePoint[] => {
+  const result: EngineStrokePoint[] = [];
+  for (let point = offset; point < offset + count; point += 1) {
+    result.push({ x: points[point * 2], y: points[point * 2 + 1] });
+  }
+  return result;
+};
+
+// Mirrors Engine::writeDelta(): a header, one record per changed shape, then presences, points and strings.
+export const DELTA_MAGIC = 0x4c44444d;
+export const DELTA_VERSION = 1;
+export const DELTA_RECORD_BYTES = 8 + SNAPSHOT_SHAPE_BYTES;
+export const DELTA_FLAG_FULL_RESYNC = 1;
+export const CHANGE_INSERT = 0;
+export const CHANGE_UPDATE = 1;
+export const CHANGE_APPEND_POINTS = 2;
+export const CHANGE_REMOVE = 3;
+
+export interface DeltaMirror {
+  revision: number;
+  apply(bytes: Uint8Array): EngineViewState | null;
+  // The mirrored shapes in z order. The array is the mirror's own and changes with each apply().
+  shapes(): readonly EngineShape[];
+}
+
+// Right and bottom edges of a shape, from 0.
+const shapeRight = (shape: EngineShape) => {
+  if (shape.kind === 'rectangle') {
+    return Math.max(0, shape.x + shape.width);
+  }
+  let right = 0;
+  for (const point of shape.points) {
+    right = Math.max(right, point.x);
+  }
+  return right;
+};
+
+const shapeBottom = (shape: EngineShape) => {
+  if (shape.kind === 'rectangle') {
+    return Math.max(0, shape.y + shape.height);
+  }
+  let bottom = 0;
+  for (const point of shape.points) {
+    bottom = Math.max(bottom, point.y);
+  }
+  return bottom;
+};
+
+// For documents that arrive whole, from engines without deltas.
+export const summarizeShapes = (shapes: readonly EngineShape[]): EngineDocumentSummary => {
+  const summary = { rectangles: 0, strokes: 0, maxX: 0, maxY: 0 };
+  for (const shape of shapes) {
+    if (shape.kind === 'rectangle') {
+      summary.rectangles += 1;
+    } else {
+      summary.strokes += 1;
+    }
+    summary.maxX = Math.max(summary.maxX, shapeRight(shape));
+    summary.maxY = Math.max(summary.maxY, shapeBottom(shape));
+  }
+  return summary;
+};
+
+// Keeps the UI-side copy of the document in sync with tickSince() deltas, and its summary with it: counts and each
+// shape's edges are updated with the records, so that a delta costs the size of its records rather than of the
+// document. The far edges are only recomputed, from the kept edges, when the shape on one of them shrinks or goes.
+// Shape keys grow with z order, so shapes are kept sorted by key and one that undo puts back below others is placed
+// by it.
+export const createDeltaMirror = (): DeltaMirror => {
+  const keys: number[] = [];
+  const shapes: EngineShape[] = [];
+  const rights: number[] = [];
+  const bottoms: number[] = [];
+  let rectangles = 0;
+  let strokes = 0;
+  let maxX = 0;
+  let maxY = 0;
+  let edgesStale = false;
+
+  // Index of `key` in `keys`, or where it would go; new shapes usually come last.
+  const position = (key: number) => {
+    if (keys.length === 0 || keys[keys.length - 1] < key) {
+      return keys.length;
+    }
+    let low = 0;
+    let high = keys.length;
+    while (low < high) {
+      const middle = (low + high) >>> 1;
+      if (keys[middle] < key) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  };
+
+  const count = (shape: EngineShape, step: number) => {
+    if (shape.kind === 'rectangle') {
+      rectangles += step;
+    } else {
+      strokes += step;
+    }
+  };
+
+  // Sets the edges of the shape at `at`, which hold its previous ones unless it was just inserted.
+  const setEdges = (at: number, right: number, bottom: number) => {
+    if (rights[at] > right && rights[at] >= maxX) {
+      edgesStale = true;
+    }
+    if (bottoms[at] > bottom && bottoms[at] >= maxY) {
+      edgesStale = true;
+    }
+    rights[at] = right;
+    bottoms[at] = bottom;
+    maxX = Math.max(maxX, right);
+    maxY = Math.max(maxY, bottom);
+  };
+
+  const put = (key: number, shape: EngineShape) => {
+    const at = position(key);
+    if (keys[at] === key) {
+      count(shapes[at], -1);
+      shapes[at] = shape;
+    } else {
+      keys.splice(at, 0, key);
+      shapes.splice(at, 0, shape);
+      rights.splice(at, 0, 0);
+      bottoms.splice(at, 0, 0);
+    }
+    count(shape, 1);
+    setEdges(at, shapeRight(shape), shapeBottom(shape));
+  };
+
+  const remove = (at: number) => {
+    count(shapes[at], -1);
+    setEdges(at, 0, 0);
+    keys.splice(at, 1);
+    shapes.splice(at, 1);
+    rights.splice(at, 1);
+    bottoms.splice(at, 1);
+  };
+
+  const mirror: DeltaMirror = {
+    revision: 0,
+    shapes: () => shapes,
+    apply: (bytes) => {
+      if (bytes.byteLength < 8 || bytes.byteOffset % 4 !== 0) {
+        return null;
+      }
+
+      const preamble = new Uint32Array(bytes.buffer, bytes.byteOffset, 2);
+      if (preamble[0] !== DELTA_MAGIC || (preamble[1] & 0xffff) !== DELTA_VERSION) {
+        return null;
+      }
+
+      const header = new Uint32Array(bytes.buffer, bytes.byteOffset, (preamble[1] >>> 16) / 4);
+      const flags = header[2];
+      const revision = header[4];
+      const recordCount = header[5];
+      const presenceCount = header[6];
+      const pointCount = header[7];
+      const stringBytes = header[8];
+
+      const recordsOffset = bytes.byteOffset + header.byteLength;
+      const presencesOffset = recordsOffset + recordCount * DELTA_RECORD_BYTES;
+      const pointsOffset = presencesOffset + presenceCount * SNAPSHOT_PRESENCE_BYTES;
+      const stringsOffset = pointsOffset + pointCount * SNAPSHOT_POINT_BYTES;
+      if (stringsOffset + stringBytes > bytes.byteOffset + bytes.byteLength) {
+        return null;
+      }
+
+      const words = new Uint32Array(bytes.buffer, recordsOffset, (recordCount * DELTA_RECORD_BYTES) / 4);
+      const floats = new Float32Array(bytes.buffer, recordsOffset, (recordCount * DELTA_RECORD_BYTES) / 4);
+      const points = new Float32Array(bytes.buffer, pointsOffset, pointCount * 2);
+      const strings = new Uint8Array(bytes.buffer, stringsOffset, stringBytes);
+
+      if (flags & DELTA_FLAG_FULL_RESYNC) {
+        keys.length = 0;
+        shapes.length = 0;
+        rights.length = 0;
+        bottoms.length = 0;
+        rectangles = 0;
+        strokes = 0;
+        maxX = 0;
+        maxY = 0;
+        edgesStale = false;
+      }
+
+      for (let index = 0; index < recordCount; index += 1) {
+        const base = (index * DELTA_RECORD_BYTES) / 4;
+        const op = words[base];
+        const key = words[base + 1];
+        const body = base + 2;
+
+        if (op === CHANGE_REMOVE) {
+          const at = position(key);
+          if (keys[at] === key) {
+            remove(at);
+          }
+          continue;
+        }
+
+        if (op === CHANGE_APPEND_POINTS) {
+          const at = position(key);
+          const shape = keys[at] === key ? shapes[at] : undefined;
+          if (shape?.kind === 'stroke') {
+            const strokePoints = shape.points;
+            const kept = Math.min(strokePoints.length, words[body + 7]);
+            const truncated = kept < strokePoints.length;
+            strokePoints.length = kept;
+            let right = truncated ? shapeRight(shape) : rights[at];
+            let bottom = truncated ? shapeBottom(shape) : bottoms[at];
+            const first = words[body + 5];
+            for (let point = first; point < first + words[body + 6]; point += 1) {
+              const x = points[point * 2];
+              const y = points[point * 2 + 1];
+              strokePoints.push({ x, y });
+              right = Math.max(right, x);
+              bottom = Math.max(bottom, y);
+            }
+            setEdges(at, right, bottom);
+          }
+          continue;
+        }
+
+        const kind = words[body];
+        const color = rgbaToCss(words[body + 1]);
+        const id = readString(strings, words[body + 2]);
+        const name = readString(strings, words[body + 3]);
+        if (kind === SHAPE_KIND_RECTANGLE) {
+          put(key, {
+            id,
+            name,
+            kind: 'rectangle',
+            color,
+            x: floats[body + 4],
+            y: floats[body + 5],
+            width: floats[body + 6],
+            height: floats[body + 7]
+          });
+        } else if (kind === SHAPE_KIND_STROKE) {
+          put(key, {
+            id,
+            name,
+            kind: 'stroke',
+            color,
+            size: floats[body + 4],
+            points: readPoints(points, words[body + 5], words[body + 6])
+          });
+        }
+      }
+
+      if (edgesStale) {
+        maxX = 0;
+        maxY = 0;
+        for (let at = 0; at < rights.length; at += 1) {
+          maxX = Math.max(maxX, rights[at]);
+          maxY = Math.max(maxY, bottoms[at]);
+        }
+        edgesStale = false;
+      }
+
+      mirror.revision = revision;
+      return {
+        summary: { rectangles, strokes, maxX, maxY },
+        presences: readPresences(
+          new Int32Array(bytes.buffer, presencesOffset, (presenceCount * SNAPSHOT_PRESENCE_BYTES) / 4),
+          new Float32Array(bytes.buffer, presencesOffset, (presenceCount * SNAPSHOT_PRESENCE_BYTES) / 4),
+          presenceCount
+        )
+      };
+    }
+  };
+
+  return mirror;
+};
@@ -72,6 +72,21 @@ export interface EngineStatePayload {
   presences: EnginePresence[];
 }
 
+// What the UI sizes the workspace and counts shapes from: shape counts and the far edges of the shapes.
+export interface EngineDocumentSummary {
+  rectangles: number;
+  strokes: number;
+  // Largest right and bottom edges of any shape, and never below 0.
+  maxX: number;
+  maxY: number;
+}
+
+// What the UI keeps of the engine's state; the shapes themselves are only painted by the worker.
+export interface EngineViewState {
+  summary: EngineDocumentSummary;
+  presences: EnginePresence[];
+}
+
 export interface PointerEventPayload {
   type: 'pointerDown' | 'pointerMove' | 'pointerUp';
   pointerId: number;
@@ -81,3 +96,17 @@ export interface PointerEventPayload {
   altKey: boolean;
   metaKey: boolean;
 }
+
+// Pixels rasterized by the engine, to be put at (left, top) in device pixels; `pixels` aliases Wasm memory.
+// Only the dirty rectangle (frame pixels, empty when nothing changed) differs from the last frame at that place.
+export interface EngineFrame {
+  pixels: Uint8Array;
+  left: number;
+  top: number;
+  width: number;
+  height: number;
+  dirtyLeft: number;
+  dirtyTop: number;
+  dirtyWidth: number;
+  dirtyHeight: number;
+}
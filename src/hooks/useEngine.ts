@@ -1,14 +1,31 @@
 import { MutableRefObject, useCallback, useEffect, useRef, useState } from 'react';
-import { EngineCommand, EngineStatePayload, PointerEventPayload } from '../engine/types';
+import { EngineCommand, EngineViewState, PointerEventPayload } from '../engine/types';
 import { EngineWorker, UIToWorkerMessage, WorkerToUIMessage } from '../engine/messages';
+import { createDeltaMirror, summarizeShapes } from '../engine/snapshot';
+import {
+  CommandRingProducer,
+  createCommandRing,
+  createCommandRingProducer,
+  isCommandRingSupported
+} from '../engine/commandRing';
 
 type CanvasRef = MutableRefObject<HTMLCanvasElement | null>;
 
+// Scrolled area of the workspace, in document units.
+export type Viewport = { x: number; y: number; width: number; height: number };
+
 type UseEngineResult = {
-  state: EngineStatePayload;
+  state: EngineViewState;
   isReady: boolean;
   sendCommand: (command: EngineCommand) => void;
   forwardPointerEvent: (event: PointerEvent, scale?: { x: number; y: number }) => void;
+  setViewport: (viewport: Viewport) => void;
+  startRecording: () => void;
+  stopRecording: () => void;
+  saveDocument: () => void;
+  undo: () => void;
+  redo: () => void;
+  loadDocument: (file: Blob) => void;
 };
 
 const createWorker = () =>
@@ -16,6 +33,26 @@ const createWorker = () =>
     type: 'module'
   }) as EngineWorker;
 
+// Saves a worker session trace for engine/bench/session_replay.cpp.
+const downloadRecording = (buffer: ArrayBuffer) => {
+  const url = URL.createObjectURL(new Blob([buffer], { type: 'application/octet-stream' }));
+  const link = document.createElement('a');
+  link.href = url;
+  link.download = `minidraw-session-${Date.now()}.mdtr`;
+  link.click();
+  URL.revokeObjectURL(url);
+};
+
+// Saves the document (engine/include/document_format.hpp) from the chunks the worker produced.
+const downloadDocument = (chunks: ArrayBuffer[]) => {
+  const url = URL.createObjectURL(new Blob(chunks, { type: 'application/octet-stream' }));
+  const link = document.createElement('a');
+  link.href = url;
+  link.download = `minidraw-${Date.now()}.mddc`;
+  link.click();
+  URL.revokeObjectURL(url);
+};
+
 const toPointerPayload = (
   event: PointerEvent,
   bounds: DOMRect,
@@ -41,13 +78,14 @@ export const useEngine = (
   zoom: number = 1
 ): UseEngineResult => {
   const workerRef = useRef<EngineWorker | null>(null);
+  const ringRef = useRef<CommandRingProducer | null>(null);
   const initialSizeRef = useRef({ size: logicalSize, zoom });
 
   useEffect(() => {
     initialSizeRef.current = { size: logicalSize, zoom };
   }, [logicalSize?.height, logicalSize?.width, zoom]);
-  const [state, setState] = useState<EngineStatePayload>({
-    document: null,
+  const [state, setState] = useState<EngineViewState>({
+    summary: { rectangles: 0, strokes: 0, maxX: 0, maxY: 0 },
     presences: []
   });
   const [isReady, setIsReady] = useState(false);
@@ -74,16 +112,42 @@ export const useEngine = (
 
     const offscreen = canvas.transferControlToOffscreen();
     const dpr = Math.min(window.devicePixelRatio || 1, 2);
+    const mirror = createDeltaMirror();
+    // Without cross-origin isolation there is no SharedArrayBuffer and every event goes through postMessage.
+    const commandRing = isCommandRingSupported() ? createCommandRing() : undefined;
 
     const handleMessage = (event: MessageEvent<WorkerToUIMessage>) => {
       const { data } = event;
       if (data.type === 'ready') {
+        // The worker only accepts the ring when its engine can drain it; otherwise keep posting messages.
+        ringRef.current = data.commandRing && commandRing ? createCommandRingProducer(commandRing) : null;
         setIsReady(true);
         return;
       }
 
       if (data.type === 'state') {
-        setState(data.payload);
+        setState({
+          summary: summarizeShapes(data.payload.document?.shapes ?? []),
+          presences: data.payload.presences
+        });
+        return;
+      }
+
+      if (data.type === 'delta') {
+        const next = mirror.apply(new Uint8Array(data.buffer));
+        if (next) {
+          setState(next);
+        }
+        return;
+      }
+
+      if (data.type === 'recording') {
+        downloadRecording(data.buffer);
+        return;
+      }
+
+      if (data.type === 'document') {
+        downloadDocument(data.chunks);
         return;
       }
 
@@ -97,7 +161,8 @@ export const useEngine = (
     const initMessage: UIToWorkerMessage = {
       type: 'init',
       canvas: offscreen,
-      devicePixelRatio: dpr
+      devicePixelRatio: dpr,
+      commandRing
     };
     worker.postMessage(initMessage, [offscreen]);
 
@@ -116,6 +181,7 @@ export const useEngine = (
       worker.removeEventListener('message', handleMessage);
       worker.terminate();
       workerRef.current = null;
+      ringRef.current = null;
     };
   }, [canvasRef]);
 
@@ -136,6 +202,10 @@ export const useEngine = (
   }, [logicalSize?.height, logicalSize?.width, zoom]);
 
   const sendCommand = useCallback((command: EngineCommand) => {
+    if (ringRef.current) {
+      ringRef.current.push(command);
+      return;
+    }
     workerRef.current?.postMessage({ type: 'command', command });
   }, []);
 
@@ -147,6 +217,17 @@ export const useEngine = (
       }
 
       const bounds = canvas.getBoundingClientRect();
+      if (ringRef.current) {
+        // The engine only reacts to moves; skip building the payload object on this hot path.
+        if (event.type === 'pointermove') {
+          ringRef.current.pushPointerMove(
+            event.pointerId,
+            (event.clientX - bounds.left) * scale.x,
+            (event.clientY - bounds.top) * scale.y
+          );
+        }
+        return;
+      }
       workerRef.current.postMessage({
         type: 'pointer',
         event: toPointerPayload(event, bounds, scale)
@@ -155,10 +236,46 @@ export const useEngine = (
     [canvasRef]
   );
 
+  const setViewport = useCallback((viewport: Viewport) => {
+    workerRef.current?.postMessage({ type: 'viewport', ...viewport });
+  }, []);
+
+  const startRecording = useCallback(() => {
+    workerRef.current?.postMessage({ type: 'recordStart' });
+  }, []);
+
+  const stopRecording = useCallback(() => {
+    workerRef.current?.postMessage({ type: 'recordStop' });
+  }, []);
+
+  const saveDocument = useCallback(() => {
+    workerRef.current?.postMessage({ type: 'save' });
+  }, []);
+
+  const undo = useCallback(() => {
+    workerRef.current?.postMessage({ type: 'undo' });
+  }, []);
+
+  const redo = useCallback(() => {
+    workerRef.current?.postMessage({ type: 'redo' });
+  }, []);
+
+  // The file is streamed by the worker; only the Blob handle crosses the thread boundary.
+  const loadDocument = useCallback((file: Blob) => {
+    workerRef.current?.postMessage({ type: 'load', file });
+  }, []);
+
   return {
     state,
     isReady,
     sendCommand,
-    forwardPointerEvent
+    forwardPointerEvent,
+    setViewport,
+    startRecording,
+    stopRecording,
+    saveDocument,
+    undo,
+    redo,
+    loadDocument
   };
 };
@@ -1,11 +1,46 @@
 declare module '/engine/engine.mjs' {
-  import { EngineCommand, EngineStatePayload, PointerEventPayload } from '../engine/types';
+  import { EngineCommand, EngineFrame, EngineStatePayload, PointerEventPayload } from '../engine/types';
 
   export interface EngineHandle {
     resize(width: number, height: number): void;
+    setViewport(x: number, y: number, width: number, height: number): void;
+    setSimplifyTolerance(tolerance: number): void;
     pointerEvent(event: PointerEventPayload): void;
     execute(command: EngineCommand): void;
+    internString(value: string): number;
+    commandBuffer(byteLength: number): Uint8Array;
+    executeBatch(byteLength: number): void;
+    startedStrokes(): Uint32Array;
+    queryRect(minX: number, minY: number, maxX: number, maxY: number): Uint32Array;
+    queryPoint(x: number, y: number): Uint32Array;
+    queryRadius(x: number, y: number, radius: number): Uint32Array;
     tick(): EngineStatePayload;
+    tickBinary(): Uint8Array;
+    tickVisible(): Uint8Array;
+    tickSince(revision: number): Uint8Array;
+    render(scale: number): EngineFrame;
+    revision(): number;
+    beginSave(): void;
+    saveChunk(): Uint8Array;
+    beginLoad(): void;
+    loadBuffer(byteLength: number): Uint8Array;
+    loadChunk(byteLength: number): boolean;
+    finishLoad(): boolean;
+    beginArchiveSave(): void;
+    archiveBuffer(byteLength: number): Uint8Array;
+    openArchive(byteLength: number): boolean;
+    setJournaling(enabled: boolean): void;
+    journalChunk(): Uint8Array;
+    journalNeedsCompaction(): boolean;
+    beginCompaction(): void;
+    compactionComplete(): boolean;
+    replayJournal(byteLength: number): number;
+    undo(): boolean;
+    redo(): boolean;
+    canUndo(): boolean;
+    canRedo(): boolean;
+    beginUndoGroup(): void;
+    endUndoGroup(): void;
   }
 
   export interface EngineModule {
@@ -0,0 +1,185 @@
+/// <reference lib="webworker" />
+
+// Autosave of the board in the origin private file system: a snapshot in the compact document format (.mddc) and
+// the engine's operation journal over it. Each tick appends what the engine logged since the previous one, so it
+// costs the size of the edits rather than of the board. Once the engine asks for compaction, a new snapshot goes to
+// the slot not in use and the journal starts over; until the journal is rewritten, the old slot and old journal still
+// describe the same board. On start-up, the snapshot the journal continues is loaded and the journal replayed.
+//
+// A compaction is a full save, about 22 ms for 50 000 shapes, so it is written a few chunks per task and frames keep
+// running in between; ticks meanwhile append to the old journal. An edit cuts it short, and the next tick starts over.
+
+export interface JournalingEngine {
+  beginLoad(): void;
+  loadBuffer(byteLength: number): Uint8Array;
+  loadChunk(byteLength: number): boolean;
+  finishLoad(): boolean;
+  saveChunk(): Uint8Array;
+  setJournaling(enabled: boolean): void;
+  journalChunk(): Uint8Array;
+  journalNeedsCompaction(): boolean;
+  beginCompaction(): void;
+  compactionComplete(): boolean;
+  replayJournal(byteLength: number): number;
+}
+
+export interface Autosave {
+  // Appends the journal, and starts a compaction when the engine asks for it or the document was replaced.
+  tick(): void;
+  // A load replaced the document: the stored snapshot no longer matches it.
+  documentReplaced(): void;
+  close(): void;
+}
+
+const SNAPSHOT_FILES = ['board-a.mddc', 'board-b.mddc'];
+const JOURNAL_FILE = 'board.mdjl';
+// Save chunks are 256 KiB, about 1 ms each.
+const COMPACTION_CHUNKS_PER_TASK = 4;
+
+const readAll = (handle: FileSystemSyncAccessHandle) => {
+  const bytes = new Uint8Array(handle.getSize());
+  handle.read(bytes, { at: 0 });
+  return bytes;
+};
+
+const loadSnapshot = (engine: JournalingEngine, bytes: Uint8Array) => {
+  if (bytes.byteLength === 0) {
+    return false;
+  }
+  engine.beginLoad();
+  // Fetched right before writing: memory growth detaches earlier views of the Wasm heap.
+  engine.loadBuffer(bytes.byteLength).set(bytes);
+  engine.loadChunk(bytes.byteLength);
+  return engine.finishLoad();
+};
+
+const replay = (engine: JournalingEngine, journal: Uint8Array) => {
+  if (journal.byteLength === 0) {
+    return 0;
+  }
+  engine.loadBuffer(journal.byteLength).set(journal);
+  return engine.replayJournal(journal.byteLength);
+};
+
+// Null when the browser has no synchronous OPFS access, or another tab holds the files.
+export const openAutosave = async (engine: JournalingEngine): Promise<Autosave | null> => {
+  const files: FileSystemFileHandle[] = [];
+  const handles: FileSystemSyncAccessHandle[] = [];
+  try {
+    const root = await navigator.storage.getDirectory();
+    for (const name of [...SNAPSHOT_FILES, JOURNAL_FILE]) {
+      files.push(await root.getFileHandle(name, { create: true }));
+      handles.push(await files[files.length - 1].createSyncAccessHandle());
+    }
+  } catch (error) {
+    handles.forEach((handle) => handle.close());
+    console.info('Sauvegarde automatique indisponible.', error);
+    return null;
+  }
+  // The engine only journals for a caller that takes the chunks; edits made before this point ask for compaction.
+  engine.setJournaling(true);
+  const snapshots = handles.slice(0, SNAPSHOT_FILES.length);
+  const journal = handles[SNAPSHOT_FILES.length];
+
+  // The journal names the snapshot it continues; the engine tells whether a loaded one is it. If neither is (the
+  // journal was cut short while being rewritten), the newest snapshot already holds everything.
+  const stored = readAll(journal);
+  let active = -1;
+  let journalBytes = 0;
+  let replayed = replay(engine, stored);
+  if (replayed > 0) {
+    active = 0;
+    journalBytes = replayed;
+  }
+  for (let slot = 0; active < 0 && slot < snapshots.length; slot += 1) {
+    if (loadSnapshot(engine, readAll(snapshots[slot]))) {
+      replayed = replay(engine, stored);
+      if (replayed > 0) {
+        active = slot;
+        journalBytes = replayed;
+      }
+    }
+  }
+  let compactionDue = false;
+  if (active < 0) {
+    const modified = await Promise.all(
+      files.slice(0, SNAPSHOT_FILES.length).map(async (file) => (await file.getFile()).lastModified)
+    );
+    const newestFirst = modified[0] >= modified[1] ? [0, 1] : [1, 0];
+    active = newestFirst.find((slot) => loadSnapshot(engine, readAll(snapshots[slot]))) ?? 0;
+    // Whatever the engine now holds is saved again on the first tick, with a journal to match.
+    compactionDue = true;
+    journal.truncate(0);
+  } else {
+    // A torn last record is dropped; the engine continues the journal from there.
+    journal.truncate(journalBytes);
+  }
+  journal.flush();
+
+  const append = () => {
+    const chunk = engine.journalChunk();
+    if (chunk.byteLength > 0) {
+      journalBytes += journal.write(chunk, { at: journalBytes });
+      journal.flush();
+    }
+  };
+
+  // The compaction in progress: the slot it writes and how far, and the task that writes its next chunks.
+  let compaction: { slot: number; offset: number; task: ReturnType<typeof setTimeout> } | null = null;
+
+  const continueCompaction = () => {
+    if (!compaction) {
+      return;
+    }
+    const target = snapshots[compaction.slot];
+    for (let count = 0; count < COMPACTION_CHUNKS_PER_TASK; count += 1) {
+      const chunk = engine.saveChunk();
+      if (chunk.byteLength === 0) {
+        const slot = compaction.slot;
+        compaction = null;
+        if (!engine.compactionComplete()) {
+          // Cut short: the old slot and journal still hold the board.
+          return;
+        }
+        target.flush();
+        active = slot;
+        compactionDue = false;
+        journal.truncate(0);
+        journalBytes = 0;
+        append();
+        return;
+      }
+      compaction.offset += target.write(chunk, { at: compaction.offset });
+    }
+    compaction.task = setTimeout(continueCompaction, 0);
+  };
+
+  const compact = () => {
+    const slot = 1 - active;
+    snapshots[slot].truncate(0);
+    engine.beginCompaction();
+    compaction = { slot, offset: 0, task: setTimeout(continueCompaction, 0) };
+  };
+
+  return {
+    tick: () => {
+      // After a load, the journal continues a snapshot that is not stored yet: it waits for the compaction.
+      if (!compactionDue) {
+        append();
+      }
+      if (!compaction && (compactionDue || engine.journalNeedsCompaction())) {
+        compact();
+      }
+    },
+    documentReplaced: () => {
+      compactionDue = true;
+    },
+    close: () => {
+      if (compaction) {
+        clearTimeout(compaction.task);
+        compaction = null;
+      }
+      handles.forEach((handle) => handle.close());
+    }
+  };
+};
@@ -3,17 +3,61 @@
 import {
   EngineCommand,
   EngineDocument,
+  EngineFrame,
   EngineStatePayload,
   EngineStroke,
   PointerEventPayload
 } from '../engine/types';
 import { UIToWorkerMessage, WorkerToUIMessage } from '../engine/messages';
+import {
+  COMMAND_DEFINE_STRING,
+  COMMAND_FINISH_STROKE,
+  CommandEncoder,
+  createCommandEncoder
+} from '../engine/commandBuffer';
+import { CommandRingConsumer, createCommandRingConsumer } from '../engine/commandRing';
+import { SessionRecorder, createSessionRecorder } from '../engine/sessionRecorder';
+import { Autosave, JournalingEngine, openAutosave } from './autosave';
+import {
+  SHAPE_KIND_RECTANGLE,
+  SHAPE_KIND_STROKE,
+  SNAPSHOT_PRESENCE_BYTES,
+  SNAPSHOT_SHAPE_BYTES,
+  openSnapshot,
+  rgbaToCss
+} from '../engine/snapshot';
 
 interface EngineHandle {
   resize(width: number, height: number): void;
+  setViewport?(x: number, y: number, width: number, height: number): void;
   pointerEvent(event: PointerEventPayload): void;
   execute(command: EngineCommand): void;
+  internString?(value: string): number;
+  commandBuffer?(byteLength: number): Uint8Array;
+  executeBatch?(byteLength: number): void;
+  startedStrokes?(): Uint32Array;
   tick(): EngineStatePayload;
+  tickBinary?(): Uint8Array;
+  tickVisible?(): Uint8Array;
+  tickSince?(revision: number): Uint8Array;
+  render?(scale: number): EngineFrame;
+  revision?(): number;
+  beginSave?(): void;
+  saveChunk?(): Uint8Array;
+  beginLoad?(): void;
+  loadBuffer?(byteLength: number): Uint8Array;
+  loadChunk?(byteLength: number): boolean;
+  finishLoad?(): boolean;
+  archiveBuffer?(byteLength: number): Uint8Array;
+  openArchive?(byteLength: number): boolean;
+  setJournaling?(enabled: boolean): void;
+  journalChunk?(): Uint8Array;
+  journalNeedsCompaction?(): boolean;
+  beginCompaction?(): void;
+  compactionComplete?(): boolean;
+  replayJournal?(byteLength: number): number;
+  undo?(): boolean;
+  redo?(): boolean;
 }
 
 interface EngineModule {
@@ -22,15 +66,30 @@ interface EngineModule {
 
 const ctx: DedicatedWorkerGlobalScope = self as unknown as DedicatedWorkerGlobalScope;
 let engine: EngineHandle | null = null;
+let commandEncoder: CommandEncoder | null = null;
+let commandRing: CommandRingConsumer | null = null;
+let recorder: SessionRecorder | null = null;
+let autosave: Autosave | null = null;
+// String definitions already drained from the ring, by string index, replayed at the start of a recording so it
+// decodes standalone. Only strings later records may still name are kept: a stroke id goes once its stroke finishes.
+const ringDefinitions = new Map<number, Uint32Array>();
 let canvasCtx: OffscreenCanvasRenderingContext2D | null = null;
 let devicePixelRatio = 1;
 let renderScale = 1;
 let isInitialized = false;
 let animationHandle: number | null = null;
+let lastPaintedRevision = -1;
+// Resizing the canvas clears it, so the next native frame is put in full rather than by its dirty rectangle.
+let canvasCleared = true;
+// Scrolled area in document units, re-applied after each resize (which resets the engine's viewport).
+let viewport: { x: number; y: number; width: number; height: number } | null = null;
+let acknowledgedRevision = 0;
 
 const FRAME_MS = 1000 / 60;
+const AUTOSAVE_INTERVAL_MS = 3000;
 
-const post = (message: WorkerToUIMessage) => ctx.postMessage(message);
+const post = (message: WorkerToUIMessage, transfer: Transferable[] = []) =>
+  ctx.postMessage(message, transfer);
 
 const paintState = (
   state: EngineStatePayload,
@@ -81,15 +140,182 @@ const paintState = (
   context.restore();
 };
 
+// Paints straight from the Wasm heap view returned by tickBinary(); no per-shape objects are created.
+const paintSnapshot = (
+  bytes: Uint8Array,
+  context: OffscreenCanvasRenderingContext2D,
+  scale: number
+): number => {
+  const view = openSnapshot(bytes);
+  if (!view) {
+    context.clearRect(0, 0, context.canvas.width, context.canvas.height);
+    return -1;
+  }
+
+  const logicalWidth = context.canvas.width / scale;
+  const logicalHeight = context.canvas.height / scale;
+  const { shapeWords, shapeFloats, points } = view;
+
+  context.save();
+  context.scale(scale, scale);
+  context.clearRect(0, 0, logicalWidth, logicalHeight);
+  for (let index = 0; index < view.shapeCount; index += 1) {
+    const base = (index * SNAPSHOT_SHAPE_BYTES) / 4;
+    const kind = shapeWords[base];
+    const color = rgbaToCss(shapeWords[base + 1]);
+
+    if (kind === SHAPE_KIND_RECTANGLE) {
+      context.fillStyle = color;
+      context.fillRect(shapeFloats[base + 4], shapeFloats[base + 5], shapeFloats[base + 6], shapeFloats[base + 7]);
+      continue;
+    }
+
+    if (kind === SHAPE_KIND_STROKE) {
+      const size = shapeFloats[base + 4];
+      const first = shapeWords[base + 5] * 2;
+      const count = shapeWords[base + 6];
+      if (count === 0) {
+        continue;
+      }
+
+      context.strokeStyle = color;
+      context.lineWidth = size;
+      context.lineJoin = 'round';
+      context.lineCap = 'round';
+      if (count === 1) {
+        context.beginPath();
+        context.arc(points[first], points[first + 1], size / 2, 0, Math.PI * 2);
+        context.fillStyle = color;
+        context.fill();
+        continue;
+      }
+
+      context.beginPath();
+      context.moveTo(points[first], points[first + 1]);
+      for (let point = 1; point < count; point += 1) {
+        context.lineTo(points[first + point * 2], points[first + point * 2 + 1]);
+      }
+      context.stroke();
+    }
+  }
+  context.restore();
+  return view.revision;
+};
+
+// Native path: the engine rasterized the viewport itself, so a frame is a single blit of its dirty rectangle.
+const blitFrame = (frame: EngineFrame, context: OffscreenCanvasRenderingContext2D, whole: boolean) => {
+  const dirty = whole
+    ? { left: 0, top: 0, width: frame.width, height: frame.height }
+    : { left: frame.dirtyLeft, top: frame.dirtyTop, width: frame.dirtyWidth, height: frame.dirtyHeight };
+  if (dirty.width === 0 || dirty.height === 0) {
+    return;
+  }
+  if (typeof SharedArrayBuffer !== 'undefined' && frame.pixels.buffer instanceof SharedArrayBuffer) {
+    // The threaded engine's memory is shared and ImageData cannot wrap it: copy the dirty rows out.
+    const rowBytes = dirty.width * 4;
+    const copy = new Uint8ClampedArray(rowBytes * dirty.height);
+    for (let row = 0; row < dirty.height; row += 1) {
+      const start = frame.pixels.byteOffset + ((dirty.top + row) * frame.width + dirty.left) * 4;
+      copy.set(new Uint8Array(frame.pixels.buffer, start, rowBytes), row * rowBytes);
+    }
+    context.putImageData(new ImageData(copy, dirty.width, dirty.height), frame.left + dirty.left, frame.top + dirty.top);
+    return;
+  }
+  const pixels = new Uint8ClampedArray(frame.pixels.buffer, frame.pixels.byteOffset, frame.pixels.byteLength);
+  context.putImageData(
+    new ImageData(pixels, frame.width, frame.height),
+    frame.left,
+    frame.top,
+    dirty.left,
+    dirty.top,
+    dirty.width,
+    dirty.height
+  );
+};
+
+// Stroke ids are unique to their stroke (see App.tsx), so a finished stroke's id is never named again.
+const trackRingDefinitions = (batch: Uint8Array, byteLength: number) => {
+  const words = new Uint32Array(batch.buffer, batch.byteOffset, byteLength / 4);
+  let offset = 0;
+  while (offset < words.length) {
+    const count = words[offset] >>> 16;
+    if (count === 0 || offset + count > words.length) {
+      break;
+    }
+    const op = words[offset] & 0xffff;
+    if (op === COMMAND_DEFINE_STRING) {
+      ringDefinitions.set(words[offset + 1], words.slice(offset, offset + count));
+    } else if (op === COMMAND_FINISH_STROKE) {
+      ringDefinitions.delete(words[offset + 1]);
+    }
+    offset += count;
+  }
+};
+
+// Applies every command queued since the last frame in a single Wasm call.
+const flushCommands = () => {
+  if (!engine?.commandBuffer || !engine.executeBatch) {
+    return;
+  }
+
+  // Fetched right before writing: memory growth detaches earlier views of the Wasm heap.
+  if (commandRing) {
+    const byteLength = commandRing.available();
+    if (byteLength > 0) {
+      const batch = engine.commandBuffer(byteLength);
+      commandRing.readInto(batch, byteLength);
+      trackRingDefinitions(batch, byteLength);
+      recorder?.records(batch.subarray(0, byteLength));
+      engine.executeBatch(byteLength);
+    }
+    return;
+  }
+
+  if (commandEncoder && commandEncoder.byteLength > 0) {
+    const byteLength = commandEncoder.byteLength;
+    engine.commandBuffer(byteLength).set(commandEncoder.bytes());
+    engine.executeBatch(byteLength);
+    commandEncoder.reset();
+    // Strokes started in this batch get their handles; their later updates skip the id lookup.
+    if (engine.startedStrokes) {
+      commandEncoder.bindStrokeHandles(engine.startedStrokes());
+    }
+  }
+};
+
 const renderLoop = () => {
   if (!engine || !canvasCtx) {
     return;
   }
 
   try {
-    const state = engine.tick();
-    paintState(state, canvasCtx, renderScale);
-    post({ type: 'state', payload: state });
+    flushCommands();
+    recorder?.frame();
+    if (engine.tickBinary && engine.tickSince && engine.revision) {
+      const revision = engine.revision();
+      if (revision !== lastPaintedRevision) {
+        // Only shapes meeting the scrolled viewport are drawn; scrolling forces a repaint.
+        if (engine.render) {
+          blitFrame(engine.render(renderScale), canvasCtx, canvasCleared);
+          canvasCleared = false;
+          lastPaintedRevision = revision;
+        } else {
+          const snapshot = engine.tickVisible ? engine.tickVisible() : engine.tickBinary();
+          lastPaintedRevision = paintSnapshot(snapshot, canvasCtx, renderScale);
+        }
+      }
+      if (revision !== acknowledgedRevision) {
+        // postMessage is ordered and reliable, so a delta counts as acknowledged as soon as it is sent.
+        // The view aliases Wasm memory that the next tick overwrites, so the UI gets its own copy.
+        const delta = engine.tickSince(acknowledgedRevision).slice();
+        post({ type: 'delta', buffer: delta.buffer }, [delta.buffer]);
+        acknowledgedRevision = revision;
+      }
+    } else {
+      const state = engine.tick();
+      paintState(state, canvasCtx, renderScale);
+      post({ type: 'state', payload: state });
+    }
   } catch (error) {
     console.error(error);
     post({ type: 'log', message: `Erreur moteur: ${String(error)}` });
@@ -196,10 +422,50 @@ const createMockEngine = (): EngineHandle => {
   };
 };
 
-const loadEngineModule = async (): Promise<EngineModule | null> => {
+const instantiateEngine = async (module: { default?: unknown }): Promise<EngineModule | null> => {
+  if (typeof module.default === 'function') {
+    const instance = await module.default({
+      locateFile: (path: string) => `/engine/${path}`
+    });
+    if ('createEngine' in instance) {
+      return instance as unknown as EngineModule;
+    }
+  }
+  return null;
+};
+
+// Smallest module using SIMD128 instructions (i8x16.splat, i8x16.popcnt): it only validates where the engine-simd
+// flavors can run.
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11
+]);
+
+const supportsWasmSimd = () => {
+  try {
+    return WebAssembly.validate(SIMD_PROBE);
+  } catch {
+    return false;
+  }
+};
+
+// The threaded build spawns its pthread workers from its own script URL, so it is imported directly rather than
+// through a blob, and only where shared memory is available (cross-origin isolated pages).
+const loadThreadedEngineModule = async (name: string): Promise<EngineModule | null> => {
+  if (!globalThis.crossOriginIsolated) {
+    return null;
+  }
+  try {
+    return await instantiateEngine(await import(/* @vite-ignore */ `/engine/${name}.mjs`));
+  } catch (error) {
+    console.info(`Module WebAssembly ${name} indisponible.`, error);
+    return null;
+  }
+};
+
+const loadSequentialEngineModule = async (name: string): Promise<EngineModule | null> => {
   let moduleUrl: string | null = null;
   try {
-    const response = await fetch('/engine/engine.mjs', {
+    const response = await fetch(`/engine/${name}.mjs`, {
       cache: 'no-store'
     });
     if (!response.ok) {
@@ -208,32 +474,84 @@ const loadEngineModule = async (): Promise<EngineModule | null> => {
 
     const source = await response.text();
     moduleUrl = URL.createObjectURL(new Blob([source], { type: 'application/javascript' }));
-    const module = await import(/* @vite-ignore */ moduleUrl);
-    if (typeof module.default === 'function') {
-      const instance = await module.default({
-        locateFile: (path: string) => `/engine/${path}`
-      });
-      if ('createEngine' in instance) {
-        return instance as unknown as EngineModule;
-      }
-    }
+    return await instantiateEngine(await import(/* @vite-ignore */ moduleUrl));
   } catch (error) {
-    console.warn('Impossible de charger le module WebAssembly, fallback JS utilisé.', error);
+    console.info(`Module WebAssembly ${name} indisponible.`, error);
+    return null;
   } finally {
     if (moduleUrl) {
       URL.revokeObjectURL(moduleUrl);
     }
   }
+};
+
+// Fastest flavor first: threads, then SIMD128, each only where the browser supports it; engine.mjs is the baseline.
+const loadEngineModule = async (): Promise<EngineModule | null> => {
+  const simd = supportsWasmSimd();
+  const flavors: Array<[string, boolean]> = [
+    ['engine-mt-simd', true],
+    ['engine-mt', true],
+    ['engine-simd', false],
+    ['engine', false]
+  ];
+  for (const [name, threaded] of flavors) {
+    if (name.endsWith('-simd') && !simd) {
+      continue;
+    }
+    const instance = threaded ? await loadThreadedEngineModule(name) : await loadSequentialEngineModule(name);
+    if (instance) {
+      return instance;
+    }
+  }
+  console.warn('Impossible de charger le module WebAssembly, fallback JS utilisé.');
   return null;
 };
 
+const isJournaling = (candidate: EngineHandle): candidate is EngineHandle & JournalingEngine =>
+  Boolean(
+    candidate.beginLoad &&
+      candidate.loadBuffer &&
+      candidate.loadChunk &&
+      candidate.finishLoad &&
+      candidate.saveChunk &&
+      candidate.setJournaling &&
+      candidate.journalChunk &&
+      candidate.journalNeedsCompaction &&
+      candidate.beginCompaction &&
+      candidate.compactionComplete &&
+      candidate.replayJournal
+  );
+
+// Restores the autosaved board before the first frame, then stores the engine's journal every few seconds.
+const startAutosave = async (target: EngineHandle) => {
+  if (!isJournaling(target)) {
+    return;
+  }
+  autosave = await openAutosave(target);
+  if (!autosave) {
+    return;
+  }
+  post({ type: 'log', message: 'Sauvegarde automatique active.' });
+  setInterval(() => {
+    flushCommands();
+    autosave?.tick();
+  }, AUTOSAVE_INTERVAL_MS);
+};
+
 const handleInit = async (message: Extract<UIToWorkerMessage, { type: 'init' }>) => {
   devicePixelRatio = message.devicePixelRatio;
   const module = await loadEngineModule();
 
   if (module) {
     engine = module.createEngine(0, 0);
+    if (message.commandRing && engine.commandBuffer && engine.executeBatch) {
+      // The ring carries its own string definitions, so internString() indices must not be mixed into the table.
+      commandRing = createCommandRingConsumer(message.commandRing);
+    } else if (engine.internString && engine.executeBatch) {
+      commandEncoder = createCommandEncoder(engine.internString.bind(engine));
+    }
     post({ type: 'log', message: 'Moteur Wasm initialisé.' });
+    await startAutosave(engine);
   } else {
     engine = createMockEngine();
     post({ type: 'log', message: 'Moteur JS de secours initialisé.' });
@@ -245,7 +563,7 @@ const handleInit = async (message: Extract<UIToWorkerMessage, { type: 'init' }>)
   }
 
   isInitialized = true;
-  post({ type: 'ready' });
+  post({ type: 'ready', commandRing: commandRing !== null });
   cancelLoop();
   renderLoop();
 };
@@ -262,18 +580,153 @@ const handleResize = (message: Extract<UIToWorkerMessage, { type: 'resize' }>) =
 
   canvasCtx.canvas.width = Math.max(1, Math.floor(width * renderScale));
   canvasCtx.canvas.height = Math.max(1, Math.floor(height * renderScale));
+  lastPaintedRevision = -1;
+  canvasCleared = true;
 
   engine.resize(width, height);
+  if (viewport) {
+    engine.setViewport?.(viewport.x, viewport.y, viewport.width, viewport.height);
+  }
+};
+
+const handleViewport = (message: Extract<UIToWorkerMessage, { type: 'viewport' }>) => {
+  viewport = { x: message.x, y: message.y, width: message.width, height: message.height };
+  if (!engine?.setViewport) {
+    return;
+  }
+  engine.setViewport(viewport.x, viewport.y, viewport.width, viewport.height);
+  lastPaintedRevision = -1;
 };
 
 const handleCommand = (message: Extract<UIToWorkerMessage, { type: 'command' }>) => {
+  recorder?.command(message.command);
+  if (commandEncoder) {
+    commandEncoder.push(message.command);
+    return;
+  }
   engine?.execute(message.command);
 };
 
 const handlePointer = (message: Extract<UIToWorkerMessage, { type: 'pointer' }>) => {
+  recorder?.pointer(message.event);
   engine?.pointerEvent(message.event);
 };
 
+const handleRecordStart = () => {
+  recorder = createSessionRecorder();
+  for (const definition of ringDefinitions.values()) {
+    recorder.records(new Uint8Array(definition.buffer));
+  }
+  post({ type: 'log', message: 'Enregistrement de session démarré.' });
+};
+
+const handleRecordStop = () => {
+  if (!recorder) {
+    return;
+  }
+  const buffer = recorder.finish();
+  recorder = null;
+  post({ type: 'recording', buffer }, [buffer]);
+};
+
+// Commands already queued belong to the history before the undo or redo applies.
+const handleHistory = (type: 'undo' | 'redo') => {
+  if (!engine?.undo || !engine.redo) {
+    return;
+  }
+  flushCommands();
+  if (type === 'undo') {
+    engine.undo();
+  } else {
+    engine.redo();
+  }
+};
+
+// Copies the document out chunk by chunk within this one task, so no command can change it in between. The UI gets
+// the chunks as they are and builds a Blob from them, so the whole document is never one contiguous buffer.
+const handleSave = () => {
+  if (!engine?.beginSave || !engine.saveChunk) {
+    post({ type: 'log', message: 'Sauvegarde indisponible avec le moteur de secours.' });
+    return;
+  }
+  flushCommands();
+  engine.beginSave();
+  const chunks: ArrayBuffer[] = [];
+  for (let chunk = engine.saveChunk(); chunk.length > 0; chunk = engine.saveChunk()) {
+    chunks.push(chunk.slice().buffer);
+  }
+  post({ type: 'document', chunks }, chunks);
+};
+
+// Commands still queued were encoded against the replaced document, some by stroke handles that its successor may
+// reuse: they are dropped along with the bindings.
+const documentAdopted = () => {
+  commandEncoder?.reset();
+  commandEncoder?.forgetStrokeHandles();
+  lastPaintedRevision = -1;
+  autosave?.documentReplaced();
+};
+
+// Streams the file into the engine as it is read. Frames keep running meanwhile, on the current document, which the
+// loaded one replaces only once it has been read whole and found valid.
+const handleLoad = async (message: Extract<UIToWorkerMessage, { type: 'load' }>) => {
+  if (await isArchive(message.file)) {
+    await handleOpenArchive(message.file);
+    return;
+  }
+  if (!engine?.beginLoad || !engine.loadBuffer || !engine.loadChunk || !engine.finishLoad) {
+    post({ type: 'log', message: 'Chargement indisponible avec le moteur de secours.' });
+    return;
+  }
+  const target = engine;
+  target.beginLoad();
+  const reader = message.file.stream().getReader();
+  for (;;) {
+    const { done, value } = await reader.read();
+    if (done) {
+      break;
+    }
+    // Fetched right before writing: memory growth detaches earlier views of the Wasm heap.
+    target.loadBuffer(value.byteLength).set(value);
+    if (!target.loadChunk(value.byteLength)) {
+      await reader.cancel();
+      break;
+    }
+  }
+  if (target.finishLoad()) {
+    documentAdopted();
+    post({ type: 'log', message: 'Document chargé.' });
+  } else {
+    post({ type: 'log', message: 'Document invalide ou incomplet, chargement annulé.' });
+  }
+};
+
+// "MDAR", the magic of archives in the mappable layout (engine/include/archive_format.hpp).
+const ARCHIVE_MAGIC = [0x4d, 0x44, 0x41, 0x52];
+
+const isArchive = async (file: Blob) => {
+  const head = new Uint8Array(await file.slice(0, ARCHIVE_MAGIC.length).arrayBuffer());
+  return ARCHIVE_MAGIC.every((byte, index) => head[index] === byte);
+};
+
+// Archives are used in place by the engine, so the file is read whole and copied into engine memory in one go, with
+// no frame in between that could grow the heap and detach the view.
+const handleOpenArchive = async (file: Blob) => {
+  if (!engine?.archiveBuffer || !engine.openArchive) {
+    post({ type: 'log', message: "Ouverture d'archive indisponible avec le moteur de secours." });
+    return;
+  }
+  const target = engine;
+  const bytes = new Uint8Array(await file.arrayBuffer());
+  target.archiveBuffer(bytes.byteLength).set(bytes);
+  if (target.openArchive(bytes.byteLength)) {
+    documentAdopted();
+    post({ type: 'log', message: 'Archive ouverte.' });
+  } else {
+    post({ type: 'log', message: 'Archive invalide, ouverture annulée.' });
+  }
+};
+
 ctx.addEventListener('message', (event: MessageEvent<UIToWorkerMessage>) => {
   const { data } = event;
 
@@ -294,12 +747,34 @@ ctx.addEventListener('message', (event: MessageEvent<UIToWorkerMessage>) => {
     case 'resize':
       handleResize(data);
       break;
+    case 'viewport':
+      handleViewport(data);
+      break;
     case 'command':
       handleCommand(data);
       break;
     case 'pointer':
       handlePointer(data);
       break;
+    case 'recordStart':
+      handleRecordStart();
+      break;
+    case 'recordStop':
+      handleRecordStop();
+      break;
+    case 'save':
+      handleSave();
+      break;
+    case 'undo':
+    case 'redo':
+      handleHistory(data.type);
+      break;
+    case 'load':
+      handleLoad(data).catch((error) => {
+        console.error(error);
+        post({ type: 'log', message: `Erreur de chargement: ${String(error)}` });
+      });
+      break;
     default:
       break;
   }
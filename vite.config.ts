@@ -1,8 +1,20 @@
 import { defineConfig } from 'vite';
 import react from '@vitejs/plugin-react';
 
+// Cross-origin isolation enables SharedArrayBuffer for the UI → worker command ring.
+const isolationHeaders = {
+  'Cross-Origin-Opener-Policy': 'same-origin',
+  'Cross-Origin-Embedder-Policy': 'require-corp'
+};
+
 export default defineConfig({
   plugins: [react()],
+  server: {
+    headers: isolationHeaders
+  },
+  preview: {
+    headers: isolationHeaders
+  },
   worker: {
     format: 'es'
   },